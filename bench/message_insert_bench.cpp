@@ -0,0 +1,151 @@
+// 消息写入基准: 对比逐条提交与组提交的持续写入吞吐
+//
+// 每个线程循环调用 MessageHandler::Insert, 输出每种模式下的 msgs/s 与单条写入延迟分位数(微秒).
+//   direct - 每条消息一个事务, 每次提交都要等待 redo log 落盘
+//   group  - 经 MessageBatchWriter 攒批, 一个事务提交一批消息
+// 结束后删除本次写入的消息.
+#include "logger.h"
+#include "odb_client.h"
+#include "message_handler.h"
+#include "etcd_client.h"
+#include <gflags/gflags.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+
+DEFINE_string(host, "127.0.0.1", "MySQL 地址");
+DEFINE_int32(port, 3306, "MySQL 端口");
+DEFINE_string(user, "root", "MySQL 用户");
+DEFINE_string(password, "", "MySQL 密码");
+DEFINE_string(db, "instant_social", "MySQL 库名");
+DEFINE_string(threads, "1,16,64", "并发线程数列表");
+DEFINE_int32(messages, 20000, "每组测试写入的消息总数");
+DEFINE_int32(max_batch, 256, "group 模式每批最多条数");
+DEFINE_int32(max_delay_us, 2000, "group 模式攒批等待时间(微秒)");
+DEFINE_int32(content_size, 64, "消息内容字节数");
+DEFINE_string(modes, "direct,group", "测试模式列表");
+DEFINE_string(etcd_host, "http://127.0.0.1:2379", "etcd 地址, 从中租用消息主键的 worker id");
+
+namespace
+{
+    using namespace InstantSocial;
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::string> Split(const std::string &text)
+    {
+        std::vector<std::string> items;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    int64_t Percentile(const std::vector<int64_t> &sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+    }
+
+    void RunOnce(const std::shared_ptr<odb::core::database> &db, const IdGenerator::Ptr &ids, const std::string &mode, int threads)
+    {
+        MessageHandler handler(db, ids);
+        if (mode == "group")
+        {
+            MessageBatchWriterOptions options;
+            options.max_batch = FLAGS_max_batch;
+            options.max_delay = std::chrono::microseconds(FLAGS_max_delay_us);
+            options.metrics_prefix = "";
+            handler.EnableGroupCommit(options);
+        }
+
+        std::string run = "bench_" + mode + "_" + std::to_string(threads) + "_" +
+                          std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+        std::string content(FLAGS_content_size, 'x');
+        const size_t per_thread = FLAGS_messages / threads;
+        std::vector<std::vector<int64_t>> latencies(threads);
+        std::vector<std::thread> workers;
+        std::atomic<size_t> failures{0};
+        auto start = Clock::now();
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                auto &lat = latencies[t];
+                lat.reserve(per_thread);
+                std::string session_id = run + "_" + std::to_string(t);
+                for (size_t n = 0; n < per_thread; ++n)
+                {
+                    MessageEntity message(session_id + "_" + std::to_string(n), session_id, "bench_user",
+                                          MessageType::TEXT, boost::posix_time::microsec_clock::universal_time());
+                    message.content(content);
+                    auto begin = Clock::now();
+                    if (!handler.Insert(message)) ++failures;
+                    lat.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count());
+                }
+            });
+        }
+        for (auto &w : workers) w.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<int64_t> all;
+        for (auto &lat : latencies) all.insert(all.end(), lat.begin(), lat.end());
+        std::sort(all.begin(), all.end());
+        printf("%-8s %-8d %12.0f %10ld %10ld %10ld", mode.c_str(), threads, all.size() / std::max(seconds, 1e-9),
+               static_cast<long>(Percentile(all, 0.50)),
+               static_cast<long>(Percentile(all, 0.99)),
+               static_cast<long>(all.empty() ? 0 : all.back()));
+        if (failures > 0) printf("  (%zu failed)", failures.load());
+        printf("\n");
+        fflush(stdout);
+
+        for (int t = 0; t < threads; ++t)
+        {
+            handler.Remove(run + "_" + std::to_string(t));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    InstantSocial::init_logger(false, "bench_logs.txt", 0);
+    InstantSocial::g_logger->set_level(spdlog::level::warn);
+
+    MySQLPoolOptions pool_options;
+    pool_options.max_connections = 64;
+    pool_options.metrics_prefix = "";
+    auto db = ODBFactory::Create(DatabaseType::MySQL, FLAGS_host, FLAGS_user, FLAGS_password, FLAGS_db, FLAGS_port, pool_options);
+    if (!db)
+    {
+        printf("connect %s:%d failed\n", FLAGS_host.c_str(), FLAGS_port);
+        return 1;
+    }
+
+    // 各轮共用一个生成器, 与同时运行的其他实例也不会发出相同的主键
+    IdGenerator::Ptr ids;
+    try
+    {
+        ids = LeasedIdGenerator(std::make_shared<WorkerIdLease>(FLAGS_etcd_host, "/id_worker/", "message_insert_bench"));
+    }
+    catch (const std::exception &e)
+    {
+        printf("lease worker id from %s failed: %s\n", FLAGS_etcd_host.c_str(), e.what());
+        return 1;
+    }
+
+    printf("%-8s %-8s %12s %10s %10s %10s\n", "mode", "threads", "msgs/s", "p50(us)", "p99(us)", "max(us)");
+    for (auto &mode : Split(FLAGS_modes))
+    {
+        for (auto &threads : Split(FLAGS_threads))
+        {
+            RunOnce(db, ids, mode, std::max(std::stoi(threads), 1));
+        }
+    }
+    return 0;
+}
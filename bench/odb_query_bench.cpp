@@ -0,0 +1,187 @@
+// ODB 查询基准: 对比每次构造 odb::query 与按连接缓存的预编译查询
+//
+// 每个线程循环执行按主键查用户与好友关系存在性检查, 输出每种模式下的 QPS、
+// 单次查询延迟分位数(微秒)以及本进程每次查询消耗的 CPU 时间(微秒).
+//   adhoc    - 每次调用都构造新的 odb::query, MySQL 每次重新解析并准备语句
+//   prepared - 调用 UserHandler / RelationHandler, 语句在连接上准备一次后重复执行
+// 数据库服务端的 CPU 变化需结合 mysqld 的监控一起看.
+#include "logger.h"
+#include "odb_client.h"
+#include "user_handler.h"
+#include "relation_handler.h"
+#include <gflags/gflags.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <thread>
+
+DEFINE_string(host, "127.0.0.1", "MySQL 地址");
+DEFINE_int32(port, 3306, "MySQL 端口");
+DEFINE_string(user, "root", "MySQL 用户");
+DEFINE_string(password, "", "MySQL 密码");
+DEFINE_string(db, "instant_social", "MySQL 库名");
+DEFINE_string(threads, "1,8,32", "并发线程数列表");
+DEFINE_int32(queries, 100000, "每组测试的查询总数");
+DEFINE_int32(users, 1000, "预置的测试用户数");
+DEFINE_string(modes, "adhoc,prepared", "测试模式列表");
+
+namespace
+{
+    using namespace InstantSocial;
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::string> Split(const std::string &text)
+    {
+        std::vector<std::string> items;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    int64_t Percentile(const std::vector<int64_t> &sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+    }
+
+    double CpuSeconds()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    std::string UserId(size_t i)
+    {
+        return "bench_user_" + std::to_string(i);
+    }
+
+    // 预置用户与相邻用户之间的好友关系, 已存在时忽略插入失败
+    void Seed(const std::shared_ptr<odb::core::database> &db)
+    {
+        auto level = g_logger->level();
+        g_logger->set_level(spdlog::level::off);
+        UserHandler users(db);
+        RelationHandler relations(db);
+        for (int i = 0; i < FLAGS_users; ++i)
+        {
+            if (users.GetByUserID(UserId(i))) continue;
+            auto user = std::make_shared<UserEntity>(UserId(i), "bench_" + std::to_string(i), "password");
+            users.Insert(user);
+            if (i > 0) relations.Insert(UserId(i - 1), UserId(i));
+        }
+        g_logger->set_level(level);
+    }
+
+    void AdhocQuery(const std::shared_ptr<odb::core::database> &db, const std::string &user_id, const std::string &peer_id)
+    {
+        odb::transaction t(db->begin());
+        typedef odb::query<UserEntity> UserQuery;
+        std::unique_ptr<UserEntity> user(db->query_one<UserEntity>(UserQuery::user_id == user_id));
+        typedef odb::query<RelationEntity> RelationQuery;
+        odb::result<RelationEntity> r(db->query<RelationEntity>(RelationQuery::user_id == user_id && RelationQuery::peer_id == peer_id));
+        bool exists = !r.empty();
+        (void)exists;
+        t.commit();
+    }
+
+    void RunOnce(const std::shared_ptr<odb::core::database> &db, const std::string &mode, int threads)
+    {
+        UserHandler users(db);
+        RelationHandler relations(db);
+        const size_t per_thread = FLAGS_queries / threads / 2;
+        std::vector<std::vector<int64_t>> latencies(threads);
+        std::vector<std::thread> workers;
+        std::atomic<size_t> errors{0};
+        double cpu_start = CpuSeconds();
+        auto start = Clock::now();
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                auto &lat = latencies[t];
+                lat.reserve(per_thread);
+                try
+                {
+                    for (size_t n = 0; n < per_thread; ++n)
+                    {
+                        size_t i = (n * threads + t) % std::max(FLAGS_users - 1, 1);
+                        auto user_id = UserId(i);
+                        auto peer_id = UserId(i + 1);
+                        auto begin = Clock::now();
+                        if (mode == "adhoc")
+                        {
+                            AdhocQuery(db, user_id, peer_id);
+                        }
+                        else
+                        {
+                            users.GetByUserID(user_id);
+                            relations.Exists(user_id, peer_id);
+                        }
+                        // 每轮包含两次查询, 按单次查询记录延迟
+                        lat.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count() / 2);
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    ++errors;
+                    LOG_ERROR("bench thread {} failed: {}", t, e.what());
+                }
+            });
+        }
+        for (auto &w : workers) w.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double cpu = CpuSeconds() - cpu_start;
+
+        std::vector<int64_t> all;
+        for (auto &lat : latencies) all.insert(all.end(), lat.begin(), lat.end());
+        std::sort(all.begin(), all.end());
+        size_t queries = all.size() * 2;
+        printf("%-10s %-8d %12.0f %10ld %10ld %14.1f", mode.c_str(), threads, queries / std::max(seconds, 1e-9),
+               static_cast<long>(Percentile(all, 0.50)),
+               static_cast<long>(Percentile(all, 0.99)),
+               queries ? cpu * 1e6 / queries : 0.0);
+        if (errors > 0) printf("  (%zu threads failed)", errors.load());
+        printf("\n");
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    InstantSocial::init_logger(false, "bench_logs.txt", 0);
+    InstantSocial::g_logger->set_level(spdlog::level::warn);
+
+    int max_threads = 1;
+    for (auto &threads : Split(FLAGS_threads)) max_threads = std::max(max_threads, std::stoi(threads));
+    MySQLPoolOptions pool_options;
+    pool_options.min_connections = max_threads;
+    pool_options.max_connections = max_threads;
+    pool_options.metrics_prefix = "";
+    auto db = ODBFactory::Create(DatabaseType::MySQL, FLAGS_host, FLAGS_user, FLAGS_password, FLAGS_db, FLAGS_port, pool_options);
+    if (!db)
+    {
+        printf("connect %s:%d failed\n", FLAGS_host.c_str(), FLAGS_port);
+        return 1;
+    }
+    Seed(db);
+
+    printf("%-10s %-8s %12s %10s %10s %14s\n", "mode", "threads", "queries/s", "p50(us)", "p99(us)", "cpu/query(us)");
+    for (auto &mode : Split(FLAGS_modes))
+    {
+        for (auto &threads : Split(FLAGS_threads))
+        {
+            RunOnce(db, mode, std::max(std::stoi(threads), 1));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+// RabbitMQHandler 吞吐与延迟基准测试
+//
+// 默认在进程内启动 LocalAmqpBroker, 指定 --host 时改为连接真实 RabbitMQ.
+// 对每组 (消息大小, 生产者数, 预取数) 组合输出:
+//   publish msgs/s  - 生产者提交并由事件循环写出全部消息的速率(以 Flush 返回为准)
+//   consume msgs/s  - 消费端从收到第一条到最后一条消息的速率
+//   p50/p90/p99/max - 端到端延迟(微秒), 发送时间戳嵌在消息体前 8 字节
+#include "logger.h"
+#include "rabbitmq.h"
+#include "local_amqp_broker.h"
+#include <gflags/gflags.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <condition_variable>
+
+DEFINE_string(host, "", "RabbitMQ 地址, 为空时使用进程内 LocalAmqpBroker");
+DEFINE_int32(port, 5672, "RabbitMQ 端口");
+DEFINE_string(user, "guest", "RabbitMQ 用户名");
+DEFINE_string(password, "guest", "RabbitMQ 密码");
+DEFINE_int32(messages, 20000, "每组测试发送的消息总数");
+DEFINE_string(sizes, "64,1024,16384", "消息大小(字节)列表");
+DEFINE_string(producers, "1,4", "生产者数量列表");
+DEFINE_string(prefetch, "1,64,512", "消费端预取数量列表, 0 表示不限制");
+DEFINE_int32(timeout_s, 60, "单组测试等待消费完成的超时时间(秒)");
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<int> ParseList(const std::string &text)
+    {
+        std::vector<int> values;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (!item.empty()) values.push_back(std::stoi(item));
+        }
+        return values;
+    }
+
+    int64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    int64_t Percentile(const std::vector<int64_t> &sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+        return sorted[index];
+    }
+
+    struct RunResult
+    {
+        double publish_rate = 0;
+        double consume_rate = 0;
+        size_t received = 0;
+        std::vector<int64_t> latencies_us;
+    };
+
+    RunResult RunOnce(const std::string &host, int port, int size, int producers, int prefetch, int run_id)
+    {
+        const std::string exchange = "bench_exchange";
+        const std::string queue = "bench_queue_" + std::to_string(run_id);
+        const std::string key = "bench_key_" + std::to_string(run_id);
+        const size_t total = static_cast<size_t>(FLAGS_messages);
+
+        RunResult result;
+        std::mutex mutex;
+        std::condition_variable cond;
+        int64_t first_ns = 0, last_ns = 0;
+        result.latencies_us.reserve(total);
+
+        InstantSocial::RabbitMQHandler consumer(FLAGS_user, FLAGS_password, host, port);
+        consumer.DeclareComponents(exchange, queue, key);
+        consumer.SetPrefetch(static_cast<uint16_t>(prefetch));
+        consumer.ConsumeMessage(queue, [&](const char *data, size_t len)
+        {
+            int64_t now = NowNs();
+            int64_t sent = 0;
+            if (len >= sizeof(sent)) memcpy(&sent, data, sizeof(sent));
+            std::lock_guard<std::mutex> lock(mutex);
+            if (result.received == 0) first_ns = now;
+            last_ns = now;
+            result.latencies_us.push_back((now - sent) / 1000);
+            if (++result.received == total) cond.notify_all();
+        });
+        consumer.Flush();
+
+        std::vector<std::unique_ptr<InstantSocial::RabbitMQHandler>> clients;
+        for (int i = 0; i < producers; ++i)
+        {
+            clients.push_back(std::make_unique<InstantSocial::RabbitMQHandler>(FLAGS_user, FLAGS_password, host, port));
+            // 每个连接自行声明一次, 保证在同一信道内绑定先于 publish 生效
+            clients.back()->DeclareComponents(exchange, queue, key);
+            clients.back()->Flush();
+        }
+
+        std::vector<std::thread> threads;
+        std::atomic<int64_t> publish_end_ns{0};
+        int64_t publish_start_ns = NowNs();
+        for (int i = 0; i < producers; ++i)
+        {
+            size_t count = total / producers + (static_cast<size_t>(i) < total % producers ? 1 : 0);
+            threads.emplace_back([&, i, count]()
+            {
+                std::string body(std::max<size_t>(size, sizeof(int64_t)), 'x');
+                for (size_t n = 0; n < count; ++n)
+                {
+                    int64_t now = NowNs();
+                    memcpy(&body[0], &now, sizeof(now));
+                    clients[i]->PublishMessage(exchange, body, key);
+                }
+                clients[i]->Flush();
+                int64_t end = NowNs();
+                int64_t prev = publish_end_ns.load();
+                while (end > prev && !publish_end_ns.compare_exchange_weak(prev, end)) {}
+            });
+        }
+        for (auto &t : threads) t.join();
+        result.publish_rate = total * 1e9 / std::max<int64_t>(publish_end_ns - publish_start_ns, 1);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait_for(lock, std::chrono::seconds(FLAGS_timeout_s), [&]() { return result.received == total; });
+        if (result.received > 1)
+        {
+            result.consume_rate = result.received * 1e9 / std::max<int64_t>(last_ns - first_ns, 1);
+        }
+        // 超时时消费者仍可能在回调中写 result, 拷贝一份再返回
+        RunResult out = result;
+        lock.unlock();
+        std::sort(out.latencies_us.begin(), out.latencies_us.end());
+        return out;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    InstantSocial::init_logger(false, "bench_logs.txt", 0);
+    InstantSocial::g_logger->set_level(spdlog::level::warn);
+
+    InstantSocial::LocalAmqpBroker broker;
+    std::string host = FLAGS_host;
+    int port = FLAGS_port;
+    if (host.empty())
+    {
+        host = "127.0.0.1";
+        port = broker.Start();
+        if (port == 0)
+        {
+            LOG_ERROR("Failed to start LocalAmqpBroker");
+            return -1;
+        }
+    }
+
+    printf("%-8s %-10s %-9s %14s %14s %10s %10s %10s %10s\n",
+           "size", "producers", "prefetch", "publish msg/s", "consume msg/s", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    int run_id = 0;
+    for (int size : ParseList(FLAGS_sizes))
+    {
+        for (int producers : ParseList(FLAGS_producers))
+        {
+            for (int prefetch : ParseList(FLAGS_prefetch))
+            {
+                RunResult r = RunOnce(host, port, size, std::max(producers, 1), prefetch, run_id++);
+                printf("%-8d %-10d %-9d %14.0f %14.0f %10ld %10ld %10ld %10ld",
+                       size, producers, prefetch, r.publish_rate, r.consume_rate,
+                       static_cast<long>(Percentile(r.latencies_us, 0.50)),
+                       static_cast<long>(Percentile(r.latencies_us, 0.90)),
+                       static_cast<long>(Percentile(r.latencies_us, 0.99)),
+                       static_cast<long>(r.latencies_us.empty() ? 0 : r.latencies_us.back()));
+                if (r.received != static_cast<size_t>(FLAGS_messages))
+                {
+                    printf("  (timeout, received %zu/%d)", r.received, FLAGS_messages);
+                }
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
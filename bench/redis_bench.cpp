@@ -0,0 +1,153 @@
+// Redis 单 key 命令吞吐基准: 对比逐条发送、自动流水线与手工流水线
+//
+// 每个线程循环执行 SET + GET, 输出每种模式下的 ops/s 与单条命令延迟分位数(微秒).
+//   direct   - 每条命令独占一次往返
+//   auto     - 经 RedisClient 的自动流水线合并并发命令, 调用方式与 direct 相同
+//   pipeline - 每个线程手工攒 --batch 条命令再发送, 作为吞吐上限参考
+#include "logger.h"
+#include "redis_client.h"
+#include <gflags/gflags.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+
+DEFINE_string(host, "127.0.0.1", "Redis 地址");
+DEFINE_int32(port, 6379, "Redis 端口");
+DEFINE_string(password, "", "Redis 密码");
+DEFINE_int32(pool_size, 8, "连接池大小");
+DEFINE_string(threads, "1,16,128", "并发线程数列表");
+DEFINE_int32(ops, 200000, "每组测试的命令总数");
+DEFINE_int32(batch, 64, "pipeline 模式下每条流水线的命令数");
+DEFINE_int32(window_us, 0, "auto 模式的攒批等待时间(微秒)");
+DEFINE_int32(flushers, 2, "auto 模式同时在途的流水线数");
+DEFINE_string(modes, "direct,auto,pipeline", "测试模式列表");
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::string> Split(const std::string &text)
+    {
+        std::vector<std::string> items;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, ','))
+        {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    int64_t Percentile(const std::vector<int64_t> &sorted, double p)
+    {
+        if (sorted.empty()) return 0;
+        return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+    }
+
+    InstantSocial::RedisClient::Ptr Connect(bool auto_pipeline)
+    {
+        InstantSocial::RedisOptions options;
+        options.host = FLAGS_host;
+        options.port = FLAGS_port;
+        options.password = FLAGS_password;
+        options.pool_size = FLAGS_pool_size;
+        options.wait_timeout = std::chrono::milliseconds(0);
+        options.metrics_prefix = "";
+        options.auto_pipeline.enabled = auto_pipeline;
+        options.auto_pipeline.window = std::chrono::microseconds(FLAGS_window_us);
+        options.auto_pipeline.flushers = FLAGS_flushers;
+        return InstantSocial::RedisFactory::Create(options);
+    }
+
+    void RunOnce(const std::string &mode, int threads)
+    {
+        auto client = Connect(mode == "auto");
+        if (!client)
+        {
+            printf("%-10s %-8d connect failed\n", mode.c_str(), threads);
+            return;
+        }
+
+        const size_t per_thread = FLAGS_ops / threads / 2;
+        std::vector<std::vector<int64_t>> latencies(threads);
+        std::vector<std::thread> workers;
+        std::atomic<size_t> errors{0};
+        auto start = Clock::now();
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                auto &lat = latencies[t];
+                lat.reserve(per_thread * 2);
+                std::string key = "bench:" + std::to_string(t);
+                try
+                {
+                    if (mode == "pipeline")
+                    {
+                        size_t batch = std::max(FLAGS_batch / 2, 1);
+                        for (size_t n = 0; n < per_thread; n += batch)
+                        {
+                            auto begin = Clock::now();
+                            auto pipe = client->Standalone()->pipeline(false);
+                            for (size_t i = 0; i < batch; ++i)
+                            {
+                                pipe.set(key, "value").get(key);
+                            }
+                            pipe.exec();
+                            auto cost = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count();
+                            lat.insert(lat.end(), batch * 2, cost);
+                        }
+                        return;
+                    }
+                    for (size_t n = 0; n < per_thread; ++n)
+                    {
+                        auto begin = Clock::now();
+                        client->Set(key, "value");
+                        auto mid = Clock::now();
+                        client->Get(key);
+                        auto end = Clock::now();
+                        lat.push_back(std::chrono::duration_cast<std::chrono::microseconds>(mid - begin).count());
+                        lat.push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - mid).count());
+                    }
+                }
+                catch (const std::exception &e)
+                {
+                    ++errors;
+                    LOG_ERROR("bench thread {} failed: {}", t, e.what());
+                }
+            });
+        }
+        for (auto &w : workers) w.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<int64_t> all;
+        for (auto &lat : latencies) all.insert(all.end(), lat.begin(), lat.end());
+        std::sort(all.begin(), all.end());
+        printf("%-10s %-8d %12.0f %10ld %10ld %10ld", mode.c_str(), threads, all.size() / std::max(seconds, 1e-9),
+               static_cast<long>(Percentile(all, 0.50)),
+               static_cast<long>(Percentile(all, 0.99)),
+               static_cast<long>(all.empty() ? 0 : all.back()));
+        if (errors > 0) printf("  (%zu threads failed)", errors.load());
+        printf("\n");
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    InstantSocial::init_logger(false, "bench_logs.txt", 0);
+    InstantSocial::g_logger->set_level(spdlog::level::warn);
+
+    printf("%-10s %-8s %12s %10s %10s %10s\n", "mode", "threads", "ops/s", "p50(us)", "p99(us)", "max(us)");
+    for (auto &mode : Split(FLAGS_modes))
+    {
+        for (auto &threads : Split(FLAGS_threads))
+        {
+            RunOnce(mode, std::max(std::stoi(threads), 1));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef DATABASE_ROUTER_H
+#define DATABASE_ROUTER_H
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <bvar/bvar.h>
+#include <odb/database.hxx>
+#include "local_cache.h"
+
+namespace InstantSocial
+{
+    struct DatabaseRouterOptions
+    {
+        std::chrono::milliseconds max_replica_lag{1000};        // 复制延迟超过该值的从库不参与读
+        std::chrono::milliseconds sticky_window{5000};          // 写入后该 key 的读取保持读主库(或已追上的从库)的最长时间
+        std::chrono::milliseconds heartbeat_interval{500};      // 主库写心跳与测量从库延迟的周期
+        size_t sticky_capacity = 100000;                        // 记录最近写入 key 的数量上限
+        std::string metrics_prefix = "db_router";               // bvar 指标前缀, 为空时不导出
+    };
+
+    // 读写分离路由: 写走主库, 读按延迟上限选择从库, 都不满足时回到主库.
+    // 读己之写: 写入后调用 MarkWritten(key), 之后 sticky_window 内读取同一 key 时
+    // 只选择复制进度已经越过该次写入的从库
+    class DatabaseRouter
+    {
+    public:
+        using Ptr = std::shared_ptr<DatabaseRouter>;
+        using Database = std::shared_ptr<odb::core::database>;
+
+        DatabaseRouter(const Database &primary, const std::vector<Database> &replicas,
+                       const DatabaseRouterOptions &options = DatabaseRouterOptions());
+        ~DatabaseRouter();
+
+        const Database &Primary() const { return m_primary; }
+        Database ForRead(const std::string &key = std::string());
+        // 任一 key 最近写入过都按读己之写处理
+        Database ForRead(const std::vector<std::string> &keys);
+        void MarkWritten(const std::string &key);
+        void MarkWritten(const std::vector<std::string> &keys);
+
+        size_t ReplicaCount() const { return m_replicas.size(); }
+        // 最近一次测得的复制延迟(微秒), 未知时返回 -1
+        int64_t ReplicaLag(size_t index) const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Replica
+        {
+            Database db;
+            std::atomic<int64_t> lag_us{-1};
+            std::atomic<int64_t> caught_up_to{0};  // 该从库已应用到的主库时间点, 本地 steady 时钟微秒
+            std::atomic<int64_t> measured_at{0};
+        };
+
+        struct Metrics
+        {
+            bvar::Adder<int64_t> primary_reads;
+            bvar::Adder<int64_t> replica_reads;
+            bvar::Adder<int64_t> sticky_reads;
+            bvar::PassiveStatus<int64_t> healthy_replicas;
+            bvar::PassiveStatus<int64_t> max_lag_us;
+
+            explicit Metrics(DatabaseRouter *router);
+        };
+
+        static int64_t NowMicros();
+        // written_at 为 0 表示没有读己之写约束
+        Database Pick(int64_t written_at);
+        bool Eligible(const Replica &replica, int64_t now, int64_t written_at) const;
+        void Run();
+        void Heartbeat();
+        void Measure(Replica &replica);
+
+        void ExposeMetrics(const std::string &prefix);
+        static int64_t GetHealthyReplicas(void *arg);
+        static int64_t GetMaxLag(void *arg);
+
+    private:
+        Database m_primary;
+        std::vector<std::unique_ptr<Replica>> m_replicas;
+        DatabaseRouterOptions m_options;
+        ShardedLruCache<std::string, int64_t> m_written;
+        std::atomic<size_t> m_next{0};
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        bool m_stop = false;
+        std::thread m_heartbeat;
+        std::unique_ptr<Metrics> m_metrics;
+    };
+}
+
+#endif // DATABASE_ROUTER_H
@@ -0,0 +1,125 @@
+#ifndef DB_EXECUTOR_H
+#define DB_EXECUTOR_H
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+#include <bvar/bvar.h>
+#include "logger.h"
+
+namespace InstantSocial
+{
+    struct DbExecutorOptions
+    {
+        size_t threads = 16;                                // 执行数据库调用的线程数, 不宜超过连接池的 max_connections
+        size_t queue_capacity = 1024;                       // 排队中的调用上限, 队列满时新调用直接失败
+        std::chrono::milliseconds default_timeout{500};     // 未指定超时的调用在队列中最多等待的时间
+        std::string metrics_prefix = "db_executor";         // bvar 指标前缀, 为空时不导出
+    };
+
+    // 数据库执行器: 由固定数量的线程执行阻塞的 ODB 调用, 调用方(如 brpc 的 bthread)不必等待数据库 IO.
+    // 过载时丢弃而不是堆积: 队列满的调用立即失败, 排队超过截止时间的调用不再执行, 都以 R{} 作为结果返回,
+    // 与同步 handler 出错时的返回值(false、空列表、nullptr)一致. 截止时间只约束排队, 已开始的调用不会被中断
+    class DbExecutor
+    {
+    public:
+        using Ptr = std::shared_ptr<DbExecutor>;
+        using Clock = std::chrono::steady_clock;
+        // run 为 false 表示调用被丢弃(超过截止时间), 任务只需给出失败结果
+        using Task = std::function<void(bool run)>;
+
+        explicit DbExecutor(const DbExecutorOptions &options = DbExecutorOptions());
+        ~DbExecutor();
+
+        // 队列满或已停止时返回 false, task 不会被调用
+        bool Post(Task task, Clock::time_point deadline);
+        // timeout 不大于 0 时使用 default_timeout
+        Clock::time_point DeadlineAfter(std::chrono::milliseconds timeout) const;
+        // 执行完队列中剩余的调用后停止, 之后的调用直接失败
+        void Stop();
+
+        // 在执行器线程上执行 fn, 通过 future 取得结果. 在 bthread 中应使用回调版本, future::get 同样会阻塞工作线程
+        template <typename F, typename R = std::invoke_result_t<F>>
+        std::future<R> Submit(F fn, std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+        {
+            auto promise = std::make_shared<std::promise<R>>();
+            auto future = promise->get_future();
+            Dispatch(std::move(fn), [promise](R result) { promise->set_value(std::move(result)); }, timeout);
+            return future;
+        }
+
+        // 在执行器线程上执行 fn 并以其结果调用 done. 被丢弃时以 R{} 调用, 队列满时在调用方线程上立即调用
+        template <typename F, typename Done, typename R = std::invoke_result_t<F>>
+        void Dispatch(F fn, Done done, std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+        {
+            static_assert(std::is_default_constructible<R>::value, "DbExecutor needs a default failure result");
+            auto shared_done = std::make_shared<Done>(std::move(done));
+            auto task = [fn = std::move(fn), shared_done](bool run) mutable {
+                R result{};
+                if (run)
+                {
+                    try
+                    {
+                        result = fn();
+                    }
+                    catch (const std::exception &e)
+                    {
+                        LOG_ERROR("DbExecutor call failed: {}", e.what());
+                    }
+                }
+                (*shared_done)(std::move(result));
+            };
+            if (!Post(std::move(task), DeadlineAfter(timeout)))
+            {
+                (*shared_done)(R{});
+            }
+        }
+
+        size_t Queued();
+
+    private:
+        struct Pending
+        {
+            Task task;
+            Clock::time_point enqueued;
+            Clock::time_point deadline;
+        };
+
+        struct Metrics
+        {
+            bvar::PassiveStatus<int64_t> queued;
+            bvar::LatencyRecorder wait;
+            bvar::LatencyRecorder exec;
+            bvar::Adder<int64_t> rejected;
+            bvar::Adder<int64_t> expired;
+
+            explicit Metrics(DbExecutor *executor);
+        };
+
+        void Run();
+        void ExposeMetrics(const std::string &prefix);
+        static int64_t GetQueued(void *arg);
+
+    private:
+        DbExecutorOptions m_options;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::deque<Pending> m_queue;
+        bool m_stop = false;
+
+        std::vector<std::thread> m_workers;
+        std::unique_ptr<Metrics> m_metrics;
+    };
+}
+
+#endif // DB_EXECUTOR_H
@@ -6,8 +6,10 @@
 #include <etcd/Watcher.hpp>
 #include <etcd/Response.hpp>
 #include <etcd/KeepAlive.hpp>
+#include <atomic>
 #include <functional>
 #include "logger.h"
+#include "id_generator.h"
 
 namespace InstantSocial 
 {
@@ -25,6 +27,31 @@ namespace InstantSocial
         uint64_t m_lease_id;
     };
 
+    // 从 etcd 租一个集群内唯一的 worker id, 供 IdGenerator 使用: 在 prefix 下依次尝试创建 prefix + n(n < max_workers),
+    // 第一个创建成功的 n 即为 worker id, key 绑定在本实例的租约上并持续续约, 实例退出或失联超过 ttl 秒后自动释放.
+    // 续约失败后 Alive() 返回 false, 此时该 worker id 可能已被其他实例租走, 不能再用它发号
+    class WorkerIdLease
+    {
+    public:
+        using Ptr = std::shared_ptr<WorkerIdLease>;
+        // 没有空闲的 worker id 或访问 etcd 失败时抛出 std::runtime_error
+        WorkerIdLease(const std::string &host, const std::string &prefix, const std::string &owner,
+                      uint32_t max_workers = 1024, int ttl = 10);
+        ~WorkerIdLease();
+
+        uint32_t WorkerId() const { return m_worker_id; }
+        bool Alive() const { return m_alive.load(); }
+
+    private:
+        std::shared_ptr<etcd::Client> m_client;
+        std::shared_ptr<etcd::KeepAlive> m_keep_alive;
+        std::atomic<bool> m_alive{true};
+        uint32_t m_worker_id = 0;
+    };
+
+    // 使用租得的 worker id 发号, 租约失效后停止发号. 生成器持有 lease, 二者同生命周期
+    IdGenerator::Ptr LeasedIdGenerator(const WorkerIdLease::Ptr &lease, const IdGeneratorOptions &options = IdGeneratorOptions());
+
     class ServiceDiscovery 
     {
     public:
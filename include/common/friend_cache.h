@@ -0,0 +1,47 @@
+#ifndef FRIEND_CACHE_H
+#define FRIEND_CACHE_H
+
+#include <string>
+#include <vector>
+#include "redis_client.h"
+
+namespace InstantSocial
+{
+    struct FriendCacheOptions
+    {
+        std::chrono::milliseconds ttl{86400000};        // 好友集合闲置过期时间
+        std::chrono::milliseconds fill_timeout{5000};   // 回填令牌有效期
+        std::string key_prefix = "friends:";
+    };
+
+    // 每个用户的好友集合 Redis SET. 集合中始终带一个空串哨兵, 用来区分"已加载但没有好友"和"未加载".
+    // 增删只作用于已加载的集合, 未加载的集合由读取方从数据库整体回填, 回填期间发生的增删会使回填作废
+    class FriendCache
+    {
+    public:
+        using Ptr = std::shared_ptr<FriendCache>;
+        FriendCache(const RedisClient::Ptr &client, const FriendCacheOptions &options = FriendCacheOptions())
+            : m_client(client), m_options(options) {}
+
+        // 双向写入/删除 user_id <-> peer_id
+        void Add(const std::string &user_id, const std::string &peer_id);
+        void Remove(const std::string &user_id, const std::string &peer_id);
+        // 集合已加载时返回 true 并通过 is_friend 给出结果
+        bool Contains(const std::string &user_id, const std::string &peer_id, bool &is_friend);
+        bool Members(const std::string &user_id, std::vector<std::string> &peers);
+        std::string BeginFill(const std::string &user_id);
+        bool Fill(const std::string &user_id, const std::string &token, const std::vector<std::string> &peers);
+        void Invalidate(const std::string &user_id);
+
+    private:
+        std::string SetKey(const std::string &user_id) const { return m_options.key_prefix + "{" + user_id + "}"; }
+        std::string FillKey(const std::string &user_id) const { return m_options.key_prefix + "{" + user_id + "}:fill"; }
+        void Update(const RedisScript &script, const std::string &user_id, const std::string &peer_id);
+
+    private:
+        RedisClient::Ptr m_client;
+        FriendCacheOptions m_options;
+    };
+}
+
+#endif // FRIEND_CACHE_H
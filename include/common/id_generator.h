@@ -0,0 +1,63 @@
+#ifndef ID_GENERATOR_H
+#define ID_GENERATOR_H
+
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <functional>
+
+namespace InstantSocial
+{
+    struct IdGeneratorOptions
+    {
+        int64_t epoch_ms = 1704067200000;               // 时间戳起点 2024-01-01 00:00:00 UTC, 41 位毫秒约可用 69 年
+        std::chrono::milliseconds max_backward{10};     // 时钟回拨不超过该值时等待追上, 超过时 Next 返回 0
+    };
+
+    // 64 位按时间递增的 id: 最高位为 0, 41 位毫秒时间戳 + 10 位 worker id + 12 位序号, 每个 worker 每毫秒最多 4096 个.
+    // worker id 须在集群内唯一, 通常由 WorkerIdLease 从 etcd 租得. 同一进程内共享一个实例, 线程安全.
+    // 对外接口仍使用字符串 id 时用 ToString 转换: 定长 16 位小写十六进制, 字典序与数值序一致
+    class IdGenerator
+    {
+    public:
+        using Ptr = std::shared_ptr<IdGenerator>;
+        // 返回 false 时 worker id 可能已被其他实例占用, Next 停止发号
+        using LeaseCheck = std::function<bool()>;
+
+        static const int kWorkerBits = 10;
+        static const int kSequenceBits = 12;
+        static const uint32_t kMaxWorkerId = (1u << kWorkerBits) - 1;
+
+        // worker_id 超过 kMaxWorkerId 时抛出 std::invalid_argument
+        explicit IdGenerator(uint32_t worker_id, const IdGeneratorOptions &options = IdGeneratorOptions(),
+                             const LeaseCheck &lease_check = nullptr);
+
+        // 时钟回拨过大或租约已失效时返回 0
+        uint64_t Next();
+        uint32_t WorkerId() const { return m_worker_id; }
+
+        // 生成该 id 的 Unix 毫秒时间戳, 按同一 epoch_ms 解析
+        int64_t TimestampOf(uint64_t id) const { return static_cast<int64_t>(id >> (kWorkerBits + kSequenceBits)) + m_options.epoch_ms; }
+        static uint32_t WorkerOf(uint64_t id) { return static_cast<uint32_t>(id >> kSequenceBits) & kMaxWorkerId; }
+        static uint32_t SequenceOf(uint64_t id) { return static_cast<uint32_t>(id) & ((1u << kSequenceBits) - 1); }
+
+        static std::string ToString(uint64_t id);
+        // 只接受 ToString 的格式, 失败返回 false
+        static bool FromString(const std::string &str, uint64_t &id);
+
+    private:
+        int64_t NowMs() const;
+
+    private:
+        uint32_t m_worker_id;
+        IdGeneratorOptions m_options;
+        LeaseCheck m_lease_check;
+        std::mutex m_mutex;
+        int64_t m_last_ms = -1;
+        uint32_t m_sequence = 0;
+    };
+}
+
+#endif // ID_GENERATOR_H
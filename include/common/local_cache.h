@@ -0,0 +1,219 @@
+#ifndef LOCAL_CACHE_H
+#define LOCAL_CACHE_H
+
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+namespace InstantSocial
+{
+    // 分片 LRU 进程内缓存. 每个分片一把锁, 容量按 charge 计(默认每条记 1, 即按条数限制),
+    // 可选过期时间作为失效消息丢失时的兜底.
+    template <typename Key, typename Value, typename Hash = std::hash<Key>>
+    class ShardedLruCache
+    {
+    public:
+        using Ptr = std::shared_ptr<ShardedLruCache>;
+        using ChargeFunc = std::function<size_t(const Key &, const Value &)>;
+
+        struct Options
+        {
+            size_t shards = 16;
+            size_t capacity = 100000;               // 所有分片的总 charge 上限
+            std::chrono::milliseconds ttl{0};       // 0 表示不过期
+        };
+
+        struct ShardStats
+        {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            size_t entries = 0;
+            size_t charge = 0;
+        };
+
+        explicit ShardedLruCache(const Options &options, ChargeFunc charge = nullptr)
+            : m_ttl(options.ttl), m_charge(std::move(charge))
+        {
+            size_t shards = options.shards == 0 ? 1 : options.shards;
+            m_shard_capacity = options.capacity / shards == 0 ? 1 : options.capacity / shards;
+            for (size_t i = 0; i < shards; ++i)
+            {
+                m_shards.push_back(std::make_unique<Shard>());
+            }
+        }
+
+        bool Get(const Key &key, Value &value)
+        {
+            Shard &shard = ShardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(key);
+            if (it == shard.index.end())
+            {
+                ++shard.misses;
+                return false;
+            }
+            if (m_ttl.count() > 0 && it->second->expire <= std::chrono::steady_clock::now())
+            {
+                Drop(shard, it->second);
+                ++shard.misses;
+                return false;
+            }
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            value = it->second->value;
+            ++shard.hits;
+            return true;
+        }
+
+        void Put(const Key &key, const Value &value)
+        {
+            Shard &shard = ShardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Insert(shard, key, value);
+        }
+
+        // 仅当读取源数据之后该分片没有发生过失效时才写入, 避免把刚被失效的旧值写回缓存.
+        // epoch 须在读取源数据之前通过 Epoch(key) 获取.
+        bool Put(const Key &key, const Value &value, uint64_t epoch)
+        {
+            Shard &shard = ShardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (shard.epoch != epoch) return false;
+            Insert(shard, key, value);
+            return true;
+        }
+
+        uint64_t Epoch(const Key &key)
+        {
+            Shard &shard = ShardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            return shard.epoch;
+        }
+
+        void Erase(const Key &key)
+        {
+            Shard &shard = ShardFor(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            ++shard.epoch;
+            auto it = shard.index.find(key);
+            if (it != shard.index.end())
+            {
+                Drop(shard, it->second);
+            }
+        }
+
+        void Clear()
+        {
+            for (auto &shard : m_shards)
+            {
+                std::lock_guard<std::mutex> lock(shard->mutex);
+                ++shard->epoch;
+                shard->index.clear();
+                shard->lru.clear();
+                shard->charge = 0;
+            }
+        }
+
+        std::vector<ShardStats> Stats() const
+        {
+            std::vector<ShardStats> stats;
+            for (size_t i = 0; i < m_shards.size(); ++i)
+            {
+                stats.push_back(ShardStatsAt(i));
+            }
+            return stats;
+        }
+
+        size_t ShardCount() const { return m_shards.size(); }
+
+        // 只锁一个分片, 供按分片导出指标时使用
+        ShardStats ShardStatsAt(size_t index) const
+        {
+            const Shard &shard = *m_shards[index];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            ShardStats s;
+            s.hits = shard.hits;
+            s.misses = shard.misses;
+            s.evictions = shard.evictions;
+            s.entries = shard.index.size();
+            s.charge = shard.charge;
+            return s;
+        }
+
+    private:
+        struct Entry
+        {
+            Key key;
+            Value value;
+            size_t charge;
+            std::chrono::steady_clock::time_point expire;
+        };
+        using EntryList = std::list<Entry>;
+
+        struct Shard
+        {
+            mutable std::mutex mutex;
+            EntryList lru;      // 头部为最近使用
+            std::unordered_map<Key, typename EntryList::iterator, Hash> index;
+            size_t charge = 0;
+            uint64_t epoch = 0;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+        };
+
+        Shard &ShardFor(const Key &key)
+        {
+            // 再混合一次, 避免分片下标与分片内哈希桶使用相同的低位
+            uint64_t h = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ULL;
+            return *m_shards[(h >> 32) % m_shards.size()];
+        }
+
+        void Insert(Shard &shard, const Key &key, const Value &value)
+        {
+            size_t charge = m_charge ? m_charge(key, value) : 1;
+            auto expire = std::chrono::steady_clock::now() + m_ttl;
+            auto it = shard.index.find(key);
+            if (it != shard.index.end())
+            {
+                shard.charge -= it->second->charge;
+                it->second->value = value;
+                it->second->charge = charge;
+                it->second->expire = expire;
+                shard.charge += charge;
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            }
+            else
+            {
+                shard.lru.push_front(Entry{key, value, charge, expire});
+                shard.index.emplace(key, shard.lru.begin());
+                shard.charge += charge;
+            }
+            while (shard.charge > m_shard_capacity && shard.lru.size() > 1)
+            {
+                Drop(shard, std::prev(shard.lru.end()));
+                ++shard.evictions;
+            }
+        }
+
+        void Drop(Shard &shard, typename EntryList::iterator it)
+        {
+            shard.charge -= it->charge;
+            shard.index.erase(it->key);
+            shard.lru.erase(it);
+        }
+
+    private:
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        size_t m_shard_capacity;
+        std::chrono::milliseconds m_ttl;
+        ChargeFunc m_charge;
+    };
+}
+
+#endif // LOCAL_CACHE_H
@@ -0,0 +1,66 @@
+#ifndef MEMBERSHIP_CACHE_H
+#define MEMBERSHIP_CACHE_H
+
+#include <string>
+#include <vector>
+#include "redis_client.h"
+#include "local_cache.h"
+
+namespace InstantSocial
+{
+    struct MembershipCacheOptions
+    {
+        std::chrono::milliseconds ttl{86400000};        // 会话成员集合闲置过期时间
+        std::chrono::milliseconds fill_timeout{5000};   // 回填令牌有效期
+        std::string key_prefix = "members:";
+        size_t local_shards = 16;
+        size_t local_capacity = 1000000;                // 进程内缓存的成员总数上限, 0 表示不启用进程内缓存
+    };
+
+    // 会话成员缓存, 两层:
+    //   Redis  每个会话一个 SET(带空串哨兵表示已加载) 和一个版本号, 每次成员变更版本号加一
+    //   进程内 按会话缓存成员列表及其版本号, 读取时把本地版本号带给 Redis, 版本未变只返回版本号
+    // 版本号在 key 过期后以当前微秒时间戳重新初始化, 保证同一会话的版本号单调递增
+    class MembershipCache
+    {
+    public:
+        using Ptr = std::shared_ptr<MembershipCache>;
+        using MemberList = std::shared_ptr<const std::vector<std::string>>;
+
+        MembershipCache(const RedisClient::Ptr &client, const MembershipCacheOptions &options = MembershipCacheOptions());
+
+        // 命中时返回 true, 并给出成员列表和对应的版本号
+        bool Get(const std::string &session_id, MemberList &members, long long &version);
+        // 只读取版本号, 未加载时返回 0. 调用方可以据此判断手中的成员列表是否过期
+        long long Version(const std::string &session_id);
+
+        void Add(const std::string &session_id, const std::vector<std::string> &user_ids);
+        void Remove(const std::string &session_id, const std::vector<std::string> &user_ids);
+        void Clear(const std::string &session_id);
+
+        // 回填: 读数据库前 BeginFill 取得令牌, 读完后 Fill 写入. 期间有成员变更时放弃写入, 返回 false
+        std::string BeginFill(const std::string &session_id);
+        bool Fill(const std::string &session_id, const std::string &token, const std::vector<std::string> &user_ids);
+        void Invalidate(const std::string &session_id);
+
+    private:
+        struct Entry
+        {
+            long long version = 0;
+            MemberList members;
+        };
+        using LocalCache = ShardedLruCache<std::string, Entry>;
+
+        std::string SetKey(const std::string &session_id) const { return m_options.key_prefix + "{" + session_id + "}"; }
+        std::string VersionKey(const std::string &session_id) const { return m_options.key_prefix + "{" + session_id + "}:ver"; }
+        std::string FillKey(const std::string &session_id) const { return m_options.key_prefix + "{" + session_id + "}:fill"; }
+        void Update(const RedisScript &script, const std::string &session_id, const std::vector<std::string> &user_ids);
+
+    private:
+        RedisClient::Ptr m_client;
+        MembershipCacheOptions m_options;
+        std::unique_ptr<LocalCache> m_local;
+    };
+}
+
+#endif // MEMBERSHIP_CACHE_H
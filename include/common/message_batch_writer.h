@@ -0,0 +1,90 @@
+#ifndef MESSAGE_BATCH_WRITER_H
+#define MESSAGE_BATCH_WRITER_H
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <bvar/bvar.h>
+#include <odb/database.hxx>
+#include "message_entity.h"
+
+namespace InstantSocial
+{
+    struct MessageBatchWriterOptions
+    {
+        size_t max_batch = 256;                         // 攒够该条数立即提交
+        std::chrono::microseconds max_delay{2000};      // 队首消息最多等待该时间后提交
+        size_t queue_capacity = 65536;                  // 队列满时 Submit 阻塞, 对写入方形成反压
+        std::string metrics_prefix = "message_writer";  // bvar 指标前缀, 为空时不导出
+    };
+
+    // 消息组提交: 并发提交的消息在队列中攒批, 按目标库分组后在一个事务中写入, 一批只付出一次提交(落盘)的开销.
+    // Submit 返回的 future 在该消息所在事务提交后置为 true; 整批失败时退化为逐条写入, 只有写不进去的消息返回 false
+    class MessageBatchWriter
+    {
+    public:
+        using Ptr = std::shared_ptr<MessageBatchWriter>;
+        using Database = std::shared_ptr<odb::core::database>;
+        // 消息 -> 写入的库, 分片部署时按 session_id 选择 owner 分片
+        using Resolver = std::function<Database(const MessageEntity &)>;
+
+        MessageBatchWriter(const Resolver &resolver, const MessageBatchWriterOptions &options = MessageBatchWriterOptions());
+        ~MessageBatchWriter();
+
+        std::future<bool> Submit(const MessageEntity &message);
+        // 写完队列中剩余的消息后停止, 之后的 Submit 直接返回 false
+        void Stop();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Pending
+        {
+            MessageEntity message;
+            std::promise<bool> done;
+            Clock::time_point enqueued;
+        };
+
+        struct Metrics
+        {
+            bvar::PassiveStatus<int64_t> queued;
+            bvar::IntRecorder batch_size;
+            bvar::LatencyRecorder commit;
+            bvar::LatencyRecorder wait;
+            bvar::Adder<int64_t> fallbacks;
+            bvar::Adder<int64_t> failures;
+
+            explicit Metrics(MessageBatchWriter *writer);
+        };
+
+        void Run();
+        void Flush(std::vector<Pending> &batch);
+        // 在一个事务中写入同一个库的一组消息, 失败时逐条重试
+        void Write(const Database &db, std::vector<Pending *> &group);
+
+        void ExposeMetrics(const std::string &prefix);
+        static int64_t GetQueued(void *arg);
+
+    private:
+        Resolver m_resolver;
+        MessageBatchWriterOptions m_options;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;         // 通知后台线程有新消息或需要停止
+        std::condition_variable m_space_cond;   // 通知被反压的 Submit 队列有空位
+        std::deque<Pending> m_queue;
+        bool m_stop = false;
+
+        std::thread m_flusher;
+        std::unique_ptr<Metrics> m_metrics;
+    };
+}
+
+#endif // MESSAGE_BATCH_WRITER_H
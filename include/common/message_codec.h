@@ -0,0 +1,18 @@
+#ifndef MESSAGE_CODEC_H
+#define MESSAGE_CODEC_H
+
+#include <string>
+#include "message_entity.h"
+
+namespace InstantSocial
+{
+    // MessageEntity 的紧凑二进制编码, 用于 Redis 中的消息缓存. 格式带版本号, 解码失败按缓存未命中处理
+    std::string EncodeMessage(const MessageEntity &message);
+    bool DecodeMessage(const std::string &data, MessageEntity &message);
+
+    // 编码结果从 kMessageIdentityOffset 起的一段(主键与 message_id), 用于在 Redis 脚本中不解码地识别同一条消息
+    const size_t kMessageIdentityOffset = 2;
+    std::string EncodeMessageIdentity(const MessageEntity &message);
+}
+
+#endif // MESSAGE_CODEC_H
@@ -0,0 +1,72 @@
+#ifndef MESSAGE_SHARD_ROUTER_H
+#define MESSAGE_SHARD_ROUTER_H
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <odb/database.hxx>
+
+namespace InstantSocial
+{
+    // 与 MySQL CRC32() 结果一致, 迁移工具可以直接在 SQL 中按桶筛选
+    uint32_t Crc32(const std::string &data);
+
+    // session_id -> 桶 -> 分片. 桶数固定, 拆分分片时只改变桶的归属.
+    // 迁移中的桶写入同时发往 owner 与 migrating_to, 读取仍走 owner, 切换后由 migrating_to 接管
+    struct ShardMap
+    {
+        static constexpr int kNone = -1;
+
+        uint64_t version = 0;
+        std::vector<int> owner;         // 下标为桶号
+        std::vector<int> migrating_to;  // kNone 表示不在迁移中
+
+        size_t Buckets() const { return owner.size(); }
+        uint32_t BucketOf(const std::string &session_id) const;
+
+        // 桶均匀分配到 shards 个分片
+        static ShardMap Uniform(size_t shards, size_t buckets = 1024);
+
+        // 文本格式, 存放在配置文件或 etcd 中:
+        //   version 3
+        //   buckets 1024
+        //   0-511 0
+        //   512-767 1
+        //   768-1023 1 -> 2
+        // 连续且归属相同的桶合并为一行, "-> N" 表示正在迁往分片 N
+        std::string Format() const;
+        static bool Parse(const std::string &text, ShardMap &map);
+    };
+
+    class MessageShardRouter
+    {
+    public:
+        using Ptr = std::shared_ptr<MessageShardRouter>;
+        using Database = std::shared_ptr<odb::core::database>;
+
+        MessageShardRouter(const std::vector<Database> &shards, const ShardMap &map);
+
+        // 读取与回填使用的分片
+        Database ForSession(const std::string &session_id) const;
+        // 写入目标, 第一个为 owner, 迁移中的桶还包含目标分片
+        std::vector<Database> WriteTargets(const std::string &session_id) const;
+        // 所有分片, 用于没有 session_id 的管理操作
+        const std::vector<Database> &Shards() const { return m_shards; }
+
+        // 热更新分片表, 桶数不同、引用了不存在的分片或版本号不大于当前版本时拒绝
+        bool UpdateMap(const ShardMap &map);
+        std::shared_ptr<const ShardMap> Map() const;
+
+    private:
+        bool Valid(const ShardMap &map) const;
+
+    private:
+        std::vector<Database> m_shards;
+        mutable std::mutex m_mutex;
+        std::shared_ptr<const ShardMap> m_map;
+    };
+}
+
+#endif // MESSAGE_SHARD_ROUTER_H
@@ -0,0 +1,137 @@
+#ifndef MYSQL_POOL_H
+#define MYSQL_POOL_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <condition_variable>
+#include <bvar/bvar.h>
+#include <odb/mysql/database.hxx>
+#include <odb/mysql/connection.hxx>
+#include <odb/mysql/connection-factory.hxx>
+
+namespace InstantSocial
+{
+    struct MySQLPoolOptions
+    {
+        size_t min_connections = 2;                             // 常驻连接数, 启动时预先建立
+        size_t max_connections = 16;                            // 连接数上限
+        size_t max_connections_limit = 64;                      // 自动扩容时的上限, 不大于 max_connections 时不扩容
+        std::chrono::milliseconds wait_timeout{0};              // 借连接的最长等待时间, 0 表示一直等待, 超时抛出 odb::timeout
+        std::chrono::milliseconds idle_timeout{300000};         // 超过 min_connections 的空闲连接闲置超过该时间后关闭
+        std::chrono::milliseconds max_lifetime{1800000};        // 连接最长存活时间, 应小于 MySQL 的 wait_timeout, 0 表示不限
+        std::chrono::milliseconds ping_interval{5000};          // 闲置超过该时间的连接借出前先 ping, 0 表示每次都 ping
+        std::chrono::milliseconds maintain_interval{5000};      // 后台回收与扩缩容的检查周期
+        std::chrono::microseconds resize_wait_threshold{2000};  // 一个检查周期内平均等待时间超过该值时扩容
+        size_t resize_step = 4;
+        std::string metrics_prefix = "mysql_pool";              // bvar 指标前缀, 为空时不导出
+    };
+
+    // 替代 odb::mysql::connection_pool_factory 的连接池:
+    // 最小/最大连接数, 启动预热, 空闲与存活时间回收, 按闲置时长限频的借出前 ping, 等待时间与利用率指标,
+    // 以及根据等待时间在 max_connections 与 max_connections_limit 之间自动扩缩容
+    class MySQLConnectionPool : public odb::mysql::connection_factory
+    {
+    public:
+        struct Stats
+        {
+            size_t idle = 0;
+            size_t in_use = 0;
+            size_t waiters = 0;
+            size_t max_connections = 0;
+            uint64_t created = 0;
+            uint64_t closed = 0;
+            uint64_t ping_failures = 0;
+            uint64_t timeouts = 0;
+        };
+
+        explicit MySQLConnectionPool(const MySQLPoolOptions &options = MySQLPoolOptions());
+        ~MySQLConnectionPool() override;
+
+        odb::mysql::connection_ptr connect() override;
+        // 由 odb::mysql::database 构造时调用, 在此预热连接并启动后台维护线程
+        void database(database_type &db) override;
+
+        // 手动调整连接数上限, 已借出的多余连接归还时关闭
+        void Resize(size_t max_connections);
+        Stats GetStats() const;
+        // 不必等待就能借出的连接数: 上限减去已借出的与正在等待的
+        size_t Available() const;
+        // db 由 ODBFactory 以 MySQLConnectionPool 创建时返回其连接池, 否则返回 nullptr
+        static MySQLConnectionPool *Of(const odb::core::database &db);
+
+    private:
+        class PooledConnection;
+        using PooledConnectionPtr = odb::details::shared_ptr<PooledConnection>;
+        using Clock = std::chrono::steady_clock;
+
+        struct IdleConnection
+        {
+            PooledConnectionPtr conn;
+            Clock::time_point since;
+        };
+
+        struct Metrics
+        {
+            bvar::PassiveStatus<int64_t> idle;
+            bvar::PassiveStatus<int64_t> in_use;
+            bvar::PassiveStatus<int64_t> waiters;
+            bvar::PassiveStatus<int64_t> max_connections;
+            bvar::PassiveStatus<double> utilization;
+            bvar::LatencyRecorder wait;
+            bvar::Adder<int64_t> created;
+            bvar::Adder<int64_t> closed;
+            bvar::Adder<int64_t> ping_failures;
+            bvar::Adder<int64_t> timeouts;
+
+            explicit Metrics(MySQLConnectionPool *pool);
+        };
+
+        PooledConnectionPtr Create();
+        bool Expired(const PooledConnection &conn, Clock::time_point now) const;
+        bool Validate(PooledConnection &conn, Clock::time_point now);
+        odb::mysql::connection_ptr Borrow(const PooledConnectionPtr &conn, Clock::time_point start);
+        // 引用计数归零时调用, 返回 true 表示关闭该连接
+        bool Release(PooledConnection *conn);
+        void Run();
+        void Maintain();
+        void OnClosed(size_t count);
+
+        void ExposeMetrics(const std::string &prefix);
+        static int64_t GetIdle(void *arg);
+        static int64_t GetInUse(void *arg);
+        static int64_t GetWaiters(void *arg);
+        static int64_t GetMaxConnections(void *arg);
+        static double GetUtilization(void *arg);
+
+    private:
+        MySQLPoolOptions m_options;
+        database_type *m_db = nullptr;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::deque<IdleConnection> m_idle;      // 尾部为最近归还的连接, 优先借出; 头部闲置最久, 优先回收
+        size_t m_in_use = 0;
+        size_t m_waiters = 0;
+        size_t m_max_connections;
+        size_t m_peak_in_use = 0;               // 本检查周期内的最大借出数
+        uint64_t m_wait_count = 0;              // 本检查周期内发生等待的借出次数
+        uint64_t m_wait_us = 0;
+
+        std::atomic<uint64_t> m_created{0};
+        std::atomic<uint64_t> m_closed{0};
+        std::atomic<uint64_t> m_ping_failures{0};
+        std::atomic<uint64_t> m_timeouts{0};
+
+        bool m_stop = false;
+        std::condition_variable m_stop_cond;
+        std::thread m_maintainer;
+        std::unique_ptr<Metrics> m_metrics;
+    };
+}
+
+#endif // MYSQL_POOL_H
@@ -7,6 +7,9 @@
 #include <odb/database.hxx>
 #include <odb/mysql/database.hxx>
 #include "logger.h"
+#include "mysql_pool.h"
+#include "database_router.h"
+#include <vector>
 
 namespace InstantSocial
 {
@@ -19,6 +22,12 @@ namespace InstantSocial
     SQLServer   // SQL Server数据库
     };
 
+    struct DatabaseEndpoint
+    {
+        std::string host;
+        unsigned int port = 3306;
+    };
+
     class ODBFactory
     {
         public:
@@ -31,7 +40,28 @@ namespace InstantSocial
                                                             int conn_pool_count = 1,
                                                             const std::string &cset = "utf8mb4"
                                                         );
-            
+            // 使用 MySQLConnectionPool 管理连接, 支持预热、空闲回收、借出前 ping 与连接池指标
+            static std::shared_ptr<odb::core::database> Create(   DatabaseType db_type,
+                                                            const std::string &host,
+                                                            const std::string &user,
+                                                            const std::string &password,
+                                                            const std::string &dbName,
+                                                            unsigned int port,
+                                                            const MySQLPoolOptions &pool_options,
+                                                            const std::string &cset = "utf8mb4"
+                                                        );
+            // 主库加若干从库, 每个实例各自一个连接池; 从库连接失败时跳过该从库
+            static DatabaseRouter::Ptr CreateRouter(  DatabaseType db_type,
+                                                      const DatabaseEndpoint &primary,
+                                                      const std::vector<DatabaseEndpoint> &replicas,
+                                                      const std::string &user,
+                                                      const std::string &password,
+                                                      const std::string &dbName,
+                                                      const MySQLPoolOptions &pool_options = MySQLPoolOptions(),
+                                                      const DatabaseRouterOptions &router_options = DatabaseRouterOptions(),
+                                                      const std::string &cset = "utf8mb4"
+                                                  );
+
     };
 }
 
@@ -0,0 +1,68 @@
+#ifndef ASYNC_HANDLER_H
+#define ASYNC_HANDLER_H
+
+#include <tuple>
+#include <memory>
+#include <utility>
+#include "db_executor.h"
+
+namespace InstantSocial
+{
+    // 把任意 handler 的同步方法放到 DbExecutor 上执行, 例如
+    //   AsyncHandler<UserHandler> users(user_handler, executor);
+    //   users.Call(&UserHandler::GetByUserID, user_id);                       // future
+    //   users.Then([done](std::shared_ptr<UserEntity> user) { ... }, &UserHandler::GetByUserID, user_id);
+    // 参数按值保存到执行时; 被丢弃的调用得到与 handler 出错相同的结果
+    template <typename Handler>
+    class AsyncHandler
+    {
+    public:
+        using Ptr = std::shared_ptr<AsyncHandler>;
+
+        AsyncHandler(const std::shared_ptr<Handler> &handler, const DbExecutor::Ptr &executor)
+            : m_handler(handler), m_executor(executor) {}
+
+        template <typename R, typename... Params, typename... Args>
+        std::future<R> Call(R (Handler::*method)(Params...), Args &&...args)
+        {
+            return CallWithin(std::chrono::milliseconds(0), method, std::forward<Args>(args)...);
+        }
+
+        // timeout 为排队的最长时间, 不大于 0 时使用执行器的默认值
+        template <typename R, typename... Params, typename... Args>
+        std::future<R> CallWithin(std::chrono::milliseconds timeout, R (Handler::*method)(Params...), Args &&...args)
+        {
+            return m_executor->Submit(Bind(method, std::forward<Args>(args)...), timeout);
+        }
+
+        template <typename Done, typename R, typename... Params, typename... Args>
+        void Then(Done done, R (Handler::*method)(Params...), Args &&...args)
+        {
+            ThenWithin(std::chrono::milliseconds(0), std::move(done), method, std::forward<Args>(args)...);
+        }
+
+        template <typename Done, typename R, typename... Params, typename... Args>
+        void ThenWithin(std::chrono::milliseconds timeout, Done done, R (Handler::*method)(Params...), Args &&...args)
+        {
+            m_executor->Dispatch(Bind(method, std::forward<Args>(args)...), std::move(done), timeout);
+        }
+
+        const std::shared_ptr<Handler> &handler() const { return m_handler; }
+
+    private:
+        template <typename R, typename... Params, typename... Args>
+        auto Bind(R (Handler::*method)(Params...), Args &&...args)
+        {
+            // 持有 handler 的引用计数, 调用执行前 AsyncHandler 被销毁也不影响
+            return [handler = m_handler, method, saved = std::make_tuple(std::decay_t<Args>(std::forward<Args>(args))...)]() mutable {
+                return std::apply([&](auto &...a) { return ((*handler).*method)(a...); }, saved);
+            };
+        }
+
+    private:
+        std::shared_ptr<Handler> m_handler;
+        DbExecutor::Ptr m_executor;
+    };
+}
+
+#endif // ASYNC_HANDLER_H
@@ -13,6 +13,8 @@ namespace InstantSocial
     public:
         using Ptr = std::shared_ptr<ChatSessionHandler>;
         ChatSessionHandler(const std::shared_ptr<odb::database> &db) : m_db(db) {}
+        // 读写分离: 写走主库, 读按路由选择从库
+        ChatSessionHandler(const DatabaseRouter::Ptr &router) : m_db(router->Primary()), m_router(router) {}
 
         bool Insert(ChatSessionEntity &entity);
         bool RemoveBySessionId(const std::string &session_id);
@@ -23,6 +25,7 @@ namespace InstantSocial
         
     private:
         std::shared_ptr<odb::database> m_db;
+        DatabaseRouter::Ptr m_router;
     };
 }
 
@@ -7,11 +7,19 @@
 
 namespace InstantSocial
 {
+    class MembershipCache;
+
     class ChatSessionMemberHandler
     {
         public:
         using Ptr = std::shared_ptr<ChatSessionMemberHandler>;
         ChatSessionMemberHandler(const std::shared_ptr<odb::database> &db) : m_db(db) {}
+        // 带成员缓存: 增删成员同步更新缓存, GetMemberListBySessionId 优先读缓存, 未命中时读库回填
+        ChatSessionMemberHandler(const std::shared_ptr<odb::database> &db, const std::shared_ptr<MembershipCache> &cache)
+            : m_db(db), m_cache(cache) {}
+        // 读写分离: 写走主库, 读按路由选择从库; 成员缓存回填始终读主库
+        ChatSessionMemberHandler(const DatabaseRouter::Ptr &router, const std::shared_ptr<MembershipCache> &cache = nullptr)
+            : m_db(router->Primary()), m_router(router), m_cache(cache) {}
 
         bool Apeend(ChatSessionMemberEntity &entity);
         bool Apeend(std::vector<ChatSessionMemberEntity> &entity_list);
@@ -19,8 +27,17 @@ namespace InstantSocial
         bool RemoveAllBySessionId(const std::string &session_id);
         std::vector<std::string> GetMemberListBySessionId(const std::string &session_id);
 
+        private:
+        std::vector<std::string> QueryMemberList(const std::shared_ptr<odb::database> &db, const std::string &session_id, bool &ok);
+        void UpdateCache(const std::string &session_id, const std::vector<std::string> &user_ids, bool add);
+        void ClearCache(const std::string &session_id);
+        void InvalidateCache(const std::string &session_id);
+        std::shared_ptr<odb::database> ReadDb(const std::string &session_id);
+
         private:
         std::shared_ptr<odb::database> m_db;
+        DatabaseRouter::Ptr m_router;
+        std::shared_ptr<MembershipCache> m_cache;
 
     };
 }
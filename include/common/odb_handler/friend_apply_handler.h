@@ -12,6 +12,8 @@ namespace InstantSocial
     public:
         using Ptr = std::shared_ptr<FriendApplyHandler>;
         FriendApplyHandler(const std::shared_ptr<odb::core::database> &db) : m_db(db) {}
+        // 读写分离: 写走主库, 读按路由选择从库
+        FriendApplyHandler(const DatabaseRouter::Ptr &router) : m_db(router->Primary()), m_router(router) {}
         ~FriendApplyHandler() = default;
 
         bool Insert(FriendApplyEntity &event);
@@ -21,6 +23,7 @@ namespace InstantSocial
 
     private:
         std::shared_ptr<odb::core::database> m_db;
+        DatabaseRouter::Ptr m_router;
     };
 }
 
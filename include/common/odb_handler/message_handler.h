@@ -4,25 +4,70 @@
 #include "odb_client.h"
 #include "message_entity.h"
 #include "message_entity-odb.hxx"
+#include "message_shard_router.h"
+#include "message_batch_writer.h"
+#include "id_generator.h"
 
 namespace InstantSocial 
 {
+    class RecentMessageCache;
+
     class MessageHandler 
     {
     public:
         using Ptr = std::shared_ptr<MessageHandler>;
-        MessageHandler(const std::shared_ptr<odb::core::database> &db) : m_db(db) {}
+        // ids 为消息主键的来源, 为空时抛出 std::invalid_argument. 各实例的 worker id 须不同, 通常用 LeasedIdGenerator 创建
+        MessageHandler(const std::shared_ptr<odb::core::database> &db, const IdGenerator::Ptr &ids)
+            : m_db(db), m_ids(CheckIds(ids)) {}
+        // Insert 同步写入最近消息缓存, GetRecent 条数不超过缓存容量时优先读缓存
+        MessageHandler(const std::shared_ptr<odb::core::database> &db, const IdGenerator::Ptr &ids,
+                       const std::shared_ptr<RecentMessageCache> &recent_cache)
+            : m_db(db), m_recent_cache(recent_cache), m_ids(CheckIds(ids)) {}
+        // 读写分离: 写走主库, 读按路由选择从库; 最近消息缓存回填始终读主库
+        MessageHandler(const DatabaseRouter::Ptr &router, const IdGenerator::Ptr &ids,
+                       const std::shared_ptr<RecentMessageCache> &recent_cache = nullptr)
+            : m_db(router->Primary()), m_router(router), m_recent_cache(recent_cache), m_ids(CheckIds(ids)) {}
+        // 按 session_id 分片存储: 每个会话的读写都路由到所属分片, 迁移中的会话同时写入目标分片
+        MessageHandler(const MessageShardRouter::Ptr &shards, const IdGenerator::Ptr &ids,
+                       const std::shared_ptr<RecentMessageCache> &recent_cache = nullptr)
+            : m_shards(shards), m_recent_cache(recent_cache), m_ids(CheckIds(ids)) {}
         ~MessageHandler() = default;
 
+        // 开启组提交: 之后的 Insert 进入 MessageBatchWriter 与其他线程的消息攒批写入, 返回前等待所在事务提交
+        void EnableGroupCommit(const MessageBatchWriterOptions &options = MessageBatchWriterOptions());
+        // message.id() 为 0 时从 IdGenerator 分配主键; message_id 总是改写为主键的字符串形式
         bool Insert(MessageEntity &message);
         bool Remove(const std::string &message_id);
         std::vector<MessageEntity> GetRecent(const std::string &session_id, int32_t count);
         std::vector<MessageEntity> GetByTimeRange(const std::string &session_id,
                                                  const boost::posix_time::ptime &start_time,
                                                  const boost::posix_time::ptime &end_time);
+
+        // 游标翻页: 游标是不透明字符串, 由 CursorOf 从某条消息生成, 按 (create_time, id) 定位.
+        // 每页都是索引上的范围扫描, 翻得再深也不需要 OFFSET. 两个接口都按时间正序返回
+        static std::string CursorOf(const MessageEntity &message);
+        // 早于 cursor 的最近 limit 条, cursor 为空时从最新一条开始; 继续向前翻取结果第一条的游标
+        std::vector<MessageEntity> GetBefore(const std::string &session_id, const std::string &cursor, int32_t limit);
+        // 晚于 cursor 的最早 limit 条, cursor 为空时从最早一条开始; 继续向后翻取结果最后一条的游标
+        std::vector<MessageEntity> GetAfter(const std::string &session_id, const std::string &cursor, int32_t limit);
     
+    private:
+        static const IdGenerator::Ptr &CheckIds(const IdGenerator::Ptr &ids);
+        std::vector<MessageEntity> QueryPage(const std::string &session_id, const std::string &cursor, int32_t limit, bool before);
+        std::vector<MessageEntity> QueryRecent(const std::shared_ptr<odb::core::database> &db, const std::string &session_id, int32_t count);
+        std::vector<MessageEntity> GetRecentCached(const std::string &session_id, int32_t count);
+        std::shared_ptr<odb::core::database> ReadDb(const std::string &session_id);
+        std::shared_ptr<odb::core::database> PrimaryDb(const std::string &session_id);
+        std::vector<std::shared_ptr<odb::core::database>> WriteDbs(const std::string &session_id);
+
     private:
         std::shared_ptr<odb::core::database> m_db;
+        DatabaseRouter::Ptr m_router;
+        MessageShardRouter::Ptr m_shards;
+        std::shared_ptr<RecentMessageCache> m_recent_cache;
+        IdGenerator::Ptr m_ids;
+        // 最后声明, 析构时先停止写入线程, 再释放它用到的库
+        MessageBatchWriter::Ptr m_writer;
     };
 }
 
@@ -0,0 +1,31 @@
+#ifndef PREPARED_QUERY_CACHE_H
+#define PREPARED_QUERY_CACHE_H
+
+#include <memory>
+#include <odb/database.hxx>
+#include <odb/connection.hxx>
+#include <odb/transaction.hxx>
+#include <odb/prepared-query.hxx>
+
+namespace InstantSocial
+{
+    // 在当前事务所在连接上查找名为 name 的预编译查询, 没有则用 build(params) 构造并缓存.
+    // 查询通过 query::_ref 按引用绑定 Params 的成员, 调用方每次执行前改写 params 指向的对象即可.
+    // 预编译语句随连接缓存, 连接被连接池关闭时一起释放; name 必须是字符串字面量
+    template <typename T, typename Params, typename Build>
+    odb::prepared_query<T> CachedQuery(const char *name, Params *&params, Build build)
+    {
+        odb::connection &conn(odb::transaction::current().connection());
+        odb::prepared_query<T> pq(conn.lookup_query<T>(name, params));
+        if (!pq)
+        {
+            std::unique_ptr<Params> owned(new Params());
+            params = owned.get();
+            pq = conn.prepare_query<T>(name, build(*params));
+            conn.cache_query(pq, std::move(owned));
+        }
+        return pq;
+    }
+}
+
+#endif // PREPARED_QUERY_CACHE_H
@@ -7,11 +7,19 @@
 
 namespace InstantSocial 
 {
+    class FriendCache;
+
     class RelationHandler 
     {
     public:
         using Ptr = std::shared_ptr<RelationHandler>;
         RelationHandler(const std::shared_ptr<odb::core::database> &db) : m_db(db) {}
+        // 带好友集合缓存: Insert/Remove 同步写缓存, Exists/GetPeers 优先读缓存, 未命中时读库回填
+        RelationHandler(const std::shared_ptr<odb::core::database> &db, const std::shared_ptr<FriendCache> &friend_cache)
+            : m_db(db), m_friend_cache(friend_cache) {}
+        // 读写分离: 写走主库, 读按路由选择从库; 好友缓存回填始终读主库
+        RelationHandler(const DatabaseRouter::Ptr &router, const std::shared_ptr<FriendCache> &friend_cache = nullptr)
+            : m_db(router->Primary()), m_router(router), m_friend_cache(friend_cache) {}
         ~RelationHandler() = default;
 
         bool Insert(const std::string &user_id, const std::string &peer_id);
@@ -19,8 +27,20 @@ namespace InstantSocial
         bool Exists(const std::string &user_id, const std::string &peer_id);
         std::vector<std::string> GetPeers(const std::string &user_id);
 
+    private:
+        bool QueryExists(const std::string &user_id, const std::string &peer_id);
+        bool QueryPeers(const std::shared_ptr<odb::core::database> &db, const std::string &user_id, std::vector<std::string> &peers);
+        // 未命中时读库并回填, 读库失败返回 false
+        bool LoadPeers(const std::string &user_id, std::vector<std::string> &peers);
+        void AddToCache(const std::string &user_id, const std::string &peer_id);
+        void RemoveFromCache(const std::string &user_id, const std::string &peer_id);
+        void InvalidateCache(const std::string &user_id, const std::string &peer_id);
+        std::shared_ptr<odb::core::database> ReadDb(const std::string &user_id);
+
     private:
         std::shared_ptr<odb::core::database> m_db;
+        DatabaseRouter::Ptr m_router;
+        std::shared_ptr<FriendCache> m_friend_cache;
     };
 }
 
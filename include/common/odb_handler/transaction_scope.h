@@ -0,0 +1,93 @@
+#ifndef TRANSACTION_SCOPE_H
+#define TRANSACTION_SCOPE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <odb/database.hxx>
+#include <odb/transaction.hxx>
+#include "database_router.h"
+
+namespace InstantSocial
+{
+    // 工作单元: 把一次业务操作中的多个 handler 调用放进同一个事务, 只在一个连接上 begin/commit 一次, 例如建群
+    //   UnitOfWork uow(db);
+    //   if (!session_handler.Insert(session) || !member_handler.Apeend(members)) return false;   // 析构时回滚
+    //   uow.Commit();
+    // 期间 handler 加入该事务, 缓存更新与读己之写的记录推迟到提交之后, 回滚时不执行.
+    // 事务属于创建它的线程; 单元内的读写都在 db 上执行(包括本应走从库的读), 分片部署的 MessageHandler 不能加入
+    class UnitOfWork
+    {
+    public:
+        explicit UnitOfWork(const std::shared_ptr<odb::core::database> &db) : m_db(db), m_transaction(db->begin()) {}
+
+        void Commit() { m_transaction.commit(); }
+        void Rollback() { m_transaction.rollback(); }
+        odb::database &database() { return *m_db; }
+
+    private:
+        std::shared_ptr<odb::core::database> m_db;
+        odb::transaction m_transaction;
+    };
+
+    // handler 内部使用: 当前线程已有事务(通常来自 UnitOfWork)时加入, 否则自己开启, 由 Commit 提交
+    class TransactionScope
+    {
+    public:
+        explicit TransactionScope(const std::shared_ptr<odb::core::database> &db)
+        {
+            if (!odb::transaction::has_current())
+            {
+                m_own.reset(new odb::transaction(db->begin()));
+            }
+        }
+
+        // 本次操作应使用的库, 加入外层事务时为外层事务的库
+        odb::database &db() { return odb::transaction::current().database(); }
+        bool joined() const { return !m_own; }
+
+        // 加入外层事务时不提交, 由外层决定
+        void Commit()
+        {
+            if (m_own) m_own->commit();
+        }
+
+        // 所在事务(自己的或外层的)提交后执行, 回滚时丢弃
+        void AfterCommit(std::function<void()> fn)
+        {
+            auto key = new std::function<void()>(std::move(fn));
+            odb::transaction::current().callback_register(&OnTransactionEnd, key);
+        }
+
+        // 提交后为读己之写记录写入的键, router 为空时忽略
+        void MarkWritten(const DatabaseRouter::Ptr &router, const std::vector<std::string> &keys)
+        {
+            if (router) AfterCommit([router, keys]() { router->MarkWritten(keys); });
+        }
+        void MarkWritten(const DatabaseRouter::Ptr &router, const std::string &key)
+        {
+            if (router) AfterCommit([router, key]() { router->MarkWritten(key); });
+        }
+
+    private:
+        static void OnTransactionEnd(unsigned short event, void *key, unsigned long long)
+        {
+            std::unique_ptr<std::function<void()>> fn(static_cast<std::function<void()> *>(key));
+            if (event != odb::transaction::event_commit) return;
+            // ODB 要求回调不抛出异常, 提交后的动作都是尽力而为
+            try
+            {
+                (*fn)();
+            }
+            catch (...)
+            {
+            }
+        }
+
+    private:
+        std::unique_ptr<odb::transaction> m_own;
+    };
+}
+
+#endif // TRANSACTION_SCOPE_H
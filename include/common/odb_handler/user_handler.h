@@ -2,26 +2,57 @@
 #define USER_HANDLER_H
 
 #include "odb_client.h"
+#include "db_executor.h"
 #include "user_entity.h"
 #include "user_entity-odb.hxx"
+#include <algorithm>
 
 namespace InstantSocial
 {
+    class UserCache;
+    class CacheInvalidator;
+
     class UserHandler
     {
         public:
             using Ptr = std::shared_ptr<UserHandler>;
             UserHandler(const std::shared_ptr<odb::core::database> &db) : m_db(db) {}
+            // 读写分离: 写走主库, 读按路由选择从库
+            UserHandler(const DatabaseRouter::Ptr &router) : m_db(router->Primary()), m_router(router) {}
             bool Insert(const std::shared_ptr<UserEntity> &user);
             bool Update(const std::shared_ptr<UserEntity> &user);
             std::shared_ptr<UserEntity> GetByUserID(const std::string &user_id);
             std::shared_ptr<UserEntity> GetByPhone(const std::string &phone);
             std::shared_ptr<UserEntity> GetByEmail(const std::string &email);
             std::shared_ptr<UserEntity> GetByNickname(const std::string &nickname);
+            // 去重后按固定大小分块查询, 多块时并发执行, 结果按 user_id_list 中首次出现的顺序返回, 不存在的 id 跳过
             std::vector<UserEntity> GetByMultiUsers(const std::vector<std::string> &user_id_list);
+            // 批量查询的块交给 executor 并发执行, 调用线程也参与. 同时执行的块数不超过 parallelism,
+            // 也不超过连接池中不必等待就能借出的连接数, 每块占用一个连接. 未设置时所有块在调用线程上依次执行
+            void SetBatchExecutor(const DbExecutor::Ptr &executor, size_t parallelism = 4)
+            {
+                m_batch_executor = executor;
+                m_batch_parallelism = std::max<size_t>(parallelism, 1);
+            }
+            // 按 user_id/手机号/邮箱查询时先读进程内缓存, 未命中时读库回填; Update 提交后失效该用户,
+            // 并在给出 invalidator 时把 user_id 发布给其他节点. invalidator 的回调应分别调用 cache 的 Invalidate 与 Clear
+            void EnableCache(const std::shared_ptr<UserCache> &cache, const std::shared_ptr<CacheInvalidator> &invalidator = nullptr)
+            {
+                m_cache = cache;
+                m_invalidator = invalidator;
+            }
+
+        private:
+            template <typename Lookup, typename Load>
+            std::shared_ptr<UserEntity> CachedGet(const std::string &read_key, Lookup lookup, Load load);
 
         private:
             std::shared_ptr<odb::core::database> m_db;
+            DatabaseRouter::Ptr m_router;
+            DbExecutor::Ptr m_batch_executor;
+            size_t m_batch_parallelism = 4;
+            std::shared_ptr<UserCache> m_cache;
+            std::shared_ptr<CacheInvalidator> m_invalidator;
     };
 }
 
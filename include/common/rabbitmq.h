@@ -6,15 +6,76 @@
 #include <amqpcpp/libev.h>
 #include <openssl/ssl.h>
 #include <openssl/opensslv.h>
+#include <bvar/bvar.h>
 #include <iostream>
 #include <functional>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "logger.h"
 
 namespace InstantSocial
 {
+    // 消费者自动扩缩容配置
+    struct ConsumerScalingOptions
+    {
+        size_t min_workers = 1;                             // 工作线程数下限
+        size_t max_workers = 8;                             // 工作线程数上限
+        uint16_t min_prefetch = 16;                         // 预取数量下限
+        uint16_t max_prefetch = 1024;                       // 预取数量上限
+        uint16_t prefetch_per_worker = 32;                  // 每个工作线程对应的预取数量
+        std::chrono::milliseconds interval{2000};           // 采样周期
+        size_t backlog_per_worker = 100;                    // 积压超过 workers * backlog_per_worker 视为过载
+        double scale_up_utilization = 0.75;                 // 过载且利用率高于此值时扩容
+        double scale_down_utilization = 0.25;               // 无积压且利用率低于此值时缩容
+        std::string metrics_prefix = "rabbitmq_consumer";   // bvar 指标前缀
+    };
+
+    // 可在运行时调整线程数的消费工作线程池
+    class ConsumerWorkerPool
+    {
+        public:
+            using Task = std::function<void()>;
+
+            ConsumerWorkerPool() = default;
+            ~ConsumerWorkerPool();
+
+            void Resize(size_t count);
+            void Submit(Task task);
+            void Stop();
+            size_t Size();
+            size_t Pending();
+            // 返回自上次调用以来所有工作线程执行任务的累计耗时
+            int64_t TakeBusyNanos();
+
+        private:
+            struct Worker
+            {
+                std::thread thread;
+                std::atomic<bool> exited{false};
+            };
+            void WorkerLoop(Worker *worker);
+            void ReapExited();
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_cond;
+            std::deque<Task> m_tasks;
+            std::vector<std::unique_ptr<Worker>> m_workers;
+            size_t m_live = 0;      // 仍在运行的线程数
+            size_t m_target = 0;    // 期望线程数, m_live 大于它时空闲线程自行退出
+            bool m_stop = false;
+            std::atomic<int64_t> m_busy_ns{0};
+    };
+
     class RabbitMQHandler
     {
         public:
+            using Ptr = std::shared_ptr<RabbitMQHandler>;
             using MessageCallback = std::function<void(const char*, size_t)>;
 
             RabbitMQHandler(const std::string &user, const std::string &password, const std::string &host, int32_t port, bool use_ssl = false);
@@ -22,20 +83,57 @@ namespace InstantSocial
 
             void DeclareComponents(const std::string &exchange, const std::string &queue, const std::string &routingKey = "routing_key", AMQP::ExchangeType type = AMQP::direct);
             void PublishMessage(const std::string &exchange, const std::string &msg, const std::string &routingKey = "routing_key");
-            void ConsumeMessage(const std::string &queue, MessageCallback &cb);
+            void ConsumeMessage(const std::string &queue, const MessageCallback &cb);
+            // 回调在工作线程池中执行, 按队列深度与线程利用率周期性调整线程数与预取数量.
+            // 线程池与预取属于整个信道, 多次调用时只有第一个队列参与扩缩容, options 以第一次为准
+            void ConsumeMessage(const std::string &queue, const MessageCallback &cb, const ConsumerScalingOptions &options);
+            // 设置信道预取数量(basic.qos), 0 表示不限制
+            void SetPrefetch(uint16_t prefetch);
+            // 阻塞直到此前提交的操作都已在事件循环线程中执行完毕
+            void Flush();
+
+            size_t ConsumerWorkers() { return m_workers.Size(); }
+            uint16_t ConsumerPrefetch() const { return m_prefetch.load(); }
 
         private:
-            static void WatchdogCallback(struct ev_loop *loop, ev_async *w, int32_t revents);
-        
+            // AMQP-CPP 对象非线程安全, 所有对连接/信道的操作都投递到事件循环线程执行
+            void RunInLoop(std::function<void()> task);
+            static void AsyncCallback(struct ev_loop *loop, ev_async *w, int32_t revents);
+            static void ScaleTimerCallback(struct ev_loop *loop, ev_timer *w, int32_t revents);
+            void Rescale(uint32_t queue_depth);
+
         private:
+            struct ScalingMetrics
+            {
+                bvar::Status<int64_t> workers;
+                bvar::Status<int64_t> prefetch;
+                bvar::Status<int64_t> queue_depth;
+                bvar::Status<double> utilization;
+                bvar::Adder<int64_t> scale_up;
+                bvar::Adder<int64_t> scale_down;
+            };
+
             struct ev_async m_async_watcher;
+            struct ev_timer m_scale_timer;
             struct ev_loop *m_event_loop;
 
+            std::mutex m_task_mutex;
+            std::vector<std::function<void()>> m_tasks;
+
             std::unique_ptr<AMQP::TcpConnection> m_connection;
             std::unique_ptr<AMQP::TcpChannel> m_channel;
             std::unique_ptr<AMQP::LibEvHandler> m_handler;
             std::thread m_loop_thread;
+
+            // 自动扩缩容状态, 除 m_workers/m_prefetch 外只在事件循环线程访问
+            ConsumerWorkerPool m_workers;
+            ConsumerScalingOptions m_scaling;
+            std::string m_scaling_queue;
+            bool m_scaling_enabled = false;
+            std::atomic<uint16_t> m_prefetch{0};
+            std::chrono::steady_clock::time_point m_last_tick;
+            std::unique_ptr<ScalingMetrics> m_metrics;
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,52 @@
+#ifndef RECENT_MESSAGE_CACHE_H
+#define RECENT_MESSAGE_CACHE_H
+
+#include <string>
+#include <vector>
+#include "redis_client.h"
+#include "message_entity.h"
+
+namespace InstantSocial
+{
+    struct RecentMessageCacheOptions
+    {
+        size_t capacity = 100;                          // 每个会话缓存的最近消息条数
+        std::chrono::milliseconds ttl{86400000 * 7LL};  // 会话不活跃超过该时间后释放
+        std::chrono::milliseconds fill_timeout{5000};   // 回填令牌有效期, 应大于一次数据库查询的耗时
+        std::string key_prefix = "recent:";
+    };
+
+    // 每个会话最近消息的 Redis LIST, 表头为最新消息.
+    // 写入只追加到已存在的列表(LPUSHX), 列表只由 Fill 从数据库整体回填, 保证缓存中的消息连续无缺口.
+    // 完整的会话(消息数不足 capacity)在列表末尾放一个空串哨兵, 表示更早的消息不存在
+    class RecentMessageCache
+    {
+    public:
+        using Ptr = std::shared_ptr<RecentMessageCache>;
+        RecentMessageCache(const RedisClient::Ptr &client, const RecentMessageCacheOptions &options = RecentMessageCacheOptions())
+            : m_client(client), m_options(options) {}
+
+        size_t Capacity() const { return m_options.capacity; }
+
+        // 新消息写入. 列表不存在或已包含该消息(提交后被回填读到)时不做任何事
+        void Push(const MessageEntity &message);
+        // 命中时按时间从新到旧填充 messages 并返回 true
+        bool Get(const std::string &session_id, size_t count, std::vector<MessageEntity> &messages);
+        // 回填: 读数据库前调用 BeginFill 取得令牌, 读完后 Fill 写入按时间从新到旧排列的消息.
+        // 两者之间若有新消息写入, 令牌失效, Fill 放弃写入
+        std::string BeginFill(const std::string &session_id);
+        bool Fill(const std::string &session_id, const std::string &token,
+                  const std::vector<MessageEntity> &newest_first, bool complete);
+        void Invalidate(const std::string &session_id);
+
+    private:
+        std::string ListKey(const std::string &session_id) const { return m_options.key_prefix + "{" + session_id + "}"; }
+        std::string FillKey(const std::string &session_id) const { return m_options.key_prefix + "{" + session_id + "}:fill"; }
+
+    private:
+        RedisClient::Ptr m_client;
+        RecentMessageCacheOptions m_options;
+    };
+}
+
+#endif // RECENT_MESSAGE_CACHE_H
@@ -2,42 +2,400 @@
 #define REDIS_CLIENT_H
 
 #include <sw/redis++/redis++.h>
+#include <bvar/bvar.h>
 #include <iostream>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <future>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "local_cache.h"
 
 namespace InstantSocial
 {
+    // 自动流水线: 并发到达的单 key 命令由后台线程合并成一条流水线发送
+    struct AutoPipelineOptions
+    {
+        bool enabled = false;
+        std::chrono::microseconds window{0};    // 攒批等待时间, 0 表示只合并发送期间排队的命令, 不额外增加延迟
+        size_t max_batch = 256;                 // 单条流水线的最大命令数
+        size_t flushers = 2;                    // 同时在途的流水线数, 每条占用一个连接
+    };
+
+    struct RedisOptions
+    {
+        enum class Mode { Standalone, Sentinel, Cluster };
+
+        Mode mode = Mode::Standalone;
+        std::string host = "127.0.0.1";                         // 单机地址, 集群模式下为任一种子节点
+        int port = 6379;
+        std::vector<std::pair<std::string, int>> sentinels;     // 哨兵模式的哨兵节点
+        std::string master_name;                                // 哨兵模式监控的主节点名
+        std::string sentinel_user;                              // 哨兵节点自身的认证, 与数据节点的账号相互独立
+        std::string sentinel_password;
+        std::string user;                                       // 数据节点的 ACL 用户名, 为空时使用 default
+        std::string password;
+        int db = 0;                                             // 集群模式只支持 0 号库
+        bool keep_alive = true;
+        std::chrono::milliseconds connect_timeout{3000};
+        std::chrono::milliseconds socket_timeout{3000};
+
+        // 连接池, 集群模式下为每个主节点的连接数
+        size_t pool_size = 8;
+        std::chrono::milliseconds wait_timeout{100};            // 连接池耗尽时的等待时间, 0 表示一直等待
+        std::chrono::milliseconds connection_lifetime{0};       // 连接最长存活时间, 0 表示不限制
+
+        std::string metrics_prefix = "redis_client";            // bvar 指标前缀, 为空时不导出
+        AutoPipelineOptions auto_pipeline;
+    };
+
+    class RedisClient;
+
+    class AutoPipeline
+    {
+    public:
+        struct Op
+        {
+            std::string key;                                                        // 集群模式按 key 的槽位分组
+            std::function<void(sw::redis::Pipeline &)> append;
+            std::function<void(sw::redis::QueuedReplies &, size_t)> reply;
+            std::function<void(std::exception_ptr)> fail;
+        };
+
+        AutoPipeline(RedisClient *client, const AutoPipelineOptions &options);
+        ~AutoPipeline();
+
+        template <typename T>
+        std::future<T> Submit(const std::string &key, std::function<void(sw::redis::Pipeline &)> append)
+        {
+            auto promise = std::make_shared<std::promise<T>>();
+            auto fut = promise->get_future();
+            Op op;
+            op.key = key;
+            op.append = std::move(append);
+            op.reply = [promise](sw::redis::QueuedReplies &replies, size_t index)
+            {
+                promise->set_value(replies.get<T>(index));
+            };
+            op.fail = [promise](std::exception_ptr err) { promise->set_exception(err); };
+            Push(std::move(op));
+            return fut;
+        }
+
+    private:
+        void Push(Op op);
+        void Run();
+        void Flush(std::vector<Op> &batch);
+        static void Exec(sw::redis::Redis &redis, std::vector<Op> &batch);
+        static void Exec(sw::redis::RedisCluster &cluster, std::vector<Op> &batch);
+        static void Dispatch(sw::redis::QueuedReplies &replies, std::vector<Op> &batch, const std::vector<size_t> &indexes);
+
+    private:
+        RedisClient *m_client;
+        AutoPipelineOptions m_options;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::deque<Op> m_queue;
+        bool m_stop = false;
+        std::vector<std::thread> m_flushers;
+    };
+
+    // 统一单机/哨兵/集群三种部署方式的 Redis 客户端, 并统计连接池占用情况
+    class RedisClient
+    {
+    public:
+        using Ptr = std::shared_ptr<RedisClient>;
+
+        RedisClient(const std::shared_ptr<sw::redis::Redis> &redis, size_t pool_size = 1, const std::string &metrics_prefix = "");
+        RedisClient(const std::shared_ptr<sw::redis::RedisCluster> &cluster, size_t pool_size = 1, const std::string &metrics_prefix = "");
+        ~RedisClient();
+
+        bool IsCluster() const { return m_cluster != nullptr; }
+        std::shared_ptr<sw::redis::Redis> Standalone() const { return m_redis; }
+        std::shared_ptr<sw::redis::RedisCluster> Cluster() const { return m_cluster; }
+
+        // f 以 sw::redis::Redis& 或 sw::redis::RedisCluster& 调用, 一般传入泛型 lambda:
+        //   client->Execute([&](auto &r) { return r.get(key); });
+        // 执行期间计为占用一个连接
+        template <typename F>
+        auto Execute(F &&f) -> decltype(f(std::declval<sw::redis::Redis &>()))
+        {
+            Lease lease(this);
+            if (m_cluster) return f(*m_cluster);
+            return f(*m_redis);
+        }
+
+        // 单 key 命令, 开启自动流水线后与其他线程的并发命令合并发送, 调用方仍同步等待结果
+        sw::redis::OptionalString Get(const std::string &key);
+        void Set(const std::string &key, const std::string &value, const std::chrono::milliseconds &ttl = std::chrono::milliseconds(0));
+        long long Del(const std::string &key);
+        // 须在开始使用前调用
+        void EnableAutoPipeline(const AutoPipelineOptions &options);
+
+        sw::redis::Subscriber Subscriber();
+        size_t PoolSize() const { return m_pool_size; }
+        int64_t InFlight() const { return m_in_flight.load(); }
+
+    private:
+        class Lease
+        {
+        public:
+            explicit Lease(RedisClient *client);
+            ~Lease();
+
+        private:
+            RedisClient *m_client;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        struct Metrics
+        {
+            bvar::PassiveStatus<int64_t> in_flight;
+            bvar::PassiveStatus<double> utilization;
+            bvar::Status<int64_t> pool_size;
+            bvar::Maxer<int64_t> peak;
+            bvar::Window<bvar::Maxer<int64_t>> peak_window;
+            bvar::LatencyRecorder latency;
+
+            explicit Metrics(RedisClient *client);
+        };
+
+        void ExposeMetrics(const std::string &prefix);
+        static int64_t GetInFlight(void *arg);
+        static double GetUtilization(void *arg);
+
+    private:
+        std::shared_ptr<sw::redis::Redis> m_redis;
+        std::shared_ptr<sw::redis::RedisCluster> m_cluster;
+        size_t m_pool_size;
+        std::atomic<int64_t> m_in_flight{0};
+        std::unique_ptr<Metrics> m_metrics;
+        std::unique_ptr<AutoPipeline> m_auto_pipeline;
+    };
+
     class RedisFactory
     {
     public:
         RedisFactory() = default;
         static std::shared_ptr<sw::redis::Redis> Create(const std::string &host, int port, bool keep_alive,  const std::string &password = "", int db = 0);
+        // 按 options.mode 创建单机/哨兵/集群客户端, 失败返回 nullptr
+        static RedisClient::Ptr Create(const RedisOptions &options);
+    };
+
+    // Redis Cluster 槽位: CRC16(key) % 16384, key 含非空 {hash tag} 时只对 tag 计算
+    uint16_t RedisKeySlot(const std::string &key);
+    // 按槽位对 key 分组, 返回 槽位 -> keys 中的下标, 同一组内的 key 可以放进一条多 key 命令
+    std::map<uint16_t, std::vector<size_t>> GroupKeysBySlot(const std::vector<std::string> &keys);
+
+    // 对每个 key 追加若干条命令并以流水线发送, 集群模式按槽位拆成多条流水线.
+    // append(pipe, i) 为 keys[i] 追加命令并返回追加的条数, read(replies, offset, i) 从 offset 开始读取 keys[i] 的回复
+    using PipelineAppendFunc = std::function<size_t(sw::redis::Pipeline &pipe, size_t index)>;
+    using PipelineReadFunc = std::function<void(sw::redis::QueuedReplies &replies, size_t offset, size_t index)>;
+    void ExecutePipelined(RedisClient &client, const std::vector<std::string> &keys,
+                          const PipelineAppendFunc &append, const PipelineReadFunc &read);
+
+    // Lua 脚本: 以 EVALSHA 执行, 只发送摘要. 节点上还没有该脚本(首次调用、重启、集群新节点)时
+    // 回复 NOSCRIPT, 改用 EVAL 发送全文, 脚本随之缓存到该节点
+    class RedisScript
+    {
+    public:
+        explicit RedisScript(std::string source);
+        const std::string &Source() const { return m_source; }
+        const std::string &Sha() const { return m_sha; }
+
+        // r 为 sw::redis::Redis 或 sw::redis::RedisCluster
+        template <typename Result, typename R>
+        Result Eval(R &r, const std::vector<std::string> &keys, const std::vector<std::string> &args) const
+        {
+            try
+            {
+                return r.template evalsha<Result>(m_sha, keys.begin(), keys.end(), args.begin(), args.end());
+            }
+            catch (const sw::redis::ReplyError &e)
+            {
+                if (!IsNoScript(e)) throw;
+            }
+            return r.template eval<Result>(m_source, keys.begin(), keys.end(), args.begin(), args.end());
+        }
+
+        template <typename R, typename Output>
+        void Eval(R &r, const std::vector<std::string> &keys, const std::vector<std::string> &args, Output output) const
+        {
+            try
+            {
+                r.evalsha(m_sha, keys.begin(), keys.end(), args.begin(), args.end(), output);
+                return;
+            }
+            catch (const sw::redis::ReplyError &e)
+            {
+                if (!IsNoScript(e)) throw;
+            }
+            r.eval(m_source, keys.begin(), keys.end(), args.begin(), args.end(), output);
+        }
+
+        // 流水线中以 EVALSHA 追加, 回复为 NOSCRIPT 时脚本未执行, 调用方可用 Eval 重试
+        void Append(sw::redis::Pipeline &pipe, const std::vector<std::string> &keys, const std::vector<std::string> &args) const
+        {
+            pipe.evalsha(m_sha, keys.begin(), keys.end(), args.begin(), args.end());
+        }
+
+        static bool IsNoScript(const sw::redis::ReplyError &e);
+
+    private:
+        std::string m_source;
+        std::string m_sha;
+    };
+
+    // 基于 Redis 发布订阅的本地缓存失效通道: 写方发布失效的 key, 所有节点订阅后淘汰本地副本
+    class CacheInvalidator
+    {
+    public:
+        using Ptr = std::shared_ptr<CacheInvalidator>;
+        using InvalidateCallback = std::function<void(const std::string &key)>;
+        using ResetCallback = std::function<void()>;
+
+        CacheInvalidator(const RedisClient::Ptr &client, const std::string &channel,
+                         const InvalidateCallback &on_invalidate, const ResetCallback &on_reset);
+        ~CacheInvalidator();
+        void Publish(const std::string &key);
+        // 一条消息携带多个 key, 以换行分隔
+        void Publish(const std::vector<std::string> &keys);
+
+    private:
+        void Run();
+
+    private:
+        RedisClient::Ptr m_client;
+        std::string m_channel;
+        InvalidateCallback m_on_invalidate;
+        ResetCallback m_on_reset;       // 订阅中断期间可能漏掉消息, 重新订阅后清空本地缓存
+        std::string m_wakeup_channel;   // 本实例独占的频道, 析构时向其发布消息唤醒阻塞的 consume
+        std::atomic<bool> m_running;
+        std::promise<void> m_stopped;
+        std::thread m_thread;
+    };
+
+    struct NearCacheOptions
+    {
+        size_t shards = 16;
+        size_t capacity = 100000;
+        std::chrono::milliseconds ttl{60000};   // 失效消息丢失时的兜底过期时间
+        std::string channel = "instant_social:session:invalidate";
     };
 
     class Session
     {
     public:
         using Ptr = std::shared_ptr<Session>;
-        Session(const std::shared_ptr<sw::redis::Redis> &redis_client) : m_redis_client(redis_client) {}
+        using UidCache = ShardedLruCache<std::string, std::string>;
+        Session(const std::shared_ptr<sw::redis::Redis> &redis_client);
+        // 启用进程内近端缓存, 命中时 GetUid 不访问 Redis
+        Session(const std::shared_ptr<sw::redis::Redis> &redis_client, const NearCacheOptions &options);
+        Session(const std::shared_ptr<sw::redis::RedisCluster> &cluster_client);
+        Session(const RedisClient::Ptr &client) : m_client(client) {}
+        Session(const RedisClient::Ptr &client, const NearCacheOptions &options);
         void Append(const std::string &ssid, const std::string &uid);
         void Remove(const std::string &ssid);
         sw::redis::OptionalString GetUid(const std::string &ssid);
 
+        // 批量接口: 单机一次往返, 集群按槽位分组后每组一次往返. 返回值与入参顺序一一对应
+        std::vector<sw::redis::OptionalString> GetUids(const std::vector<std::string> &ssids);
+        void AppendMany(const std::vector<std::pair<std::string, std::string>> &items);
+        void RemoveMany(const std::vector<std::string> &ssids);
+
+    private:
+        void Invalidate(const std::string &ssid);
+        void Invalidate(const std::vector<std::string> &ssids);
+
     private:
-        std::shared_ptr<sw::redis::Redis> m_redis_client;
+        RedisClient::Ptr m_client;
+        std::shared_ptr<UidCache> m_cache;
+        CacheInvalidator::Ptr m_invalidator;
     };
 
     class Codes
     {
     public:
         using Ptr = std::shared_ptr<Codes>;
-        Codes(const std::shared_ptr<sw::redis::Redis> &redis_client) : m_redis_client(redis_client) {}
+        Codes(const std::shared_ptr<sw::redis::Redis> &redis_client);
+        Codes(const std::shared_ptr<sw::redis::RedisCluster> &cluster_client);
+        Codes(const RedisClient::Ptr &client) : m_client(client) {}
         void Append(const std::string &cid, const std::string &code, const std::chrono::milliseconds &t = std::chrono::milliseconds(300000));
         void Remove(const std::string &cid);
         sw::redis::OptionalString GetCode(const std::string &cid);
 
+        std::vector<sw::redis::OptionalString> GetCodes(const std::vector<std::string> &cids);
+        void AppendMany(const std::vector<std::pair<std::string, std::string>> &items, const std::chrono::milliseconds &t = std::chrono::milliseconds(300000));
+        void RemoveMany(const std::vector<std::string> &cids);
+
+    private:
+        RedisClient::Ptr m_client;
+    };
+
+    struct PresenceOptions
+    {
+        std::chrono::milliseconds ttl{90000};               // 超过该时间没有心跳的设备视为离线, 应大于网关心跳周期
+        std::chrono::milliseconds flush_interval{1000};     // 心跳批量写入周期
+        std::string key_prefix = "presence:";
+    };
+
+    // 一次心跳写入: 每个 key 刷新设备的过期时间为 expire_ms, 清理过期时间不大于 now_ms 的设备, 整个 key 随 ttl 过期
+    struct PresenceBatch
+    {
+        struct Entry
+        {
+            std::string key;
+            std::vector<std::string> devices;
+        };
+        std::vector<Entry> entries;
+        int64_t now_ms = 0;
+        int64_t expire_ms = 0;
+    };
+
+    // 用户在线状态. 每个用户一个 ZSET: member 为设备标识, score 为过期时间(毫秒时间戳).
+    // 网关节点的心跳先在本地合并, 每个周期用一条流水线写入
+    class Presence
+    {
+    public:
+        using Ptr = std::shared_ptr<Presence>;
+        Presence(const RedisClient::Ptr &client, const PresenceOptions &options = PresenceOptions());
+        ~Presence();
+
+        // 记录心跳, 下一个刷新周期写入 Redis. 首次上线应先调用 Online 立即生效
+        void Heartbeat(const std::string &uid, const std::string &device);
+        void Online(const std::string &uid, const std::string &device);
+        void Offline(const std::string &uid, const std::string &device);
+        // 立即写入本地缓冲的心跳
+        void Flush();
+        // 取走本地缓冲的心跳, 按用户合并成一次写入. Flush 以当前时间调用后发送
+        PresenceBatch TakeBatch(int64_t now_ms);
+
+        bool IsOnline(const std::string &uid);
+        // 返回值与入参顺序一一对应
+        std::vector<bool> AreOnline(const std::vector<std::string> &uids);
+        std::vector<std::string> OnlineDevices(const std::string &uid);
+
+    private:
+        std::string Key(const std::string &uid) const;
+        PresenceBatch Build(const std::unordered_map<std::string, std::set<std::string>> &beats, int64_t now_ms) const;
+        void Write(const PresenceBatch &batch);
+        void Run();
+
     private:
-        std::shared_ptr<sw::redis::Redis> m_redis_client;
+        RedisClient::Ptr m_client;
+        PresenceOptions m_options;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::unordered_map<std::string, std::set<std::string>> m_pending;     // uid -> 设备
+        bool m_stop = false;
+        std::thread m_flusher;
     };
 } // namespace InstantSocial
 
-#endif // REDIS_CLIENT_H
\ No newline at end of file
+#endif // REDIS_CLIENT_H
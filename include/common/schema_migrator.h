@@ -0,0 +1,96 @@
+#ifndef SCHEMA_MIGRATOR_H
+#define SCHEMA_MIGRATOR_H
+
+#include <set>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <odb/database.hxx>
+
+namespace InstantSocial
+{
+    struct SchemaMigratorOptions
+    {
+        std::chrono::seconds lock_timeout{60};                  // 等待其他实例完成迁移的最长时间
+        std::chrono::milliseconds progress_interval{5000};      // 在线 DDL 执行期间汇报进度的周期
+        bool allow_blocking = false;                            // 是否执行会阻塞写入的迁移(需要复制整表的 DDL)
+    };
+
+    // 表结构版本管理: 已执行的版本记录在 schema_migrations 表中, 启动时或通过 tools/schema_migrate 按版本号依次执行未执行的迁移.
+    // 空库直接用 ODB 生成的建表语句建出最新结构, 并把所有迁移记为已执行.
+    // 索引变更走 ALGORITHM=INPLACE, LOCK=NONE 在线执行, 执行期间从 performance_schema 读取进度.
+    // 迁移期间持有 MySQL 命名锁, 多个实例同时启动时只有一个执行, 其余等待后发现已无待执行的迁移.
+    // 同时最多占用连接池中的 3 个连接(命名锁、DDL、进度查询)
+    class SchemaMigrator
+    {
+    public:
+        using Ptr = std::shared_ptr<SchemaMigrator>;
+        using Database = std::shared_ptr<odb::core::database>;
+        // 进度回调: 阶段名, 已完成与预估的工作量(InnoDB 以页为单位), 已耗时
+        using ProgressCallback = std::function<void(const std::string &stage, uint64_t completed, uint64_t estimated,
+                                                    std::chrono::milliseconds elapsed)>;
+
+        struct Migration
+        {
+            uint64_t version = 0;
+            std::string description;
+            bool online = true;                             // false 表示执行期间阻塞写入, 只在 allow_blocking 时执行
+            std::function<void(SchemaMigrator &)> apply;    // 须可重复执行: 中途失败后重跑时跳过已完成的部分
+        };
+
+        // 构造时注册 BuiltinMigrations()
+        SchemaMigrator(const Database &db, const SchemaMigratorOptions &options = SchemaMigratorOptions());
+
+        // 版本号重复时抛出 std::invalid_argument
+        void Register(const Migration &migration);
+        void SetProgressCallback(const ProgressCallback &callback) { m_progress = callback; }
+
+        // 已执行的最大版本号, 没有记录时为 0
+        uint64_t CurrentVersion();
+        std::vector<Migration> Pending();
+        // 按版本号依次执行未执行的迁移. 遇到失败或未允许的阻塞迁移时停止, 全部执行完返回 true
+        bool Migrate();
+
+        // 以下供迁移使用, 都先检查当前结构, 已是目标状态时跳过
+        bool TableExists(const std::string &table);
+        bool IndexExists(const std::string &table, const std::string &index);
+        // information_schema 中的 column_type, 如 "timestamp(6)", 列不存在时为空
+        std::string ColumnType(const std::string &table, const std::string &column);
+        // information_schema 中的 extra, 如 "auto_increment", 列不存在时为空
+        std::string ColumnExtra(const std::string &table, const std::string &column);
+        void AddIndex(const std::string &table, const std::string &index, const std::string &columns);
+        void DropIndex(const std::string &table, const std::string &index);
+        // 列类型与 expected_type 不同时执行 MODIFY COLUMN, 这类变更需要复制整表, 期间阻塞写入
+        void ModifyColumn(const std::string &table, const std::string &column, const std::string &definition,
+                          const std::string &expected_type);
+        // 列带 AUTO_INCREMENT 时按 definition 重建该列, 与 ModifyColumn 一样需要复制整表.
+        // 不属于任何版本, 由 tools/schema_migrate 按需执行
+        void DropAutoIncrement(const std::string &table, const std::string &column, const std::string &definition);
+        // 执行 DDL 并在执行期间定期汇报进度
+        void RunDdl(const std::string &sql);
+
+    private:
+        bool Lock(const odb::connection_ptr &conn);
+        void Unlock(const odb::connection_ptr &conn);
+        bool IsEmptyDatabase();
+        void CreateSchema();
+        void EnsureTable();
+        std::set<uint64_t> AppliedVersions();
+        void Record(const Migration &migration, std::chrono::milliseconds duration);
+        void ReportProgress(std::chrono::milliseconds elapsed);
+
+    private:
+        Database m_db;
+        SchemaMigratorOptions m_options;
+        std::vector<Migration> m_migrations;    // 按版本号升序
+        ProgressCallback m_progress;
+    };
+
+    // 项目内置的迁移, 新的结构变更在末尾追加新版本, 已发布的版本不再修改
+    std::vector<SchemaMigrator::Migration> BuiltinMigrations();
+}
+
+#endif // SCHEMA_MIGRATOR_H
@@ -0,0 +1,42 @@
+#ifndef UNREAD_COUNTER_H
+#define UNREAD_COUNTER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "redis_client.h"
+#include "chat_session_member_handler.h"
+
+namespace InstantSocial
+{
+    // 会话未读数. 每个用户一个 Hash: unread:{uid}, field 为会话 id, value 为未读条数,
+    // 渲染会话列表时一次 HMGET 取回, 不访问 MySQL
+    class UnreadCounter
+    {
+    public:
+        using Ptr = std::shared_ptr<UnreadCounter>;
+        UnreadCounter(const RedisClient::Ptr &client, const ChatSessionMemberHandler::Ptr &member_handler,
+                      const std::string &key_prefix = "unread:")
+            : m_client(client), m_member_handler(member_handler), m_key_prefix(key_prefix) {}
+
+        // 新消息: 会话内除发送者外的所有成员未读数加一, 所有成员在一条流水线内完成
+        bool OnMessage(const std::string &session_id, const std::string &sender_id);
+        bool Increment(const std::string &session_id, const std::vector<std::string> &user_ids, long long delta = 1);
+        // 已读: 清零该用户在该会话的未读数
+        bool Reset(const std::string &user_id, const std::string &session_id);
+        // 返回值与 session_ids 顺序一一对应, 没有未读记为 0
+        std::vector<long long> Get(const std::string &user_id, const std::vector<std::string> &session_ids);
+        // 该用户所有未读数不为 0 的会话
+        std::unordered_map<std::string, long long> GetAll(const std::string &user_id);
+
+    private:
+        std::string Key(const std::string &user_id) const { return m_key_prefix + "{" + user_id + "}"; }
+
+    private:
+        RedisClient::Ptr m_client;
+        ChatSessionMemberHandler::Ptr m_member_handler;
+        std::string m_key_prefix;
+    };
+}
+
+#endif // UNREAD_COUNTER_H
@@ -0,0 +1,108 @@
+#ifndef USER_CACHE_H
+#define USER_CACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <bvar/bvar.h>
+#include "local_cache.h"
+#include "user_entity.h"
+
+namespace InstantSocial
+{
+    struct UserCacheOptions
+    {
+        size_t shards = 16;
+        size_t capacity_bytes = 64 << 20;           // 内存上限(按字段长度估算), 3/4 给用户记录, 其余给手机号、邮箱索引
+        std::chrono::milliseconds ttl{300000};      // 兜底过期时间, 覆盖丢失的失效事件和从库延迟回填的旧值
+        std::string metrics_prefix = "user_cache";  // bvar 指标前缀, 为空时不导出
+    };
+
+    // 进程内用户资料缓存: 按 user_id 缓存记录, 手机号、邮箱各有一个指向 user_id 的二级索引.
+    // 二级索引只在命中的记录字段仍与之相等时才算命中, 因此失效时只需删除 user_id 对应的记录.
+    // 回填记录前取该 user_id 的 Epoch(), 读库期间同一分片发生过失效时放弃回填, 避免把旧值写回缓存.
+    // 索引即使是旧的也会被记录校验掉, 随时可以写入
+    class UserCache
+    {
+    public:
+        using Ptr = std::shared_ptr<UserCache>;
+        using User = std::shared_ptr<const UserEntity>;
+
+        explicit UserCache(const UserCacheOptions &options = UserCacheOptions());
+
+        bool GetById(const std::string &user_id, User &user);
+        // 未命中时, 若索引中有该手机号/邮箱对应的 user_id 则通过 user_id 返回, 调用方可以据此取 Epoch 后回填
+        bool GetByPhone(const std::string &phone, User &user, std::string &user_id);
+        bool GetByEmail(const std::string &email, User &user, std::string &user_id);
+
+        uint64_t Epoch(const std::string &user_id) { return m_users.Epoch(user_id); }
+        // 写入记录与索引, epoch 已变化时只写索引
+        void Fill(const UserEntity &user, uint64_t epoch);
+        // 读库前不知道 user_id 时只写索引, 下一次按手机号/邮箱查找再回填记录
+        void FillIndexes(const UserEntity &user);
+        void Invalidate(const std::string &user_id);
+        // 失效通道中断重连后调用, 期间可能漏掉了失效消息
+        void Clear();
+
+        size_t ShardCount() const { return m_users.ShardCount(); }
+        // 自启动以来该分片按 user_id 查找的命中率, 以及用户记录在该分片上占用的字节数(估算)
+        double ShardHitRate(size_t shard) const;
+        int64_t ShardBytes(size_t shard) const;
+        // 索引按手机号/邮箱分片, 与用户记录的分片不对应, 只统计总量
+        int64_t PhoneIndexBytes() const { return IndexBytes(m_phones); }
+        int64_t EmailIndexBytes() const { return IndexBytes(m_emails); }
+
+    private:
+        using IndexCache = ShardedLruCache<std::string, std::string>;
+
+        bool GetByIndex(IndexCache &index, const std::string &key, std::string (UserEntity::*field)() const, User &user,
+                        std::string &user_id);
+        bool Hit();
+        bool Miss();
+        static int64_t IndexBytes(const IndexCache &index);
+
+        struct ShardMetrics
+        {
+            UserCache *cache;
+            size_t shard;
+            bvar::PassiveStatus<double> hit_rate;
+            bvar::PassiveStatus<int64_t> bytes;
+
+            ShardMetrics(UserCache *cache, size_t shard);
+        };
+
+        struct Metrics
+        {
+            bvar::PassiveStatus<double> hit_rate;
+            bvar::PassiveStatus<int64_t> bytes;
+            bvar::PassiveStatus<int64_t> phone_index_bytes;
+            bvar::PassiveStatus<int64_t> email_index_bytes;
+            bvar::Adder<int64_t> invalidations;
+            bvar::Adder<int64_t> stale_fills;
+            std::vector<std::unique_ptr<ShardMetrics>> shards;
+
+            explicit Metrics(UserCache *cache);
+        };
+
+        void ExposeMetrics(const std::string &prefix);
+        static double GetHitRate(void *arg);
+        static int64_t GetBytes(void *arg);
+        static int64_t GetPhoneIndexBytes(void *arg);
+        static int64_t GetEmailIndexBytes(void *arg);
+        static double GetShardHitRate(void *arg);
+        static int64_t GetShardBytes(void *arg);
+
+    private:
+        ShardedLruCache<std::string, User> m_users;
+        IndexCache m_phones;
+        IndexCache m_emails;
+        std::atomic<uint64_t> m_hits{0};
+        std::atomic<uint64_t> m_misses{0};
+        std::unique_ptr<Metrics> m_metrics;
+    };
+}
+
+#endif // USER_CACHE_H
@@ -31,6 +31,14 @@ namespace InstantSocial
         #pragma db type("VARCHAR(64)") index
         std::string m_user_id;
     };
+
+    // 只取 user_id 一列, 用于成员列表查询
+    #pragma db view object(ChatSessionMemberEntity = csm)
+    struct SessionMember
+    {
+        #pragma db column(csm::m_user_id)
+        std::string m_user_id;
+    };
 }
 
 #endif
\ No newline at end of file
@@ -37,6 +37,14 @@ namespace InstantSocial
         #pragma db type("VARCHAR(64)") index
         std::string m_peer_id;
     };
+
+    // 只取 peer_id 一列, 用于申请列表查询
+    #pragma db view object(FriendApplyEntity = fa)
+    struct ApplyPeer
+    {
+        #pragma db column(fa::m_peer_id)
+        std::string m_peer_id;
+    };
 }
 
 #endif // FRIEND_APPLY_ENTITY_H
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cstddef>
+#include <cstdint>
 #include <odb/core.hxx>
 #include <odb/nullable.hxx>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -32,6 +33,9 @@ namespace InstantSocial
               m_message_type(message_type),
               m_create_time(timestamp) {}
 
+        void id(uint64_t id) { m_id = id; }
+        uint64_t id() const { return m_id; }
+
         void message_id(const std::string &message_id) { m_message_id = message_id; }
         const std::string &message_id() const { return m_message_id; }
 
@@ -64,18 +68,22 @@ namespace InstantSocial
 
     private:
         friend class odb::access;
-        #pragma db id auto
-        unsigned long m_id;
-        #pragma db type("VARCHAR(64)") index unique
+        // 写入前由 IdGenerator 分配, 按时间递增, 迁移双写时各分片上主键相同.
+        // 新建的表不带 AUTO_INCREMENT. 旧库的列仍带该属性, 显式写入的值同样被接受,
+        // 需要两边一致时在维护窗口执行 tools/schema_migrate --action=drop_auto_increment
+        #pragma db id type("BIGINT UNSIGNED")
+        uint64_t m_id = 0;
+        // 对外的字符串 id, 由 MessageHandler::Insert 从 m_id 生成, 与主键一一对应, 不建索引; 查询与翻页都用 m_id
+        #pragma db type("VARCHAR(64)")
         std::string m_message_id;
-        #pragma db type("VARCHAR(64)") index
+        #pragma db type("VARCHAR(64)")
         std::string m_session_id;               // 所属会话ID
         #pragma db type("VARCHAR(64)")
         std::string m_user_id;                  // 发送者用户ID
         #pragma db type("TINYINT")
         MessageType m_message_type;             // 消息类型  0-文本 1-图片 2-文件 3-语音 4-视频
-        #pragma db type("TIMESTAMP")
-        boost::posix_time::ptime m_create_time; // 消息创建时间
+        #pragma db type("TIMESTAMP(6)")
+        boost::posix_time::ptime m_create_time; // 消息创建时间, 保留微秒使同一秒内的消息有序
 
         #pragma db type("TEXT")
         odb::nullable<std::string> m_content;   // 消息内容（文本消息存储文本，其他类型存储描述信息）
@@ -87,6 +95,9 @@ namespace InstantSocial
         odb::nullable<std::string> m_file_path; // 文件存储路径
         #pragma db type("INTEGER")
         odb::nullable<unsigned int> m_file_size; // 文件大小（字节）
+
+        // 会话内按时间翻页: session_id 等值 + (create_time, id) 范围扫描, 也覆盖只按 session_id 的查询
+        #pragma db index("message_session_time_idx") members(m_session_id, m_create_time, m_id)
     };
 }
 
@@ -35,6 +35,14 @@ namespace InstantSocial
         #pragma db type("VARCHAR(64)")
         std::string m_peer_id;
     };
+
+    // 只取 peer_id 一列, 用于好友列表查询
+    #pragma db view object(RelationEntity = r)
+    struct RelationPeer
+    {
+        #pragma db column(r::m_peer_id)
+        std::string m_peer_id;
+    };
 }
 
 #endif // RELATION_ENTITY_H
\ No newline at end of file
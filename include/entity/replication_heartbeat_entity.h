@@ -0,0 +1,17 @@
+#ifndef REPLICATION_HEARTBEAT_ENTITY_H
+#define REPLICATION_HEARTBEAT_ENTITY_H
+
+#include <odb/core.hxx>
+
+namespace InstantSocial 
+{
+    // 主库定期写入 replication_heartbeat(id = 1, ts = NOW(6)), 在从库上读出的时间差即复制延迟(含心跳周期)
+    #pragma db view query("SELECT TIMESTAMPDIFF(MICROSECOND, ts, NOW(6)) FROM replication_heartbeat WHERE id = 1")
+    struct ReplicationLag
+    {
+        #pragma db type("BIGINT")
+        long long lag_us;
+    };
+}
+
+#endif // REPLICATION_HEARTBEAT_ENTITY_H
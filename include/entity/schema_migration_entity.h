@@ -0,0 +1,83 @@
+#ifndef SCHEMA_MIGRATION_ENTITY_H
+#define SCHEMA_MIGRATION_ENTITY_H
+
+#include <string>
+#include <odb/core.hxx>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace InstantSocial
+{
+    // 已执行的结构迁移, 每个版本一行
+    #pragma db object table("schema_migrations")
+    class SchemaMigrationEntity
+    {
+    public:
+        SchemaMigrationEntity() = default;
+        SchemaMigrationEntity(unsigned long long version, const std::string &description,
+                              const boost::posix_time::ptime &applied_at, long long duration_ms)
+            : m_version(version), m_description(description), m_applied_at(applied_at), m_duration_ms(duration_ms) {}
+
+        unsigned long long version() const { return m_version; }
+        const std::string &description() const { return m_description; }
+        boost::posix_time::ptime applied_at() const { return m_applied_at; }
+        long long duration_ms() const { return m_duration_ms; }
+
+    private:
+        friend class odb::access;
+        #pragma db id
+        unsigned long long m_version = 0;
+        #pragma db type("VARCHAR(255)")
+        std::string m_description;
+        #pragma db type("TIMESTAMP(6)")
+        boost::posix_time::ptime m_applied_at;
+        long long m_duration_ms = 0;
+    };
+
+    // 以下视图的 (?) 由调用方传入的查询条件替换
+
+    // 统计 information_schema 中满足条件的行数, 用于判断表、索引是否存在
+    #pragma db view query("SELECT COUNT(*) FROM information_schema.statistics WHERE table_schema = DATABASE() AND (?)")
+    struct IndexCount
+    {
+        #pragma db type("BIGINT")
+        long long count;
+    };
+
+    #pragma db view query("SELECT COUNT(*) FROM information_schema.tables WHERE table_schema = DATABASE() AND (?)")
+    struct TableCount
+    {
+        #pragma db type("BIGINT")
+        long long count;
+    };
+
+    #pragma db view query("SELECT column_type, extra FROM information_schema.columns WHERE table_schema = DATABASE() AND (?)")
+    struct ColumnDefinition
+    {
+        #pragma db type("VARCHAR(255)")
+        std::string type;
+        #pragma db type("VARCHAR(255)")
+        std::string extra;
+    };
+
+    // 多个实例同时启动时只让一个执行迁移
+    #pragma db view query("SELECT GET_LOCK('instant_social_schema_migration', (?))")
+    struct MigrationLock
+    {
+        #pragma db type("BIGINT") null
+        long long acquired;
+    };
+
+    // InnoDB 在线 DDL 的进度, 需要开启 performance_schema 的 stage/innodb/alter% 埋点与 events_stages_current 消费者
+    #pragma db view query("SELECT EVENT_NAME, WORK_COMPLETED, WORK_ESTIMATED FROM performance_schema.events_stages_current WHERE EVENT_NAME LIKE 'stage/innodb/alter%'")
+    struct AlterProgress
+    {
+        #pragma db type("VARCHAR(128)")
+        std::string stage;
+        #pragma db type("BIGINT UNSIGNED") null
+        unsigned long long completed;
+        #pragma db type("BIGINT UNSIGNED") null
+        unsigned long long estimated;
+    };
+}
+
+#endif // SCHEMA_MIGRATION_ENTITY_H
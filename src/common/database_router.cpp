@@ -0,0 +1,231 @@
+#include "database_router.h"
+#include "replication_heartbeat_entity.h"
+#include "replication_heartbeat_entity-odb.hxx"
+#include "logger.h"
+#include <odb/transaction.hxx>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        ShardedLruCache<std::string, int64_t>::Options WrittenKeyOptions(const DatabaseRouterOptions &options)
+        {
+            ShardedLruCache<std::string, int64_t>::Options cache_options;
+            cache_options.capacity = options.sticky_capacity;
+            cache_options.ttl = options.sticky_window;
+            return cache_options;
+        }
+    }
+
+    DatabaseRouter::DatabaseRouter(const Database &primary, const std::vector<Database> &replicas,
+                                   const DatabaseRouterOptions &options)
+        : m_primary(primary), m_options(options), m_written(WrittenKeyOptions(options))
+    {
+        for (auto &db : replicas)
+        {
+            if (!db) continue;
+            auto replica = std::make_unique<Replica>();
+            replica->db = db;
+            m_replicas.push_back(std::move(replica));
+        }
+        ExposeMetrics(m_options.metrics_prefix);
+        if (m_replicas.empty()) return;
+
+        try
+        {
+            odb::transaction t(m_primary->begin());
+            m_primary->execute("CREATE TABLE IF NOT EXISTS replication_heartbeat ("
+                               "id INT NOT NULL PRIMARY KEY, ts DATETIME(6) NOT NULL)");
+            t.commit();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Create replication_heartbeat table failed: {}", e.what());
+        }
+        m_heartbeat = std::thread(&DatabaseRouter::Run, this);
+    }
+
+    DatabaseRouter::~DatabaseRouter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        if (m_heartbeat.joinable()) m_heartbeat.join();
+    }
+
+    DatabaseRouter::Database DatabaseRouter::ForRead(const std::string &key)
+    {
+        int64_t written_at = 0;
+        if (!key.empty()) m_written.Get(key, written_at);
+        return Pick(written_at);
+    }
+
+    DatabaseRouter::Database DatabaseRouter::ForRead(const std::vector<std::string> &keys)
+    {
+        int64_t written_at = 0;
+        for (auto &key : keys)
+        {
+            int64_t t = 0;
+            if (m_written.Get(key, t)) written_at = std::max(written_at, t);
+        }
+        return Pick(written_at);
+    }
+
+    void DatabaseRouter::MarkWritten(const std::string &key)
+    {
+        if (m_replicas.empty() || key.empty()) return;
+        m_written.Put(key, NowMicros());
+    }
+
+    void DatabaseRouter::MarkWritten(const std::vector<std::string> &keys)
+    {
+        if (m_replicas.empty()) return;
+        int64_t now = NowMicros();
+        for (auto &key : keys)
+        {
+            if (!key.empty()) m_written.Put(key, now);
+        }
+    }
+
+    int64_t DatabaseRouter::ReplicaLag(size_t index) const
+    {
+        if (index >= m_replicas.size()) return -1;
+        return m_replicas[index]->lag_us.load();
+    }
+
+    int64_t DatabaseRouter::NowMicros()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    DatabaseRouter::Database DatabaseRouter::Pick(int64_t written_at)
+    {
+        if (m_metrics && written_at > 0) m_metrics->sticky_reads << 1;
+        if (!m_replicas.empty())
+        {
+            int64_t now = NowMicros();
+            size_t start = m_next.fetch_add(1, std::memory_order_relaxed);
+            for (size_t i = 0; i < m_replicas.size(); ++i)
+            {
+                auto &replica = *m_replicas[(start + i) % m_replicas.size()];
+                if (Eligible(replica, now, written_at))
+                {
+                    if (m_metrics) m_metrics->replica_reads << 1;
+                    return replica.db;
+                }
+            }
+        }
+        if (m_metrics) m_metrics->primary_reads << 1;
+        return m_primary;
+    }
+
+    bool DatabaseRouter::Eligible(const Replica &replica, int64_t now, int64_t written_at) const
+    {
+        int64_t lag = replica.lag_us.load();
+        if (lag < 0) return false;
+        // 连续几个周期没有测到延迟(从库不可达或心跳线程卡住)时不再信任旧的测量值
+        auto max_lag = std::chrono::duration_cast<std::chrono::microseconds>(m_options.max_replica_lag).count();
+        auto stale = std::chrono::duration_cast<std::chrono::microseconds>(m_options.heartbeat_interval).count() * 3;
+        if (now - replica.measured_at.load() > stale) return false;
+        if (written_at > 0) return replica.caught_up_to.load() >= written_at;
+        return lag <= max_lag;
+    }
+
+    void DatabaseRouter::Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            lock.unlock();
+            Heartbeat();
+            for (auto &replica : m_replicas)
+            {
+                Measure(*replica);
+            }
+            lock.lock();
+            m_cond.wait_for(lock, m_options.heartbeat_interval, [this] { return m_stop; });
+        }
+    }
+
+    void DatabaseRouter::Heartbeat()
+    {
+        try
+        {
+            odb::transaction t(m_primary->begin());
+            m_primary->execute("REPLACE INTO replication_heartbeat (id, ts) VALUES (1, NOW(6))");
+            t.commit();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Write replication heartbeat failed: {}", e.what());
+        }
+    }
+
+    void DatabaseRouter::Measure(Replica &replica)
+    {
+        try
+        {
+            int64_t before = NowMicros();
+            odb::transaction t(replica.db->begin());
+            std::unique_ptr<ReplicationLag> lag(replica.db->query_one<ReplicationLag>());
+            t.commit();
+            if (!lag)
+            {
+                replica.lag_us = -1;
+                return;
+            }
+            // 心跳行最多滞后一个周期, 测得值偏大, 用于判断是偏保守的
+            int64_t lag_us = std::max<int64_t>(lag->lag_us, 0);
+            replica.lag_us = lag_us;
+            replica.caught_up_to = before - lag_us;
+            replica.measured_at = NowMicros();
+        }
+        catch (const std::exception &e)
+        {
+            replica.lag_us = -1;
+            LOG_WARN("Measure replica lag failed: {}", e.what());
+        }
+    }
+
+    DatabaseRouter::Metrics::Metrics(DatabaseRouter *router)
+        : healthy_replicas(GetHealthyReplicas, router),
+          max_lag_us(GetMaxLag, router)
+    {
+    }
+
+    void DatabaseRouter::ExposeMetrics(const std::string &prefix)
+    {
+        if (prefix.empty()) return;
+        m_metrics = std::make_unique<Metrics>(this);
+        m_metrics->primary_reads.expose_as(prefix, "primary_reads");
+        m_metrics->replica_reads.expose_as(prefix, "replica_reads");
+        m_metrics->sticky_reads.expose_as(prefix, "sticky_reads");
+        m_metrics->healthy_replicas.expose_as(prefix, "healthy_replicas");
+        m_metrics->max_lag_us.expose_as(prefix, "max_replica_lag_us");
+    }
+
+    int64_t DatabaseRouter::GetHealthyReplicas(void *arg)
+    {
+        auto router = static_cast<DatabaseRouter *>(arg);
+        int64_t now = NowMicros();
+        int64_t healthy = 0;
+        for (auto &replica : router->m_replicas)
+        {
+            if (router->Eligible(*replica, now, 0)) ++healthy;
+        }
+        return healthy;
+    }
+
+    int64_t DatabaseRouter::GetMaxLag(void *arg)
+    {
+        auto router = static_cast<DatabaseRouter *>(arg);
+        int64_t max_lag = 0;
+        for (auto &replica : router->m_replicas)
+        {
+            max_lag = std::max(max_lag, replica->lag_us.load());
+        }
+        return max_lag;
+    }
+}
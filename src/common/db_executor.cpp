@@ -0,0 +1,119 @@
+#include "db_executor.h"
+
+namespace InstantSocial
+{
+    DbExecutor::DbExecutor(const DbExecutorOptions &options)
+        : m_options(options)
+    {
+        if (m_options.threads == 0) m_options.threads = 1;
+        if (m_options.queue_capacity == 0) m_options.queue_capacity = 1;
+        ExposeMetrics(m_options.metrics_prefix);
+        for (size_t i = 0; i < m_options.threads; ++i)
+        {
+            m_workers.emplace_back(&DbExecutor::Run, this);
+        }
+    }
+
+    DbExecutor::~DbExecutor()
+    {
+        Stop();
+    }
+
+    bool DbExecutor::Post(Task task, Clock::time_point deadline)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_stop && m_queue.size() < m_options.queue_capacity)
+            {
+                m_queue.push_back(Pending{std::move(task), Clock::now(), deadline});
+                m_cond.notify_one();
+                return true;
+            }
+        }
+        if (m_metrics) m_metrics->rejected << 1;
+        LOG_WARN("DbExecutor rejected a call, queue capacity {} reached or executor stopped", m_options.queue_capacity);
+        return false;
+    }
+
+    DbExecutor::Clock::time_point DbExecutor::DeadlineAfter(std::chrono::milliseconds timeout) const
+    {
+        return Clock::now() + (timeout.count() > 0 ? timeout : m_options.default_timeout);
+    }
+
+    void DbExecutor::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop) return;
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (auto &worker : m_workers)
+        {
+            if (worker.joinable()) worker.join();
+        }
+    }
+
+    size_t DbExecutor::Queued()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.size();
+    }
+
+    void DbExecutor::Run()
+    {
+        while (true)
+        {
+            Pending pending;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty()) return;
+                pending = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+
+            auto start = Clock::now();
+            // 调用方多半已经超时放弃, 再执行只会加重数据库负担
+            bool run = start <= pending.deadline;
+            if (m_metrics)
+            {
+                m_metrics->wait << std::chrono::duration_cast<std::chrono::microseconds>(start - pending.enqueued).count();
+                if (!run) m_metrics->expired << 1;
+            }
+            try
+            {
+                pending.task(run);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("DbExecutor task failed: {}", e.what());
+            }
+            if (run && m_metrics)
+            {
+                m_metrics->exec << std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+            }
+        }
+    }
+
+    DbExecutor::Metrics::Metrics(DbExecutor *executor)
+        : queued(GetQueued, executor)
+    {
+    }
+
+    void DbExecutor::ExposeMetrics(const std::string &prefix)
+    {
+        if (prefix.empty()) return;
+        m_metrics = std::make_unique<Metrics>(this);
+        m_metrics->queued.expose_as(prefix, "queued");
+        m_metrics->wait.expose(prefix + "_wait");
+        m_metrics->exec.expose(prefix + "_exec");
+        m_metrics->rejected.expose_as(prefix, "rejected");
+        m_metrics->expired.expose_as(prefix, "expired");
+    }
+
+    int64_t DbExecutor::GetQueued(void *arg)
+    {
+        return static_cast<int64_t>(static_cast<DbExecutor *>(arg)->Queued());
+    }
+}
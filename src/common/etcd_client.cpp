@@ -1,5 +1,7 @@
 #include "etcd_client.h"
 #include "logger.h"
+#include <set>
+#include <stdexcept>
 
 namespace InstantSocial 
 {
@@ -36,6 +38,66 @@ namespace InstantSocial
         return true;
     }
 
+    WorkerIdLease::WorkerIdLease(const std::string &host, const std::string &prefix, const std::string &owner,
+                                 uint32_t max_workers, int ttl)
+    {
+        m_client = std::make_shared<etcd::Client>(host);
+        m_keep_alive = std::make_shared<etcd::KeepAlive>(*m_client, [this, prefix](std::exception_ptr) {
+            m_alive = false;
+            LOG_ERROR("Lease of worker id {}{} lost", prefix, m_worker_id);
+        }, ttl);
+        int64_t lease_id = m_keep_alive->Lease();
+
+        // 先跳过已被占用的 id, 其余的逐个尝试创建, 与其他实例同时抢到同一个 id 时只有一个 add 成功
+        std::set<uint32_t> taken;
+        auto resp = m_client->ls(prefix).get();
+        if (resp.is_ok())
+        {
+            for (const auto &kv : resp.values())
+            {
+                try
+                {
+                    taken.insert(static_cast<uint32_t>(std::stoul(kv.key().substr(prefix.size()))));
+                }
+                catch (const std::exception &)
+                {
+                }
+            }
+        }
+        for (uint32_t id = 0; id < max_workers; ++id)
+        {
+            if (taken.count(id)) continue;
+            resp = m_client->add(prefix + std::to_string(id), owner, lease_id).get();
+            if (resp.is_ok())
+            {
+                m_worker_id = id;
+                LOG_INFO("Leased worker id {}{} for {}", prefix, id, owner);
+                return;
+            }
+            if (resp.error_code() != etcd::ERROR_KEY_ALREADY_EXISTS)
+            {
+                LOG_ERROR("Lease worker id {}{} failed: {}", prefix, id, resp.error_message());
+                break;
+            }
+        }
+        // 抛出前停止续约, 回调中引用了 this
+        m_keep_alive->Cancel();
+        throw std::runtime_error("no worker id available under " + prefix);
+    }
+
+    WorkerIdLease::~WorkerIdLease()
+    {
+        if (m_keep_alive)
+        {
+            m_keep_alive->Cancel();
+        }
+    }
+
+    IdGenerator::Ptr LeasedIdGenerator(const WorkerIdLease::Ptr &lease, const IdGeneratorOptions &options)
+    {
+        return std::make_shared<IdGenerator>(lease->WorkerId(), options, [lease]() { return lease->Alive(); });
+    }
+
     ServiceDiscovery::ServiceDiscovery(const std::string &host, 
                                        const std::string &basedir, 
                                        const NotifyCallback &put_cb, 
@@ -0,0 +1,148 @@
+#include "friend_cache.h"
+#include "logger.h"
+#include <random>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        // KEYS[1] 集合 KEYS[2] 回填令牌; ARGV[1] 好友 id
+        const RedisScript kAddScript(
+            "redis.call('DEL', KEYS[2]) "
+            "if redis.call('EXISTS', KEYS[1]) == 1 then redis.call('SADD', KEYS[1], ARGV[1]) end "
+            "return 0");
+
+        const RedisScript kRemoveScript(
+            "redis.call('DEL', KEYS[2]) "
+            "redis.call('SREM', KEYS[1], ARGV[1]) "
+            "return 0");
+
+        // 返回 -1 表示集合未加载
+        const RedisScript kContainsScript(
+            "if redis.call('EXISTS', KEYS[1]) == 0 then return -1 end "
+            "return redis.call('SISMEMBER', KEYS[1], ARGV[1])");
+
+        // KEYS[1] 集合 KEYS[2] 回填令牌; ARGV[1] 令牌 ARGV[2] 过期毫秒 ARGV[3..] 哨兵与好友 id
+        const RedisScript kFillScript(
+            "if redis.call('GET', KEYS[2]) ~= ARGV[1] then return 0 end "
+            "redis.call('DEL', KEYS[2]) "
+            "if redis.call('EXISTS', KEYS[1]) == 1 then return 0 end "
+            "redis.call('SADD', KEYS[1], unpack(ARGV, 3)) "
+            "redis.call('PEXPIRE', KEYS[1], ARGV[2]) "
+            "return 1");
+
+        const char *kLoadedSentinel = "";
+
+        std::string NewToken()
+        {
+            thread_local std::mt19937_64 rng(std::random_device{}());
+            std::ostringstream oss;
+            oss << std::hex << rng() << rng();
+            return oss.str();
+        }
+    }
+
+    void FriendCache::Update(const RedisScript &script, const std::string &user_id, const std::string &peer_id)
+    {
+        // 两个方向的集合可能在不同槽位, 各自执行一次脚本, 通过流水线一次发送
+        std::vector<std::string> keys = {SetKey(user_id), SetKey(peer_id)};
+        std::vector<std::vector<std::string>> script_keys = {{keys[0], FillKey(user_id)}, {keys[1], FillKey(peer_id)}};
+        std::vector<std::vector<std::string>> args = {{peer_id}, {user_id}};
+        std::vector<size_t> no_script;
+        ExecutePipelined(*m_client, keys,
+            [&](sw::redis::Pipeline &pipe, size_t i)
+            {
+                script.Append(pipe, script_keys[i], args[i]);
+                return size_t(1);
+            },
+            [&](sw::redis::QueuedReplies &replies, size_t offset, size_t i)
+            {
+                try
+                {
+                    replies.get<long long>(offset);
+                }
+                catch (const sw::redis::ReplyError &e)
+                {
+                    if (!RedisScript::IsNoScript(e)) throw;
+                    no_script.push_back(i);
+                }
+            });
+        // 节点上还没有脚本, 该方向未执行, 以 EVAL 补做
+        for (size_t i : no_script)
+        {
+            m_client->Execute([&](auto &r) { return script.Eval<long long>(r, script_keys[i], args[i]); });
+        }
+    }
+
+    void FriendCache::Add(const std::string &user_id, const std::string &peer_id)
+    {
+        if (!m_client) return;
+        Update(kAddScript, user_id, peer_id);
+    }
+
+    void FriendCache::Remove(const std::string &user_id, const std::string &peer_id)
+    {
+        if (!m_client) return;
+        Update(kRemoveScript, user_id, peer_id);
+    }
+
+    bool FriendCache::Contains(const std::string &user_id, const std::string &peer_id, bool &is_friend)
+    {
+        if (!m_client || peer_id.empty()) return false;
+        std::vector<std::string> keys = {SetKey(user_id)};
+        std::vector<std::string> args = {peer_id};
+        auto res = m_client->Execute([&](auto &r)
+        {
+            return kContainsScript.Eval<long long>(r, keys, args);
+        });
+        if (res < 0) return false;
+        is_friend = res == 1;
+        return true;
+    }
+
+    bool FriendCache::Members(const std::string &user_id, std::vector<std::string> &peers)
+    {
+        if (!m_client) return false;
+        std::vector<std::string> members;
+        std::string key = SetKey(user_id);
+        m_client->Execute([&](auto &r) { r.smembers(key, std::back_inserter(members)); });
+        if (members.empty()) return false;
+        peers.clear();
+        for (auto &member : members)
+        {
+            if (member != kLoadedSentinel) peers.push_back(std::move(member));
+        }
+        return true;
+    }
+
+    std::string FriendCache::BeginFill(const std::string &user_id)
+    {
+        if (!m_client) return std::string();
+        std::string token = NewToken();
+        m_client->Set(FillKey(user_id), token, m_options.fill_timeout);
+        return token;
+    }
+
+    bool FriendCache::Fill(const std::string &user_id, const std::string &token, const std::vector<std::string> &peers)
+    {
+        if (!m_client || token.empty()) return false;
+        std::vector<std::string> keys = {SetKey(user_id), FillKey(user_id)};
+        std::vector<std::string> args = {token, std::to_string(m_options.ttl.count()), kLoadedSentinel};
+        args.insert(args.end(), peers.begin(), peers.end());
+        auto filled = m_client->Execute([&](auto &r)
+        {
+            return kFillScript.Eval<long long>(r, keys, args);
+        });
+        return filled == 1;
+    }
+
+    void FriendCache::Invalidate(const std::string &user_id)
+    {
+        if (!m_client) return;
+        std::vector<std::string> keys = {SetKey(user_id), FillKey(user_id)};
+        m_client->Execute([&](auto &r) { r.del(keys.begin(), keys.end()); });
+    }
+}
@@ -0,0 +1,111 @@
+#include "id_generator.h"
+#include "logger.h"
+#include <thread>
+#include <stdexcept>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        const int kTimestampBits = 41;
+        const uint32_t kSequenceMask = (1u << IdGenerator::kSequenceBits) - 1;
+        const char kHexDigits[] = "0123456789abcdef";
+    }
+
+    IdGenerator::IdGenerator(uint32_t worker_id, const IdGeneratorOptions &options, const LeaseCheck &lease_check)
+        : m_worker_id(worker_id), m_options(options), m_lease_check(lease_check)
+    {
+        if (worker_id > kMaxWorkerId)
+        {
+            throw std::invalid_argument("worker id " + std::to_string(worker_id) + " exceeds " + std::to_string(kMaxWorkerId));
+        }
+    }
+
+    uint64_t IdGenerator::Next()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_lease_check && !m_lease_check())
+        {
+            LOG_ERROR("Worker id {} lease lost, stop generating ids", m_worker_id);
+            return 0;
+        }
+
+        int64_t now = NowMs();
+        if (now < m_last_ms)
+        {
+            // 小幅回拨(如 NTP 校时)等待追上, 继续发号会与回拨前的 id 重复
+            if (m_last_ms - now > m_options.max_backward.count())
+            {
+                LOG_ERROR("Clock moved backwards by {}ms, refuse to generate id", m_last_ms - now);
+                return 0;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_last_ms - now));
+            now = NowMs();
+            if (now < m_last_ms)
+            {
+                LOG_ERROR("Clock still {}ms behind last id, refuse to generate id", m_last_ms - now);
+                return 0;
+            }
+        }
+
+        if (now == m_last_ms)
+        {
+            m_sequence = (m_sequence + 1) & kSequenceMask;
+            if (m_sequence == 0)
+            {
+                // 本毫秒序号用完, 等到下一毫秒
+                while ((now = NowMs()) <= m_last_ms)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        else
+        {
+            m_sequence = 0;
+        }
+        m_last_ms = now;
+
+        int64_t elapsed = now - m_options.epoch_ms;
+        if (elapsed < 0 || elapsed >= (int64_t(1) << kTimestampBits))
+        {
+            LOG_ERROR("Timestamp {}ms is out of range of epoch {}", now, m_options.epoch_ms);
+            return 0;
+        }
+        return static_cast<uint64_t>(elapsed) << (kWorkerBits + kSequenceBits) |
+               static_cast<uint64_t>(m_worker_id) << kSequenceBits | m_sequence;
+    }
+
+    std::string IdGenerator::ToString(uint64_t id)
+    {
+        std::string str(16, '0');
+        for (int i = 15; i >= 0; --i)
+        {
+            str[i] = kHexDigits[id & 0xf];
+            id >>= 4;
+        }
+        return str;
+    }
+
+    bool IdGenerator::FromString(const std::string &str, uint64_t &id)
+    {
+        if (str.size() != 16) return false;
+        uint64_t value = 0;
+        for (char c : str)
+        {
+            int digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else return false;
+            value = value << 4 | static_cast<uint64_t>(digit);
+        }
+        id = value;
+        return true;
+    }
+
+    int64_t IdGenerator::NowMs() const
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
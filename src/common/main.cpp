@@ -2,6 +2,7 @@
 #include "rabbitmq.h"
 #include "redis_client.h"
 #include "odb_client.h"
+#include "schema_migrator.h"
 #include "odb_handler_test.h"
 #include <memory>
 #include <vector>
@@ -89,17 +90,26 @@ void TestDatabase()
     LOG_INFO("=== 测试数据库 ===");
     try 
     {
+        InstantSocial::MySQLPoolOptions pool_options;
+        pool_options.min_connections = 2;
+        pool_options.max_connections = 8;
         auto odb_db = InstantSocial::ODBFactory::Create(
             InstantSocial::DatabaseType::MySQL, 
             "192.168.113.205", 
             "root", 
             "123456", 
-            "test", 3306, 2, "utf8mb4"
+            "test", 3306, pool_options, "utf8mb4"
         );
         
         if (odb_db) 
         {
             LOG_INFO("数据库连接成功");
+            // 启动时执行在线迁移, 阻塞写入的迁移留给 tools/schema_migrate 在维护窗口执行
+            InstantSocial::SchemaMigrator migrator(odb_db);
+            if (!migrator.Migrate())
+            {
+                LOG_WARN("数据库结构迁移未全部完成, 当前版本 {}", migrator.CurrentVersion());
+            }
             // 测试所有 ODB Handler
             InstantSocial::TestAllODBHandlers(odb_db);
         } 
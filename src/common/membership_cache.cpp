@@ -0,0 +1,229 @@
+#include "membership_cache.h"
+#include "logger.h"
+#include <random>
+#include <sstream>
+#include <iterator>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        // 脚本调用 TIME 之后还要写入: Redis 5 之前按脚本整体复制, 需先切换为按命令复制才允许这样做.
+        // Redis 5 起这是默认行为, 调用只是空操作
+        const char *kReplicateCommands = "redis.replicate_commands() ";
+
+        // 版本号不存在时以 Redis 服务器的微秒时间戳初始化
+        const char *kBumpVersion =
+            "local function bump(key) "
+            "  if redis.call('EXISTS', key) == 0 then "
+            "    local t = redis.call('TIME') "
+            "    redis.call('SET', key, t[1] .. string.format('%06d', tonumber(t[2]))) "
+            "  end "
+            "  return redis.call('INCR', key) "
+            "end ";
+
+        // 成员较多时分批展开参数, 避免超出 Lua 栈上限
+        const char *kBatchCall =
+            "local function batch(cmd, key, from) "
+            "  for i = from, #ARGV, 1000 do "
+            "    redis.call(cmd, key, unpack(ARGV, i, math.min(i + 999, #ARGV))) "
+            "  end "
+            "end ";
+
+        // KEYS[1] 集合 KEYS[2] 版本号 KEYS[3] 回填令牌; ARGV[1] 过期毫秒 ARGV[2..] 用户 id
+        const RedisScript kAddScript(std::string(kReplicateCommands) + kBumpVersion + kBatchCall +
+            "redis.call('DEL', KEYS[3]) "
+            "local ver = bump(KEYS[2]) "
+            "if redis.call('EXISTS', KEYS[1]) == 1 then "
+            "  batch('SADD', KEYS[1], 2) "
+            "  redis.call('PEXPIRE', KEYS[1], ARGV[1]) "
+            "end "
+            "redis.call('PEXPIRE', KEYS[2], ARGV[1]) "
+            "return ver");
+
+        const RedisScript kRemoveScript(std::string(kReplicateCommands) + kBumpVersion + kBatchCall +
+            "redis.call('DEL', KEYS[3]) "
+            "local ver = bump(KEYS[2]) "
+            "if redis.call('EXISTS', KEYS[1]) == 1 then "
+            "  batch('SREM', KEYS[1], 2) "
+            "end "
+            "redis.call('PEXPIRE', KEYS[2], ARGV[1]) "
+            "return ver");
+
+        const RedisScript kClearScript(std::string(kReplicateCommands) + kBumpVersion +
+            "redis.call('DEL', KEYS[1], KEYS[3]) "
+            "local ver = bump(KEYS[2]) "
+            "redis.call('PEXPIRE', KEYS[2], ARGV[1]) "
+            "return ver");
+
+        // KEYS[1] 集合 KEYS[2] 版本号; ARGV[1] 调用方已有的版本号.
+        // 未加载返回空数组, 版本未变只返回 {版本号}, 否则返回 {版本号, 成员...}
+        const RedisScript kReadScript(
+            "if redis.call('EXISTS', KEYS[1]) == 0 then return {} end "
+            "local ver = redis.call('GET', KEYS[2]) or '0' "
+            "if ver == ARGV[1] then return {ver} end "
+            "local members = redis.call('SMEMBERS', KEYS[1]) "
+            "table.insert(members, 1, ver) "
+            "return members");
+
+        // KEYS[1] 集合 KEYS[2] 版本号 KEYS[3] 回填令牌; ARGV[1] 令牌 ARGV[2] 过期毫秒 ARGV[3..] 哨兵与用户 id
+        const RedisScript kFillScript(std::string(kReplicateCommands) + kBatchCall +
+            "if redis.call('GET', KEYS[3]) ~= ARGV[1] then return false end "
+            "redis.call('DEL', KEYS[3]) "
+            "if redis.call('EXISTS', KEYS[1]) == 1 then return false end "
+            "if redis.call('EXISTS', KEYS[2]) == 0 then "
+            "  local t = redis.call('TIME') "
+            "  redis.call('SET', KEYS[2], t[1] .. string.format('%06d', tonumber(t[2]))) "
+            "end "
+            "batch('SADD', KEYS[1], 3) "
+            "redis.call('PEXPIRE', KEYS[1], ARGV[2]) "
+            "redis.call('PEXPIRE', KEYS[2], ARGV[2]) "
+            "return redis.call('GET', KEYS[2])");
+
+        const char *kLoadedSentinel = "";
+
+        std::string NewToken()
+        {
+            thread_local std::mt19937_64 rng(std::random_device{}());
+            std::ostringstream oss;
+            oss << std::hex << rng() << rng();
+            return oss.str();
+        }
+    }
+
+    MembershipCache::MembershipCache(const RedisClient::Ptr &client, const MembershipCacheOptions &options)
+        : m_client(client), m_options(options)
+    {
+        if (m_options.local_capacity > 0)
+        {
+            LocalCache::Options local_options;
+            local_options.shards = m_options.local_shards;
+            local_options.capacity = m_options.local_capacity;
+            // 按成员数计容量, 大群占用相应更多的额度
+            m_local = std::make_unique<LocalCache>(local_options, [](const std::string &, const Entry &entry)
+            {
+                return entry.members ? entry.members->size() + 1 : 1;
+            });
+        }
+    }
+
+    bool MembershipCache::Get(const std::string &session_id, MemberList &members, long long &version)
+    {
+        if (!m_client) return false;
+        Entry local;
+        bool has_local = m_local && m_local->Get(session_id, local);
+        uint64_t epoch = m_local ? m_local->Epoch(session_id) : 0;
+
+        std::vector<std::string> keys = {SetKey(session_id), VersionKey(session_id)};
+        std::vector<std::string> args = {has_local ? std::to_string(local.version) : std::string()};
+        std::vector<std::string> reply;
+        m_client->Execute([&](auto &r)
+        {
+            kReadScript.Eval(r, keys, args, std::back_inserter(reply));
+        });
+        if (reply.empty())
+        {
+            if (has_local) m_local->Erase(session_id);
+            return false;
+        }
+
+        version = std::stoll(reply[0]);
+        if (reply.size() == 1 && has_local)
+        {
+            members = local.members;
+            return true;
+        }
+
+        auto list = std::make_shared<std::vector<std::string>>();
+        list->reserve(reply.size() - 1);
+        for (size_t i = 1; i < reply.size(); ++i)
+        {
+            if (reply[i] != kLoadedSentinel) list->push_back(std::move(reply[i]));
+        }
+        members = list;
+        if (m_local)
+        {
+            Entry entry;
+            entry.version = version;
+            entry.members = members;
+            m_local->Put(session_id, entry, epoch);
+        }
+        return true;
+    }
+
+    long long MembershipCache::Version(const std::string &session_id)
+    {
+        if (!m_client) return 0;
+        auto ver = m_client->Get(VersionKey(session_id));
+        return ver ? std::stoll(*ver) : 0;
+    }
+
+    void MembershipCache::Update(const RedisScript &script, const std::string &session_id, const std::vector<std::string> &user_ids)
+    {
+        if (!m_client) return;
+        // 本地副本先删除, 其他节点通过版本号发现变更
+        if (m_local) m_local->Erase(session_id);
+        std::vector<std::string> keys = {SetKey(session_id), VersionKey(session_id), FillKey(session_id)};
+        std::vector<std::string> args = {std::to_string(m_options.ttl.count())};
+        args.insert(args.end(), user_ids.begin(), user_ids.end());
+        m_client->Execute([&](auto &r)
+        {
+            return script.Eval<long long>(r, keys, args);
+        });
+    }
+
+    void MembershipCache::Add(const std::string &session_id, const std::vector<std::string> &user_ids)
+    {
+        if (user_ids.empty()) return;
+        Update(kAddScript, session_id, user_ids);
+    }
+
+    void MembershipCache::Remove(const std::string &session_id, const std::vector<std::string> &user_ids)
+    {
+        if (user_ids.empty()) return;
+        Update(kRemoveScript, session_id, user_ids);
+    }
+
+    void MembershipCache::Clear(const std::string &session_id)
+    {
+        Update(kClearScript, session_id, {});
+    }
+
+    std::string MembershipCache::BeginFill(const std::string &session_id)
+    {
+        if (!m_client) return std::string();
+        std::string token = NewToken();
+        m_client->Set(FillKey(session_id), token, m_options.fill_timeout);
+        return token;
+    }
+
+    bool MembershipCache::Fill(const std::string &session_id, const std::string &token, const std::vector<std::string> &user_ids)
+    {
+        if (!m_client || token.empty()) return false;
+        std::vector<std::string> keys = {SetKey(session_id), VersionKey(session_id), FillKey(session_id)};
+        std::vector<std::string> args = {token, std::to_string(m_options.ttl.count()), kLoadedSentinel};
+        args.insert(args.end(), user_ids.begin(), user_ids.end());
+        uint64_t epoch = m_local ? m_local->Epoch(session_id) : 0;
+        auto version = m_client->Execute([&](auto &r)
+        {
+            return kFillScript.Eval<sw::redis::OptionalString>(r, keys, args);
+        });
+        if (!version) return false;
+        if (m_local)
+        {
+            Entry entry;
+            entry.version = std::stoll(*version);
+            entry.members = std::make_shared<const std::vector<std::string>>(user_ids);
+            m_local->Put(session_id, entry, epoch);
+        }
+        return true;
+    }
+
+    void MembershipCache::Invalidate(const std::string &session_id)
+    {
+        if (!m_client) return;
+        if (m_local) m_local->Erase(session_id);
+        std::vector<std::string> keys = {SetKey(session_id), FillKey(session_id)};
+        m_client->Execute([&](auto &r) { r.del(keys.begin(), keys.end()); });
+    }
+}
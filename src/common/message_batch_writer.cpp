@@ -0,0 +1,186 @@
+#include "message_batch_writer.h"
+#include "message_entity-odb.hxx"
+#include "logger.h"
+#include <map>
+
+namespace InstantSocial
+{
+    MessageBatchWriter::MessageBatchWriter(const Resolver &resolver, const MessageBatchWriterOptions &options)
+        : m_resolver(resolver), m_options(options)
+    {
+        if (m_options.max_batch == 0) m_options.max_batch = 1;
+        if (m_options.queue_capacity < m_options.max_batch) m_options.queue_capacity = m_options.max_batch;
+        ExposeMetrics(m_options.metrics_prefix);
+        m_flusher = std::thread(&MessageBatchWriter::Run, this);
+    }
+
+    MessageBatchWriter::~MessageBatchWriter()
+    {
+        Stop();
+    }
+
+    std::future<bool> MessageBatchWriter::Submit(const MessageEntity &message)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_space_cond.wait(lock, [this]() { return m_stop || m_queue.size() < m_options.queue_capacity; });
+        if (m_stop)
+        {
+            std::promise<bool> rejected;
+            rejected.set_value(false);
+            return rejected.get_future();
+        }
+        m_queue.push_back(Pending{message, std::promise<bool>(), Clock::now()});
+        auto future = m_queue.back().done.get_future();
+        // 攒满一批或队列由空变非空时唤醒后台线程, 其余情况由其按 max_delay 定时醒来
+        if (m_queue.size() == 1 || m_queue.size() >= m_options.max_batch)
+        {
+            m_cond.notify_one();
+        }
+        return future;
+    }
+
+    void MessageBatchWriter::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop) return;
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_space_cond.notify_all();
+        if (m_flusher.joinable()) m_flusher.join();
+    }
+
+    void MessageBatchWriter::Run()
+    {
+        std::vector<Pending> batch;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty()) return;
+                // 队首消息等满 max_delay 或攒够 max_batch 后提交, 停止时不再等待
+                auto deadline = m_queue.front().enqueued + m_options.max_delay;
+                m_cond.wait_until(lock, deadline, [this]() { return m_stop || m_queue.size() >= m_options.max_batch; });
+
+                size_t count = std::min(m_queue.size(), m_options.max_batch);
+                batch.clear();
+                batch.reserve(count);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    batch.push_back(std::move(m_queue.front()));
+                    m_queue.pop_front();
+                }
+            }
+            m_space_cond.notify_all();
+            Flush(batch);
+        }
+    }
+
+    void MessageBatchWriter::Flush(std::vector<Pending> &batch)
+    {
+        auto now = Clock::now();
+        std::map<Database, std::vector<Pending *>> groups;
+        for (auto &pending : batch)
+        {
+            if (m_metrics)
+            {
+                m_metrics->wait << std::chrono::duration_cast<std::chrono::microseconds>(now - pending.enqueued).count();
+            }
+            Database db;
+            try
+            {
+                db = m_resolver(pending.message);
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Resolve database for message {} failed: {}", pending.message.message_id(), e.what());
+            }
+            if (!db)
+            {
+                pending.done.set_value(false);
+                continue;
+            }
+            groups[db].push_back(&pending);
+        }
+        if (m_metrics) m_metrics->batch_size << static_cast<int64_t>(batch.size());
+
+        for (auto &group : groups)
+        {
+            Write(group.first, group.second);
+        }
+    }
+
+    void MessageBatchWriter::Write(const Database &db, std::vector<Pending *> &group)
+    {
+        auto start = Clock::now();
+        try
+        {
+            odb::transaction t(db->begin());
+            for (auto pending : group)
+            {
+                db->persist(pending->message);
+            }
+            t.commit();
+            if (m_metrics)
+            {
+                m_metrics->commit << std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+            }
+            for (auto pending : group)
+            {
+                pending->done.set_value(true);
+            }
+            LOG_DEBUG("Group committed {} messages", group.size());
+            return;
+        }
+        catch (const std::exception &e)
+        {
+            // 常见原因是调用方指定的 id 与已有消息的主键冲突, 逐条重试让其余消息照常写入
+            LOG_WARN("Group commit of {} messages failed, retrying one by one: {}", group.size(), e.what());
+            if (m_metrics) m_metrics->fallbacks << 1;
+        }
+
+        for (auto pending : group)
+        {
+            bool ok = false;
+            try
+            {
+                odb::transaction t(db->begin());
+                db->persist(pending->message);
+                t.commit();
+                ok = true;
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Insert message {} failed: {}", pending->message.message_id(), e.what());
+                if (m_metrics) m_metrics->failures << 1;
+            }
+            pending->done.set_value(ok);
+        }
+    }
+
+    MessageBatchWriter::Metrics::Metrics(MessageBatchWriter *writer)
+        : queued(GetQueued, writer)
+    {
+    }
+
+    void MessageBatchWriter::ExposeMetrics(const std::string &prefix)
+    {
+        if (prefix.empty()) return;
+        m_metrics = std::make_unique<Metrics>(this);
+        m_metrics->queued.expose_as(prefix, "queued");
+        m_metrics->batch_size.expose_as(prefix, "batch_size");
+        m_metrics->commit.expose(prefix + "_commit");
+        m_metrics->wait.expose(prefix + "_wait");
+        m_metrics->fallbacks.expose_as(prefix, "fallbacks");
+        m_metrics->failures.expose_as(prefix, "failures");
+    }
+
+    int64_t MessageBatchWriter::GetQueued(void *arg)
+    {
+        auto writer = static_cast<MessageBatchWriter *>(arg);
+        std::lock_guard<std::mutex> lock(writer->m_mutex);
+        return static_cast<int64_t>(writer->m_queue.size());
+    }
+}
@@ -0,0 +1,163 @@
+#include "message_codec.h"
+#include <cstring>
+#include <limits>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        const uint8_t kCodecVersion = 2;
+
+        // 可空字段标志位
+        enum : uint8_t
+        {
+            kHasContent = 1 << 0,
+            kHasFileId = 1 << 1,
+            kHasFileName = 1 << 2,
+            kHasFilePath = 1 << 3,
+            kHasFileSize = 1 << 4,
+        };
+
+        const boost::posix_time::ptime kEpoch(boost::gregorian::date(1970, 1, 1));
+
+        void PutFixed(std::string &out, uint64_t value, size_t bytes)
+        {
+            for (size_t i = 0; i < bytes; ++i)
+            {
+                out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+            }
+        }
+
+        void PutString(std::string &out, const std::string &value)
+        {
+            PutFixed(out, value.size(), 4);
+            out.append(value);
+        }
+
+        class Reader
+        {
+        public:
+            explicit Reader(const std::string &data) : m_data(data) {}
+
+            bool Fixed(uint64_t &value, size_t bytes)
+            {
+                if (m_data.size() - m_pos < bytes) return false;
+                value = 0;
+                for (size_t i = 0; i < bytes; ++i)
+                {
+                    value |= static_cast<uint64_t>(static_cast<uint8_t>(m_data[m_pos + i])) << (8 * i);
+                }
+                m_pos += bytes;
+                return true;
+            }
+
+            bool String(std::string &value)
+            {
+                uint64_t size;
+                if (!Fixed(size, 4) || m_data.size() - m_pos < size) return false;
+                value.assign(m_data, m_pos, size);
+                m_pos += size;
+                return true;
+            }
+
+            bool Done() const { return m_pos == m_data.size(); }
+
+        private:
+            const std::string &m_data;
+            size_t m_pos = 0;
+        };
+    }
+
+    std::string EncodeMessage(const MessageEntity &message)
+    {
+        std::string out;
+        out.reserve(64 + message.content().size());
+        out.push_back(static_cast<char>(kCodecVersion));
+
+        // 实体只暴露取值接口, 空字符串与 0 视为未设置
+        uint8_t flags = 0;
+        if (!message.content().empty()) flags |= kHasContent;
+        if (!message.file_id().empty()) flags |= kHasFileId;
+        if (!message.file_name().empty()) flags |= kHasFileName;
+        if (!message.file_path().empty()) flags |= kHasFilePath;
+        if (message.file_size() != 0) flags |= kHasFileSize;
+        out.push_back(static_cast<char>(flags));
+
+        out.append(EncodeMessageIdentity(message));
+        PutString(out, message.session_id());
+        PutString(out, message.user_id());
+        out.push_back(static_cast<char>(message.message_type()));
+        int64_t micros = message.create_time().is_special()
+            ? std::numeric_limits<int64_t>::min()
+            : (message.create_time() - kEpoch).total_microseconds();
+        PutFixed(out, static_cast<uint64_t>(micros), 8);
+
+        if (flags & kHasContent) PutString(out, message.content());
+        if (flags & kHasFileId) PutString(out, message.file_id());
+        if (flags & kHasFileName) PutString(out, message.file_name());
+        if (flags & kHasFilePath) PutString(out, message.file_path());
+        if (flags & kHasFileSize) PutFixed(out, message.file_size(), 4);
+        return out;
+    }
+
+    std::string EncodeMessageIdentity(const MessageEntity &message)
+    {
+        std::string out;
+        PutFixed(out, message.id(), 8);
+        PutString(out, message.message_id());
+        return out;
+    }
+
+    bool DecodeMessage(const std::string &data, MessageEntity &message)
+    {
+        Reader reader(data);
+        uint64_t version, flags, id, type, micros, file_size;
+        std::string message_id, session_id, user_id, value;
+        if (!reader.Fixed(version, 1) || version != kCodecVersion) return false;
+        if (!reader.Fixed(flags, 1) || !reader.Fixed(id, 8)) return false;
+        if (!reader.String(message_id) || !reader.String(session_id) || !reader.String(user_id)) return false;
+        if (!reader.Fixed(type, 1) || !reader.Fixed(micros, 8)) return false;
+
+        message = MessageEntity();
+        message.id(id);
+        message.message_id(message_id);
+        message.session_id(session_id);
+        message.user_id(user_id);
+        message.message_type(static_cast<MessageType>(type));
+        if (static_cast<int64_t>(micros) == std::numeric_limits<int64_t>::min())
+        {
+            message.create_time(boost::posix_time::ptime());
+        }
+        else
+        {
+            message.create_time(kEpoch + boost::posix_time::microseconds(static_cast<int64_t>(micros)));
+        }
+
+        if (flags & kHasContent)
+        {
+            if (!reader.String(value)) return false;
+            message.content(value);
+        }
+        if (flags & kHasFileId)
+        {
+            if (!reader.String(value)) return false;
+            message.file_id(value);
+        }
+        if (flags & kHasFileName)
+        {
+            if (!reader.String(value)) return false;
+            message.file_name(value);
+        }
+        if (flags & kHasFilePath)
+        {
+            if (!reader.String(value)) return false;
+            message.file_path(value);
+        }
+        if (flags & kHasFileSize)
+        {
+            if (!reader.Fixed(file_size, 4)) return false;
+            message.file_size(static_cast<unsigned int>(file_size));
+        }
+        return reader.Done();
+    }
+}
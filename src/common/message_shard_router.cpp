@@ -0,0 +1,206 @@
+#include "message_shard_router.h"
+#include "logger.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        struct Crc32Table
+        {
+            uint32_t values[256];
+            Crc32Table()
+            {
+                for (uint32_t i = 0; i < 256; ++i)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k)
+                    {
+                        c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                    }
+                    values[i] = c;
+                }
+            }
+        };
+
+        bool ParseRange(const std::string &range, size_t &begin, size_t &end)
+        {
+            auto dash = range.find('-');
+            try
+            {
+                begin = std::stoul(range.substr(0, dash));
+                end = dash == std::string::npos ? begin : std::stoul(range.substr(dash + 1));
+            }
+            catch (const std::exception &)
+            {
+                return false;
+            }
+            return begin <= end;
+        }
+    }
+
+    uint32_t Crc32(const std::string &data)
+    {
+        static const Crc32Table table;
+        uint32_t crc = 0xFFFFFFFFu;
+        for (unsigned char c : data)
+        {
+            crc = table.values[(crc ^ c) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    uint32_t ShardMap::BucketOf(const std::string &session_id) const
+    {
+        return Crc32(session_id) % static_cast<uint32_t>(owner.size());
+    }
+
+    ShardMap ShardMap::Uniform(size_t shards, size_t buckets)
+    {
+        ShardMap map;
+        map.version = 1;
+        map.owner.resize(buckets);
+        map.migrating_to.assign(buckets, kNone);
+        for (size_t b = 0; b < buckets; ++b)
+        {
+            map.owner[b] = static_cast<int>(b * shards / buckets);
+        }
+        return map;
+    }
+
+    std::string ShardMap::Format() const
+    {
+        std::ostringstream oss;
+        oss << "version " << version << "\n";
+        oss << "buckets " << owner.size() << "\n";
+        size_t begin = 0;
+        for (size_t b = 1; b <= owner.size(); ++b)
+        {
+            if (b < owner.size() && owner[b] == owner[begin] && migrating_to[b] == migrating_to[begin]) continue;
+            oss << begin << "-" << b - 1 << " " << owner[begin];
+            if (migrating_to[begin] != kNone) oss << " -> " << migrating_to[begin];
+            oss << "\n";
+            begin = b;
+        }
+        return oss.str();
+    }
+
+    bool ShardMap::Parse(const std::string &text, ShardMap &map)
+    {
+        ShardMap parsed;
+        std::istringstream lines(text);
+        std::string line;
+        std::vector<bool> seen;
+        while (std::getline(lines, line))
+        {
+            std::istringstream fields(line);
+            std::string first;
+            if (!(fields >> first) || first[0] == '#') continue;
+            if (first == "version")
+            {
+                if (!(fields >> parsed.version)) return false;
+                continue;
+            }
+            if (first == "buckets")
+            {
+                size_t buckets = 0;
+                if (!(fields >> buckets) || buckets == 0 || !parsed.owner.empty()) return false;
+                parsed.owner.assign(buckets, kNone);
+                parsed.migrating_to.assign(buckets, kNone);
+                seen.assign(buckets, false);
+                continue;
+            }
+
+            size_t begin = 0, end = 0;
+            int owner = kNone, target = kNone;
+            std::string arrow;
+            if (parsed.owner.empty() || !ParseRange(first, begin, end) || end >= parsed.owner.size()) return false;
+            if (!(fields >> owner) || owner < 0) return false;
+            if (fields >> arrow)
+            {
+                if (arrow != "->" || !(fields >> target) || target < 0 || target == owner) return false;
+            }
+            for (size_t b = begin; b <= end; ++b)
+            {
+                if (seen[b]) return false;
+                seen[b] = true;
+                parsed.owner[b] = owner;
+                parsed.migrating_to[b] = target;
+            }
+        }
+        if (parsed.owner.empty()) return false;
+        for (bool s : seen)
+        {
+            if (!s) return false;
+        }
+        map = std::move(parsed);
+        return true;
+    }
+
+    MessageShardRouter::MessageShardRouter(const std::vector<Database> &shards, const ShardMap &map)
+        : m_shards(shards)
+    {
+        if (!Valid(map))
+        {
+            throw std::invalid_argument("invalid message shard map");
+        }
+        m_map = std::make_shared<const ShardMap>(map);
+    }
+
+    MessageShardRouter::Database MessageShardRouter::ForSession(const std::string &session_id) const
+    {
+        auto map = Map();
+        return m_shards[map->owner[map->BucketOf(session_id)]];
+    }
+
+    std::vector<MessageShardRouter::Database> MessageShardRouter::WriteTargets(const std::string &session_id) const
+    {
+        auto map = Map();
+        uint32_t bucket = map->BucketOf(session_id);
+        std::vector<Database> targets = {m_shards[map->owner[bucket]]};
+        if (map->migrating_to[bucket] != ShardMap::kNone)
+        {
+            targets.push_back(m_shards[map->migrating_to[bucket]]);
+        }
+        return targets;
+    }
+
+    bool MessageShardRouter::UpdateMap(const ShardMap &map)
+    {
+        if (!Valid(map))
+        {
+            LOG_ERROR("Reject message shard map version {}: invalid", map.version);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (map.Buckets() != m_map->Buckets() || map.version <= m_map->version)
+        {
+            LOG_WARN("Reject message shard map version {}: current version {}, buckets {} -> {}",
+                     map.version, m_map->version, m_map->Buckets(), map.Buckets());
+            return false;
+        }
+        m_map = std::make_shared<const ShardMap>(map);
+        LOG_INFO("Message shard map updated to version {}", map.version);
+        return true;
+    }
+
+    std::shared_ptr<const ShardMap> MessageShardRouter::Map() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_map;
+    }
+
+    bool MessageShardRouter::Valid(const ShardMap &map) const
+    {
+        if (map.Buckets() == 0 || map.migrating_to.size() != map.Buckets()) return false;
+        int shards = static_cast<int>(m_shards.size());
+        for (size_t b = 0; b < map.Buckets(); ++b)
+        {
+            if (map.owner[b] < 0 || map.owner[b] >= shards || !m_shards[map.owner[b]]) return false;
+            if (map.migrating_to[b] != ShardMap::kNone &&
+                (map.migrating_to[b] < 0 || map.migrating_to[b] >= shards || !m_shards[map.migrating_to[b]])) return false;
+        }
+        return true;
+    }
+}
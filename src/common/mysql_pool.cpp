@@ -0,0 +1,474 @@
+#include "mysql_pool.h"
+#include "logger.h"
+#include <odb/exceptions.hxx>
+#include <odb/mysql/mysql.hxx>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        // database 到其连接池的登记, 供 MySQLConnectionPool::Of 查找
+        std::mutex g_pools_mutex;
+        std::unordered_map<const odb::core::database *, MySQLConnectionPool *> g_pools;
+    }
+
+    // 归还时不析构, 由引用计数归零回调交还给连接池, 做法与 odb 自带的 pooled_connection 相同
+    class MySQLConnectionPool::PooledConnection : public odb::mysql::connection
+    {
+    public:
+        explicit PooledConnection(MySQLConnectionPool &pool)
+            : odb::mysql::connection(*pool.m_db), m_pool(&pool),
+              created(Clock::now()), last_used(created)
+        {
+            m_callback.arg = this;
+            m_callback.zero_counter = &ZeroCounter;
+        }
+
+        void Attach() { callback_ = &m_callback; }
+        void Detach() { callback_ = nullptr; }
+        // 清理未释放的语句等状态, 使连接可以被下一个使用者复用
+        void Recycle()
+        {
+            clear();
+            recycle();
+        }
+        bool Ping() { return mysql_ping(handle()) == 0; }
+
+    private:
+        static bool ZeroCounter(void *arg)
+        {
+            auto conn = static_cast<PooledConnection *>(arg);
+            return conn->m_pool->Release(conn);
+        }
+
+    private:
+        MySQLConnectionPool *m_pool;
+        odb::details::shared_base::refcount_callback m_callback;
+
+    public:
+        const Clock::time_point created;
+        Clock::time_point last_used;
+    };
+
+    MySQLConnectionPool::MySQLConnectionPool(const MySQLPoolOptions &options)
+        : m_options(options)
+    {
+        m_options.max_connections = std::max<size_t>(m_options.max_connections, 1);
+        m_options.min_connections = std::min(m_options.min_connections, m_options.max_connections);
+        m_options.max_connections_limit = std::max(m_options.max_connections_limit, m_options.max_connections);
+        m_max_connections = m_options.max_connections;
+        ExposeMetrics(m_options.metrics_prefix);
+    }
+
+    MySQLConnectionPool::~MySQLConnectionPool()
+    {
+        if (m_db)
+        {
+            std::lock_guard<std::mutex> lock(g_pools_mutex);
+            g_pools.erase(m_db);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_stop_cond.notify_all();
+        if (m_maintainer.joinable()) m_maintainer.join();
+        std::deque<IdleConnection> idle;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            idle.swap(m_idle);
+        }
+    }
+
+    void MySQLConnectionPool::database(database_type &db)
+    {
+        m_db = &db;
+        {
+            std::lock_guard<std::mutex> lock(g_pools_mutex);
+            g_pools[m_db] = this;
+        }
+        std::vector<PooledConnectionPtr> warm;
+        for (size_t i = 0; i < m_options.min_connections; ++i)
+        {
+            try
+            {
+                warm.push_back(Create());
+            }
+            catch (const std::exception &e)
+            {
+                // 预热失败不影响启动, 之后按需建立连接
+                LOG_WARN("MySQL pool warm-up failed after {} connections: {}", warm.size(), e.what());
+                break;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto now = Clock::now();
+            for (auto &conn : warm)
+            {
+                m_idle.push_back(IdleConnection{conn, now});
+            }
+        }
+        LOG_INFO("MySQL pool ready: warm={}, min={}, max={}", warm.size(), m_options.min_connections, m_max_connections);
+        m_maintainer = std::thread(&MySQLConnectionPool::Run, this);
+    }
+
+    odb::mysql::connection_ptr MySQLConnectionPool::connect()
+    {
+        auto start = Clock::now();
+        bool waited = false;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            if (!m_idle.empty())
+            {
+                PooledConnectionPtr conn = m_idle.back().conn;
+                m_idle.pop_back();
+                ++m_in_use;
+                lock.unlock();
+
+                auto now = Clock::now();
+                if (!Expired(*conn, now) && Validate(*conn, now))
+                {
+                    return Borrow(conn, start);
+                }
+                conn.reset();
+                OnClosed(1);
+                lock.lock();
+                --m_in_use;
+                continue;
+            }
+
+            if (m_in_use < m_max_connections)
+            {
+                ++m_in_use;
+                lock.unlock();
+                try
+                {
+                    return Borrow(Create(), start);
+                }
+                catch (...)
+                {
+                    lock.lock();
+                    --m_in_use;
+                    lock.unlock();
+                    m_cond.notify_one();
+                    throw;
+                }
+            }
+
+            if (!waited)
+            {
+                waited = true;
+                ++m_wait_count;
+            }
+            ++m_waiters;
+            if (m_options.wait_timeout.count() > 0)
+            {
+                auto deadline = start + m_options.wait_timeout;
+                if (m_cond.wait_until(lock, deadline) == std::cv_status::timeout && m_idle.empty() && m_in_use >= m_max_connections)
+                {
+                    --m_waiters;
+                    lock.unlock();
+                    ++m_timeouts;
+                    if (m_metrics) m_metrics->timeouts << 1;
+                    LOG_WARN("MySQL pool wait timeout: in_use={}, max={}", m_in_use, m_max_connections);
+                    throw odb::timeout();
+                }
+            }
+            else
+            {
+                m_cond.wait(lock);
+            }
+            --m_waiters;
+        }
+    }
+
+    MySQLConnectionPool::PooledConnectionPtr MySQLConnectionPool::Create()
+    {
+        PooledConnectionPtr conn(new PooledConnection(*this));
+        ++m_created;
+        if (m_metrics) m_metrics->created << 1;
+        return conn;
+    }
+
+    bool MySQLConnectionPool::Expired(const PooledConnection &conn, Clock::time_point now) const
+    {
+        return m_options.max_lifetime.count() > 0 && now - conn.created >= m_options.max_lifetime;
+    }
+
+    bool MySQLConnectionPool::Validate(PooledConnection &conn, Clock::time_point now)
+    {
+        // 刚用过的连接跳过 ping, 避免每次借出都多一次往返
+        if (now - conn.last_used < m_options.ping_interval) return true;
+        if (conn.Ping()) return true;
+        ++m_ping_failures;
+        if (m_metrics) m_metrics->ping_failures << 1;
+        LOG_WARN("MySQL pool dropped a dead connection, idle for {} ms",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(now - conn.last_used).count());
+        return false;
+    }
+
+    odb::mysql::connection_ptr MySQLConnectionPool::Borrow(const PooledConnectionPtr &conn, Clock::time_point start)
+    {
+        auto now = Clock::now();
+        auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+        conn->last_used = now;
+        conn->Attach();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_peak_in_use = std::max(m_peak_in_use, m_in_use);
+            m_wait_us += wait_us;
+        }
+        if (m_metrics) m_metrics->wait << wait_us;
+        return conn;
+    }
+
+    bool MySQLConnectionPool::Release(PooledConnection *conn)
+    {
+        conn->Detach();
+        auto now = Clock::now();
+        bool keep = !conn->failed() && !Expired(*conn, now);
+        if (keep)
+        {
+            try
+            {
+                conn->Recycle();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_WARN("MySQL pool recycle connection failed: {}", e.what());
+                keep = false;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_in_use;
+            // 缩容后超出上限的连接直接关闭
+            keep = keep && !m_stop && m_in_use + m_idle.size() < m_max_connections;
+            if (keep)
+            {
+                conn->last_used = now;
+                m_idle.push_back(IdleConnection{PooledConnectionPtr(odb::details::inc_ref(conn)), now});
+            }
+        }
+        m_cond.notify_one();
+        if (!keep) OnClosed(1);
+        return !keep;
+    }
+
+    void MySQLConnectionPool::Resize(size_t max_connections)
+    {
+        std::vector<PooledConnectionPtr> closing;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_max_connections = std::max({max_connections, m_options.min_connections, size_t(1)});
+            while (!m_idle.empty() && m_in_use + m_idle.size() > m_max_connections)
+            {
+                closing.push_back(m_idle.front().conn);
+                m_idle.pop_front();
+            }
+        }
+        m_cond.notify_all();
+        OnClosed(closing.size());
+        LOG_INFO("MySQL pool resized: max={}", max_connections);
+    }
+
+    MySQLConnectionPool::Stats MySQLConnectionPool::GetStats() const
+    {
+        Stats stats;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            stats.idle = m_idle.size();
+            stats.in_use = m_in_use;
+            stats.waiters = m_waiters;
+            stats.max_connections = m_max_connections;
+        }
+        stats.created = m_created.load();
+        stats.closed = m_closed.load();
+        stats.ping_failures = m_ping_failures.load();
+        stats.timeouts = m_timeouts.load();
+        return stats;
+    }
+
+    size_t MySQLConnectionPool::Available() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t busy = m_in_use + m_waiters;
+        return m_max_connections > busy ? m_max_connections - busy : 0;
+    }
+
+    MySQLConnectionPool *MySQLConnectionPool::Of(const odb::core::database &db)
+    {
+        std::lock_guard<std::mutex> lock(g_pools_mutex);
+        auto it = g_pools.find(&db);
+        return it == g_pools.end() ? nullptr : it->second;
+    }
+
+    void MySQLConnectionPool::Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            m_stop_cond.wait_for(lock, m_options.maintain_interval, [this] { return m_stop; });
+            if (m_stop) break;
+            lock.unlock();
+            try
+            {
+                Maintain();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("MySQL pool maintenance failed: {}", e.what());
+            }
+            lock.lock();
+        }
+    }
+
+    void MySQLConnectionPool::Maintain()
+    {
+        auto now = Clock::now();
+        std::vector<PooledConnectionPtr> closing;
+        size_t missing = 0;
+        size_t resize_to = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // 回收: 超过存活时间的连接全部关闭, 闲置超时的连接只关闭到 min_connections 为止
+            for (auto it = m_idle.begin(); it != m_idle.end();)
+            {
+                bool idle_too_long = now - it->since >= m_options.idle_timeout &&
+                                     m_in_use + m_idle.size() > m_options.min_connections;
+                if (Expired(*it->conn, now) || idle_too_long)
+                {
+                    closing.push_back(it->conn);
+                    it = m_idle.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            size_t total = m_in_use + m_idle.size();
+            missing = total < m_options.min_connections ? m_options.min_connections - total : 0;
+
+            // 扩缩容: 本周期内借出需要排队且平均等待偏高时扩容, 借出峰值不到一半时逐步缩回 max_connections
+            if (m_options.max_connections_limit > m_options.max_connections)
+            {
+                uint64_t borrows_waited = m_wait_count;
+                uint64_t avg_wait = borrows_waited > 0 ? m_wait_us / borrows_waited : 0;
+                if (borrows_waited > 0 && avg_wait > static_cast<uint64_t>(m_options.resize_wait_threshold.count()) &&
+                    m_max_connections < m_options.max_connections_limit)
+                {
+                    resize_to = std::min(m_max_connections + m_options.resize_step, m_options.max_connections_limit);
+                }
+                else if (borrows_waited == 0 && m_peak_in_use * 2 < m_max_connections &&
+                         m_max_connections > m_options.max_connections)
+                {
+                    resize_to = std::max(m_max_connections - std::min(m_options.resize_step, m_max_connections),
+                                         m_options.max_connections);
+                }
+            }
+            m_wait_count = 0;
+            m_wait_us = 0;
+            m_peak_in_use = m_in_use;
+        }
+        OnClosed(closing.size());
+        closing.clear();
+
+        // 补足常驻连接
+        std::vector<PooledConnectionPtr> created;
+        for (size_t i = 0; i < missing; ++i)
+        {
+            try
+            {
+                created.push_back(Create());
+            }
+            catch (const std::exception &e)
+            {
+                LOG_WARN("MySQL pool refill failed: {}", e.what());
+                break;
+            }
+        }
+        if (!created.empty())
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto &conn : created)
+            {
+                m_idle.push_back(IdleConnection{conn, Clock::now()});
+            }
+        }
+        if (!created.empty()) m_cond.notify_all();
+
+        if (resize_to > 0) Resize(resize_to);
+    }
+
+    void MySQLConnectionPool::OnClosed(size_t count)
+    {
+        if (count == 0) return;
+        m_closed += count;
+        if (m_metrics) m_metrics->closed << static_cast<int64_t>(count);
+    }
+
+    MySQLConnectionPool::Metrics::Metrics(MySQLConnectionPool *pool)
+        : idle(GetIdle, pool),
+          in_use(GetInUse, pool),
+          waiters(GetWaiters, pool),
+          max_connections(GetMaxConnections, pool),
+          utilization(GetUtilization, pool)
+    {
+    }
+
+    void MySQLConnectionPool::ExposeMetrics(const std::string &prefix)
+    {
+        if (prefix.empty()) return;
+        m_metrics = std::make_unique<Metrics>(this);
+        m_metrics->idle.expose_as(prefix, "idle");
+        m_metrics->in_use.expose_as(prefix, "in_use");
+        m_metrics->waiters.expose_as(prefix, "waiters");
+        m_metrics->max_connections.expose_as(prefix, "max_connections");
+        m_metrics->utilization.expose_as(prefix, "utilization");
+        m_metrics->wait.expose(prefix + "_wait");
+        m_metrics->created.expose_as(prefix, "created");
+        m_metrics->closed.expose_as(prefix, "closed");
+        m_metrics->ping_failures.expose_as(prefix, "ping_failures");
+        m_metrics->timeouts.expose_as(prefix, "timeouts");
+    }
+
+    int64_t MySQLConnectionPool::GetIdle(void *arg)
+    {
+        auto pool = static_cast<MySQLConnectionPool *>(arg);
+        std::lock_guard<std::mutex> lock(pool->m_mutex);
+        return static_cast<int64_t>(pool->m_idle.size());
+    }
+
+    int64_t MySQLConnectionPool::GetInUse(void *arg)
+    {
+        auto pool = static_cast<MySQLConnectionPool *>(arg);
+        std::lock_guard<std::mutex> lock(pool->m_mutex);
+        return static_cast<int64_t>(pool->m_in_use);
+    }
+
+    int64_t MySQLConnectionPool::GetWaiters(void *arg)
+    {
+        auto pool = static_cast<MySQLConnectionPool *>(arg);
+        std::lock_guard<std::mutex> lock(pool->m_mutex);
+        return static_cast<int64_t>(pool->m_waiters);
+    }
+
+    int64_t MySQLConnectionPool::GetMaxConnections(void *arg)
+    {
+        auto pool = static_cast<MySQLConnectionPool *>(arg);
+        std::lock_guard<std::mutex> lock(pool->m_mutex);
+        return static_cast<int64_t>(pool->m_max_connections);
+    }
+
+    double MySQLConnectionPool::GetUtilization(void *arg)
+    {
+        auto pool = static_cast<MySQLConnectionPool *>(arg);
+        std::lock_guard<std::mutex> lock(pool->m_mutex);
+        return static_cast<double>(pool->m_in_use) / pool->m_max_connections;
+    }
+}
@@ -39,4 +39,77 @@ namespace InstantSocial
                 return nullptr;
         }
     }
+
+    std::shared_ptr<odb::core::database> ODBFactory::Create(DatabaseType db_type,
+                                                        const std::string& host,
+                                                        const std::string& user,
+                                                        const std::string& password,
+                                                        const std::string& dbName,
+                                                        unsigned int port,
+                                                        const MySQLPoolOptions &pool_options,
+                                                        const std::string &cset)
+    {
+        switch (db_type)
+        {
+            case DatabaseType::MySQL:
+            {
+                try {
+                    std::unique_ptr<MySQLConnectionPool> pool(new MySQLConnectionPool(pool_options));
+
+                    auto db = std::make_shared<odb::mysql::database>(user,
+                                                                password,
+                                                                dbName,
+                                                                host,
+                                                                port,
+                                                                "",
+                                                                cset,
+                                                                0,
+                                                                std::move(pool));
+                    return db;
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Create MySQLConnectionPool fail : {}", e.what());
+                    return nullptr;
+                }
+            }
+            default:
+                LOG_ERROR("Unsupported database type");
+                return nullptr;
+        }
+    }
+
+    DatabaseRouter::Ptr ODBFactory::CreateRouter(DatabaseType db_type,
+                                                 const DatabaseEndpoint &primary,
+                                                 const std::vector<DatabaseEndpoint> &replicas,
+                                                 const std::string &user,
+                                                 const std::string &password,
+                                                 const std::string &dbName,
+                                                 const MySQLPoolOptions &pool_options,
+                                                 const DatabaseRouterOptions &router_options,
+                                                 const std::string &cset)
+    {
+        auto primary_db = Create(db_type, primary.host, user, password, dbName, primary.port, pool_options, cset);
+        if (!primary_db)
+        {
+            return nullptr;
+        }
+
+        std::vector<std::shared_ptr<odb::core::database>> replica_dbs;
+        for (size_t i = 0; i < replicas.size(); ++i)
+        {
+            // 各实例的连接池指标按序号区分
+            MySQLPoolOptions replica_pool_options = pool_options;
+            if (!pool_options.metrics_prefix.empty())
+            {
+                replica_pool_options.metrics_prefix = pool_options.metrics_prefix + "_replica" + std::to_string(i);
+            }
+            auto db = Create(db_type, replicas[i].host, user, password, dbName, replicas[i].port, replica_pool_options, cset);
+            if (!db)
+            {
+                LOG_WARN("Skip replica {}:{}", replicas[i].host, replicas[i].port);
+                continue;
+            }
+            replica_dbs.push_back(db);
+        }
+        return std::make_shared<DatabaseRouter>(primary_db, replica_dbs, router_options);
+    }
 }
\ No newline at end of file
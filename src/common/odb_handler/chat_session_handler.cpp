@@ -1,15 +1,32 @@
 #include "chat_session_handler.h"
+#include "prepared_query_cache.h"
+#include "transaction_scope.h"
 #include "logger.h"
 
 namespace InstantSocial
 {
+    namespace
+    {
+        // 预编译查询的绑定参数
+        struct SessionKey
+        {
+            std::string session_id;
+        };
+
+        struct UserSessionKey
+        {
+            std::string user_id;
+        };
+    }
+
     bool ChatSessionHandler::Insert(ChatSessionEntity &entity)
     {
         try
         {
-            odb::transaction t(m_db->begin());
-            m_db->persist(entity);
-            t.commit();
+            TransactionScope t(m_db);
+            t.db().persist(entity);
+            t.MarkWritten(m_router, "session:" + entity.chat_session_id());
+            t.Commit();
             LOG_INFO("ChatSessionHandler::Insert success, session_id: {}", entity.chat_session_id());
         }
         catch (const odb::exception &e)
@@ -24,12 +41,13 @@ namespace InstantSocial
     {
         try
         {
-            odb::transaction t(m_db->begin());
+            TransactionScope t(m_db);
             typedef odb::query<ChatSessionEntity> Query;
             typedef odb::query<ChatSessionMemberEntity> MemberQuery;
-            m_db->erase_query<ChatSessionEntity>(Query::chat_session_id == session_id);
-            m_db->erase_query<ChatSessionMemberEntity>(MemberQuery::session_id == session_id);
-            t.commit();
+            t.db().erase_query<ChatSessionEntity>(Query::chat_session_id == session_id);
+            t.db().erase_query<ChatSessionMemberEntity>(MemberQuery::session_id == session_id);
+            t.MarkWritten(m_router, {"session:" + session_id, "member:" + session_id});
+            t.Commit();
             LOG_INFO("ChatSessionHandler::RemoveBySessionId success, session_id: {}", session_id);
         }
         catch (const odb::exception &e)
@@ -44,9 +62,9 @@ namespace InstantSocial
     {
         try
         {
-            odb::transaction t(m_db->begin());
+            TransactionScope t(m_db);
             typedef odb::query<SingleChatSession> Query;
-            auto res = m_db->query_one<SingleChatSession>
+            auto res = t.db().query_one<SingleChatSession>
             (
                 Query::csm1::user_id == user_id &&
                 Query::csm2::user_id == user_id &&
@@ -55,9 +73,11 @@ namespace InstantSocial
             std::string chat_session_id = res->m_chat_session_id;
             typedef odb::query<ChatSessionEntity> ChatSessionQuery;
             typedef odb::query<ChatSessionMemberEntity> MemberQuery;
-            m_db->erase_query<ChatSessionEntity>(ChatSessionQuery::chat_session_id == chat_session_id);
-            m_db->erase_query<ChatSessionMemberEntity>(MemberQuery::session_id == chat_session_id);
-            t.commit();
+            t.db().erase_query<ChatSessionEntity>(ChatSessionQuery::chat_session_id == chat_session_id);
+            t.db().erase_query<ChatSessionMemberEntity>(MemberQuery::session_id == chat_session_id);
+            t.MarkWritten(m_router, {"session:" + chat_session_id, "member:" + chat_session_id,
+                                     "user_session:" + user_id, "user_session:" + peer_id});
+            t.Commit();
             LOG_INFO("ChatSessionHandler::RemoveByUserIdAndPeerId success, user_id: {}, peer_id: {}", user_id, peer_id);
         }
         catch (const odb::exception &e)
@@ -74,10 +94,16 @@ namespace InstantSocial
         std::shared_ptr<ChatSessionEntity> entity;
         try
         {
-            odb::transaction t(m_db->begin());
+            auto db = m_router ? m_router->ForRead("session:" + session_id) : m_db;
+            TransactionScope t(db);
             typedef odb::query<ChatSessionEntity> Query;
-            entity.reset(m_db->query_one<ChatSessionEntity>(Query::chat_session_id == session_id));
-            t.commit();
+            SessionKey *params = nullptr;
+            auto pq = CachedQuery<ChatSessionEntity>("chat-session-by-id", params, [](SessionKey &p) {
+                return Query(Query::chat_session_id == Query::_ref(p.session_id));
+            });
+            params->session_id = session_id;
+            entity.reset(pq.execute_one());
+            t.Commit();
             LOG_INFO("ChatSessionHandler::GetBySessionId success, session_id: {}", session_id);
         }
         catch (const odb::exception &e)
@@ -92,19 +118,22 @@ namespace InstantSocial
         std::vector<SingleChatSession> session_list;
         try
         {
-            odb::transaction t(m_db->begin());
+            auto db = m_router ? m_router->ForRead("user_session:" + user_id) : m_db;
+            TransactionScope t(db);
             typedef odb::query<SingleChatSession> Query;
             typedef odb::result<SingleChatSession> Result;
-            Result r(m_db->query<SingleChatSession>
-            (
-                Query::csm1::user_id == user_id &&
-                Query::csm2::user_id != Query::csm1::user_id 
-            ));
+            UserSessionKey *params = nullptr;
+            auto pq = CachedQuery<SingleChatSession>("single-chat-sessions", params, [](UserSessionKey &p) {
+                return Query(Query::csm1::user_id == Query::_ref(p.user_id) &&
+                             Query::csm2::user_id != Query::csm1::user_id);
+            });
+            params->user_id = user_id;
+            Result r(pq.execute(true));
             for (const auto &session : r)
             {
                 session_list.push_back(session);
             }
-            t.commit();
+            t.Commit();
         }
         catch (const odb::exception &e)
         {
@@ -118,19 +147,22 @@ namespace InstantSocial
         std::vector<GroupChatSession> session_list;
         try
         {
-            odb::transaction t(m_db->begin());
+            auto db = m_router ? m_router->ForRead("user_session:" + user_id) : m_db;
+            TransactionScope t(db);
             typedef odb::query<GroupChatSession> Query;
             typedef odb::result<GroupChatSession> Result;
-            Result r(m_db->query<GroupChatSession>
-            (
-                Query::css::chat_session_type == ChatSessionType::GROUP &&
-                Query::csm::user_id == user_id
-            ));
+            UserSessionKey *params = nullptr;
+            auto pq = CachedQuery<GroupChatSession>("group-chat-sessions", params, [](UserSessionKey &p) {
+                return Query(Query::css::chat_session_type == ChatSessionType::GROUP &&
+                             Query::csm::user_id == Query::_ref(p.user_id));
+            });
+            params->user_id = user_id;
+            Result r(pq.execute(true));
             for (const auto &session : r)
             {
                 session_list.push_back(session);
             }
-            t.commit();
+            t.Commit();
         }
         catch (const odb::exception &e)
         {
@@ -1,15 +1,35 @@
 #include "chat_session_member_handler.h"
+#include "membership_cache.h"
+#include "prepared_query_cache.h"
+#include "transaction_scope.h"
 #include "logger.h"
+#include <map>
 
 namespace InstantSocial
 {
+    namespace
+    {
+        // 预编译查询的绑定参数
+        struct MemberListKey
+        {
+            std::string session_id;
+        };
+    }
+
     bool ChatSessionMemberHandler::Apeend(ChatSessionMemberEntity &entity)
     {
         try
         {
-            odb::transaction t(m_db->begin());
-            m_db->persist(entity);
-            t.commit();
+            TransactionScope t(m_db);
+            t.db().persist(entity);
+            t.MarkWritten(m_router, {"member:" + entity.session_id(), "user_session:" + entity.user_id()});
+            if (m_cache)
+            {
+                t.AfterCommit([this, session_id = entity.session_id(), user_id = entity.user_id()]() {
+                    UpdateCache(session_id, {user_id}, true);
+                });
+            }
+            t.Commit();
             LOG_INFO("ChatSessionMemberHandler::Apeend success: session_id={}, user_id={}", entity.session_id(), entity.user_id());
         }
         catch (const std::exception &e)
@@ -24,12 +44,36 @@ namespace InstantSocial
     {
         try
         {
-            odb::transaction t(m_db->begin());
+            TransactionScope t(m_db);
             for (auto &entity : entity_list)
             {
-                m_db->persist(entity);
+                t.db().persist(entity);
+            }
+            if (m_router)
+            {
+                std::vector<std::string> keys;
+                for (auto &entity : entity_list)
+                {
+                    keys.push_back("member:" + entity.session_id());
+                    keys.push_back("user_session:" + entity.user_id());
+                }
+                t.MarkWritten(m_router, keys);
+            }
+            if (m_cache)
+            {
+                std::map<std::string, std::vector<std::string>> by_session;
+                for (auto &entity : entity_list)
+                {
+                    by_session[entity.session_id()].push_back(entity.user_id());
+                }
+                t.AfterCommit([this, by_session]() {
+                    for (auto &item : by_session)
+                    {
+                        UpdateCache(item.first, item.second, true);
+                    }
+                });
             }
-            t.commit();
+            t.Commit();
             LOG_INFO("ChatSessionMemberHandler::Apeend batch success: count={}", entity_list.size());
         }
         catch (const std::exception &e)
@@ -44,13 +88,20 @@ namespace InstantSocial
     {
         try
         {
-            odb::transaction t(m_db->begin());
+            TransactionScope t(m_db);
             typedef odb::query<ChatSessionMemberEntity> Query;
-            m_db->erase_query<ChatSessionMemberEntity>(
+            t.db().erase_query<ChatSessionMemberEntity>(
                 Query::session_id == entity.session_id() && 
                 Query::user_id == entity.user_id()
             );
-            t.commit();
+            t.MarkWritten(m_router, {"member:" + entity.session_id(), "user_session:" + entity.user_id()});
+            if (m_cache)
+            {
+                t.AfterCommit([this, session_id = entity.session_id(), user_id = entity.user_id()]() {
+                    UpdateCache(session_id, {user_id}, false);
+                });
+            }
+            t.Commit();
             LOG_INFO("ChatSessionMemberHandler::RemoveBySessionIdAndUserId success: session_id={}, user_id={}", entity.session_id(), entity.user_id());
         }
         catch (const std::exception &e)
@@ -65,10 +116,15 @@ namespace InstantSocial
     {
         try
         {
-            odb::transaction t(m_db->begin());
+            TransactionScope t(m_db);
             typedef odb::query<ChatSessionMemberEntity> Query;
-            m_db->erase_query<ChatSessionMemberEntity>(Query::session_id == session_id);
-            t.commit();
+            t.db().erase_query<ChatSessionMemberEntity>(Query::session_id == session_id);
+            t.MarkWritten(m_router, "member:" + session_id);
+            if (m_cache)
+            {
+                t.AfterCommit([this, session_id]() { ClearCache(session_id); });
+            }
+            t.Commit();
             LOG_INFO("ChatSessionMemberHandler::RemoveAllBySessionId success: session_id={}", session_id);
         }
         catch (const std::exception &e)
@@ -81,19 +137,70 @@ namespace InstantSocial
     }
 
     std::vector<std::string> ChatSessionMemberHandler::GetMemberListBySessionId(const std::string &session_id)
+    {
+        bool ok = false;
+        // 工作单元内直接读库, 才能看到本单元尚未提交的成员变更; 也避免用未提交的数据回填缓存
+        if (!m_cache || odb::transaction::has_current())
+        {
+            return QueryMemberList(ReadDb(session_id), session_id, ok);
+        }
+
+        std::string token;
+        try
+        {
+            MembershipCache::MemberList members;
+            long long version = 0;
+            if (m_cache->Get(session_id, members, version))
+            {
+                LOG_DEBUG("ChatSessionMemberHandler::GetMemberListBySessionId cache hit: session_id={}, version={}, count={}", session_id, version, members->size());
+                return *members;
+            }
+            token = m_cache->BeginFill(session_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("ChatSessionMemberHandler::GetMemberListBySessionId read cache failed: session_id={}, error={}", session_id, e.what());
+            return QueryMemberList(ReadDb(session_id), session_id, ok);
+        }
+
+        // 回填读主库, 从库的复制延迟可能让缓存缺少令牌生效之前的成员变更
+        std::vector<std::string> member_list = QueryMemberList(m_db, session_id, ok);
+        if (!ok)
+        {
+            return member_list;
+        }
+        try
+        {
+            m_cache->Fill(session_id, token, member_list);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("ChatSessionMemberHandler::GetMemberListBySessionId fill cache failed: session_id={}, error={}", session_id, e.what());
+        }
+        return member_list;
+    }
+
+    std::vector<std::string> ChatSessionMemberHandler::QueryMemberList(const std::shared_ptr<odb::database> &db, const std::string &session_id, bool &ok)
     {
         std::vector<std::string> member_list;
+        ok = false;
         try
         {
-            odb::transaction t(m_db->begin());
-            typedef odb::query<ChatSessionMemberEntity> Query;
-            typedef odb::result<ChatSessionMemberEntity> Result;
-            Result r(m_db->query<ChatSessionMemberEntity>(Query::session_id == session_id));
-            for (const auto &entity : r)
+            TransactionScope t(db);
+            typedef odb::query<SessionMember> Query;
+            typedef odb::result<SessionMember> Result;
+            MemberListKey *params = nullptr;
+            auto pq = CachedQuery<SessionMember>("member-list", params, [](MemberListKey &p) {
+                return Query(Query::csm::session_id == Query::_ref(p.session_id));
+            });
+            params->session_id = session_id;
+            Result r(pq.execute(true));
+            for (auto &row : r)
             {
-                member_list.push_back(entity.user_id());
+                member_list.push_back(std::move(row.m_user_id));
             }
-            t.commit();
+            t.Commit();
+            ok = true;
             LOG_INFO("ChatSessionMemberHandler::GetMemberListBySessionId success: session_id={}, count={}", session_id, member_list.size());
         }
         catch (const std::exception &e)
@@ -102,4 +209,50 @@ namespace InstantSocial
         }
         return member_list;
     }
+
+    std::shared_ptr<odb::database> ChatSessionMemberHandler::ReadDb(const std::string &session_id)
+    {
+        return m_router ? m_router->ForRead("member:" + session_id) : m_db;
+    }
+
+    void ChatSessionMemberHandler::UpdateCache(const std::string &session_id, const std::vector<std::string> &user_ids, bool add)
+    {
+        if (!m_cache) return;
+        try
+        {
+            if (add) m_cache->Add(session_id, user_ids);
+            else m_cache->Remove(session_id, user_ids);
+        }
+        catch (const std::exception &e)
+        {
+            // 增量更新失败时删除缓存, 下次读取从数据库重新加载
+            LOG_WARN("ChatSessionMemberHandler update cache failed: session_id={}, error={}", session_id, e.what());
+            InvalidateCache(session_id);
+        }
+    }
+
+    void ChatSessionMemberHandler::ClearCache(const std::string &session_id)
+    {
+        try
+        {
+            m_cache->Clear(session_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("ChatSessionMemberHandler::RemoveAllBySessionId clear cache failed: session_id={}, error={}", session_id, e.what());
+            InvalidateCache(session_id);
+        }
+    }
+
+    void ChatSessionMemberHandler::InvalidateCache(const std::string &session_id)
+    {
+        try
+        {
+            m_cache->Invalidate(session_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("ChatSessionMemberHandler invalidate cache failed: session_id={}, error={}", session_id, e.what());
+        }
+    }
 }
\ No newline at end of file
@@ -1,13 +1,28 @@
 #include "friend_apply_handler.h"
+#include "prepared_query_cache.h"
+#include "transaction_scope.h"
 #include "logger.h"
 
 namespace InstantSocial {
+    namespace {
+        // 预编译查询的绑定参数
+        struct ApplyKey {
+            std::string user_id;
+            std::string peer_id;
+        };
+
+        struct ApplyUserKey {
+            std::string user_id;
+        };
+    }
+
     bool FriendApplyHandler::Insert(FriendApplyEntity &event)
     {
         try {
-            odb::transaction t(m_db->begin());
-            m_db->persist(event);
-            t.commit();
+            TransactionScope t(m_db);
+            t.db().persist(event);
+            t.MarkWritten(m_router, "apply:" + event.user_id());
+            t.Commit();
             LOG_INFO("Insert FriendApply {} - {} success",  event.user_id(), event.peer_id());
         } catch (const std::exception &e) {
             LOG_ERROR("Insert FriendApply {} - {} failed: {}",  event.user_id(), event.peer_id(), e.what());
@@ -19,10 +34,11 @@ namespace InstantSocial {
     bool FriendApplyHandler::Remove(const std::string &user_id, const std::string &peer_id)
     {
         try {
-            odb::transaction t(m_db->begin());
+            TransactionScope t(m_db);
             typedef odb::query<FriendApplyEntity> Query;
-            m_db->erase_query<FriendApplyEntity>(Query::user_id == user_id && Query::peer_id == peer_id);
-            t.commit();
+            t.db().erase_query<FriendApplyEntity>(Query::user_id == user_id && Query::peer_id == peer_id);
+            t.MarkWritten(m_router, "apply:" + user_id);
+            t.Commit();
             LOG_INFO("Remove FriendApply {} - {} success",  user_id, peer_id);
         } catch (const std::exception &e) {
             LOG_ERROR("Remove FriendApply {} - {} failed: {}",  user_id, peer_id, e.what());
@@ -35,12 +51,19 @@ namespace InstantSocial {
     {
         bool exists = false;
         try {
-            odb::transaction t(m_db->begin());
+            auto db = m_router ? m_router->ForRead("apply:" + user_id) : m_db;
+            TransactionScope t(db);
             typedef odb::query<FriendApplyEntity> Query;
             typedef odb::result<FriendApplyEntity> Result;
-            Result r(m_db->query<FriendApplyEntity>(Query::user_id == user_id && Query::peer_id == peer_id));
+            ApplyKey *params = nullptr;
+            auto pq = CachedQuery<FriendApplyEntity>("friend-apply-exists", params, [](ApplyKey &p) {
+                return Query(Query::user_id == Query::_ref(p.user_id) && Query::peer_id == Query::_ref(p.peer_id));
+            });
+            params->user_id = user_id;
+            params->peer_id = peer_id;
+            Result r(pq.execute(true));
             exists = !r.empty();
-            t.commit();
+            t.Commit();
             LOG_INFO("Exists FriendApply {} - {} : {}",  user_id, peer_id, exists);
         } catch (const std::exception &e) {
             LOG_ERROR("Exists FriendApply {} - {} failed: {}",  user_id, peer_id, e.what());
@@ -53,15 +76,21 @@ namespace InstantSocial {
     {
         std::vector<std::string> apply_users;
         try {
-            odb::transaction t(m_db->begin());
-            typedef odb::query<FriendApplyEntity> Query;
-            typedef odb::result<FriendApplyEntity> Result;
+            auto db = m_router ? m_router->ForRead("apply:" + user_id) : m_db;
+            TransactionScope t(db);
+            typedef odb::query<ApplyPeer> Query;
+            typedef odb::result<ApplyPeer> Result;
             // 查询 user_id 发起的申请，返回被申请的用户列表
-            Result r(m_db->query<FriendApplyEntity>(Query::user_id == user_id));
-            for (const auto &entity : r) {
-                apply_users.push_back(entity.peer_id());
+            ApplyUserKey *params = nullptr;
+            auto pq = CachedQuery<ApplyPeer>("friend-apply-users", params, [](ApplyUserKey &p) {
+                return Query(Query::fa::user_id == Query::_ref(p.user_id));
+            });
+            params->user_id = user_id;
+            Result r(pq.execute(true));
+            for (auto &row : r) {
+                apply_users.push_back(std::move(row.m_peer_id));
             }
-            t.commit();
+            t.Commit();
             LOG_INFO("GetApplyUsers for {} success, count: {}",  user_id, apply_users.size());
         } catch (const std::exception &e) {
             LOG_ERROR("GetApplyUsers for {} failed: {}",  user_id, e.what());
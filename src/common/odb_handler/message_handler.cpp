@@ -1,36 +1,167 @@
 #include "message_handler.h"
+#include "recent_message_cache.h"
+#include "prepared_query_cache.h"
 #include "logger.h"
 #include <algorithm>
-#include <sstream>
+#include <stdexcept>
 
 namespace InstantSocial 
 {
+    namespace
+    {
+        // 预编译查询的绑定参数
+        struct RecentKey
+        {
+            std::string session_id;
+            int32_t count = 0;
+        };
+
+        struct TimeRangeKey
+        {
+            std::string session_id;
+            boost::posix_time::ptime start_time;
+            boost::posix_time::ptime end_time;
+        };
+
+        struct PageKey
+        {
+            std::string session_id;
+            boost::posix_time::ptime create_time;
+            uint64_t id = 0;
+            int32_t limit = 0;
+        };
+
+        const boost::posix_time::ptime kEpoch(boost::gregorian::date(1970, 1, 1));
+
+        // 游标: 16 位十六进制的微秒时间戳 + 16 位十六进制的主键 id
+        bool DecodeCursor(const std::string &cursor, boost::posix_time::ptime &create_time, uint64_t &id)
+        {
+            uint64_t micros = 0;
+            if (cursor.size() != 32 ||
+                !IdGenerator::FromString(cursor.substr(0, 16), micros) ||
+                !IdGenerator::FromString(cursor.substr(16), id))
+            {
+                return false;
+            }
+            create_time = kEpoch + boost::posix_time::microseconds(static_cast<int64_t>(micros));
+            return true;
+        }
+    }
+
+    const IdGenerator::Ptr &MessageHandler::CheckIds(const IdGenerator::Ptr &ids)
+    {
+        if (!ids) throw std::invalid_argument("MessageHandler requires an IdGenerator");
+        return ids;
+    }
+
+    void MessageHandler::EnableGroupCommit(const MessageBatchWriterOptions &options)
+    {
+        m_writer = std::make_shared<MessageBatchWriter>([this](const MessageEntity &message) {
+            return WriteDbs(message.session_id()).front();
+        }, options);
+    }
+
     bool MessageHandler::Insert(MessageEntity &message) 
     {
-        try 
+        if (message.id() == 0)
         {
-            odb::transaction t(m_db->begin());
-            m_db->persist(message);
-            t.commit();
-            LOG_INFO("Inserted message {} successfully", message.message_id());
-        } 
-        catch (const std::exception &e) 
+            uint64_t id = m_ids->Next();
+            if (id == 0)
+            {
+                LOG_ERROR("Assign id to message {} failed", message.message_id());
+                return false;
+            }
+            message.id(id);
+        }
+        // message_id 不建唯一索引, 总由主键生成, 不接受调用方指定的值
+        message.message_id(IdGenerator::ToString(message.id()));
+        auto targets = WriteDbs(message.session_id());
+        if (m_writer)
         {
-            LOG_ERROR("Insert message {} failed: {}", message.message_id(), e.what());
-            return false;
+            // 失败原因已由 MessageBatchWriter 记录
+            if (!m_writer->Submit(message).get()) return false;
+        }
+        else
+        {
+            try 
+            {
+                odb::transaction t(targets[0]->begin());
+                targets[0]->persist(message);
+                t.commit();
+            } 
+            catch (const std::exception &e) 
+            {
+                LOG_ERROR("Insert message {} failed: {}", message.message_id(), e.what());
+                return false;
+            }
+        }
+        if (m_router) m_router->MarkWritten("message:" + message.session_id());
+        LOG_INFO("Inserted message {} successfully", message.message_id());
+        // 迁移中的桶双写到目标分片. 以 owner 的结果为准, 目标分片写失败由迁移工具的补数据阶段补齐
+        for (size_t i = 1; i < targets.size(); ++i)
+        {
+            try
+            {
+                MessageEntity copy(message);
+                odb::transaction t(targets[i]->begin());
+                targets[i]->persist(copy);
+                t.commit();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Dual write message {} to migrating shard failed: {}", message.message_id(), e.what());
+            }
+        }
+
+        if (m_recent_cache)
+        {
+            try
+            {
+                m_recent_cache->Push(message);
+            }
+            catch (const std::exception &e)
+            {
+                // 缓存写失败时删除该会话的缓存, 避免之后读到缺少这条消息的列表
+                LOG_WARN("Push message {} to recent cache failed: {}", message.message_id(), e.what());
+                try
+                {
+                    m_recent_cache->Invalidate(message.session_id());
+                }
+                catch (const std::exception &ex)
+                {
+                    LOG_ERROR("Invalidate recent cache of session {} failed: {}", message.session_id(), ex.what());
+                }
+            }
         }
         return true;
     }
 
     bool MessageHandler::Remove(const std::string &session_id) 
     {
+        auto targets = WriteDbs(session_id);
+        for (size_t i = 1; i < targets.size(); ++i)
+        {
+            try
+            {
+                odb::transaction t(targets[i]->begin());
+                typedef odb::query<MessageEntity> Query;
+                targets[i]->erase_query<MessageEntity>(Query::session_id == session_id);
+                t.commit();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Remove session {} from migrating shard failed: {}", session_id, e.what());
+            }
+        }
         try 
         {
-            odb::transaction t(m_db->begin());
+            odb::transaction t(targets[0]->begin());
             typedef odb::query<MessageEntity> Query;
-            m_db->erase_query<MessageEntity>(Query::session_id == session_id);
+            targets[0]->erase_query<MessageEntity>(Query::session_id == session_id);
             t.commit();
+            if (m_router) m_router->MarkWritten("message:" + session_id);
             LOG_INFO("Removed session {} successfully", session_id);
+            if (m_recent_cache) m_recent_cache->Invalidate(session_id);
         } 
         catch (const std::exception &e) 
         {
@@ -41,20 +172,89 @@ namespace InstantSocial
     }
 
     std::vector<MessageEntity> MessageHandler::GetRecent(const std::string &session_id, int32_t count) 
+    {
+        if (m_recent_cache && count > 0 && static_cast<size_t>(count) <= m_recent_cache->Capacity())
+        {
+            return GetRecentCached(session_id, count);
+        }
+        return QueryRecent(ReadDb(session_id), session_id, count);
+    }
+
+    std::vector<MessageEntity> MessageHandler::GetRecentCached(const std::string &session_id, int32_t count)
+    {
+        std::vector<MessageEntity> res;
+        std::string token;
+        try
+        {
+            if (m_recent_cache->Get(session_id, count, res))
+            {
+                std::reverse(res.begin(), res.end());
+                LOG_DEBUG("Retrieved {} recent messages for session {} from cache", res.size(), session_id);
+                return res;
+            }
+            token = m_recent_cache->BeginFill(session_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Read recent cache of session {} failed: {}", session_id, e.what());
+            return QueryRecent(ReadDb(session_id), session_id, count);
+        }
+
+        // 未命中: 按缓存容量读库并回填, 之后同一会话的读取都走缓存
+        auto capacity = static_cast<int32_t>(m_recent_cache->Capacity());
+        // 回填读主库, 从库的复制延迟可能让缓存缺少令牌生效之前写入的消息
+        std::vector<MessageEntity> all = QueryRecent(PrimaryDb(session_id), session_id, capacity);
+        std::vector<MessageEntity> newest_first(all.rbegin(), all.rend());
+        try
+        {
+            m_recent_cache->Fill(session_id, token, newest_first, static_cast<int32_t>(all.size()) < capacity);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Fill recent cache of session {} failed: {}", session_id, e.what());
+        }
+        if (all.size() > static_cast<size_t>(count))
+        {
+            all.erase(all.begin(), all.end() - count);
+        }
+        return all;
+    }
+
+    std::shared_ptr<odb::core::database> MessageHandler::ReadDb(const std::string &session_id)
+    {
+        if (m_shards) return m_shards->ForSession(session_id);
+        return m_router ? m_router->ForRead("message:" + session_id) : m_db;
+    }
+
+    std::shared_ptr<odb::core::database> MessageHandler::PrimaryDb(const std::string &session_id)
+    {
+        return m_shards ? m_shards->ForSession(session_id) : m_db;
+    }
+
+    std::vector<std::shared_ptr<odb::core::database>> MessageHandler::WriteDbs(const std::string &session_id)
+    {
+        if (m_shards) return m_shards->WriteTargets(session_id);
+        return {m_db};
+    }
+
+    std::vector<MessageEntity> MessageHandler::QueryRecent(const std::shared_ptr<odb::core::database> &db, const std::string &session_id, int32_t count)
     {
         std::vector<MessageEntity> res;
         try 
         {
-            odb::transaction t(m_db->begin());
+            odb::transaction t(db->begin());
             typedef odb::query<MessageEntity> Query;
             typedef odb::result<MessageEntity> Result;
 
-            // 构造查询条件：session_id='xx' ORDER BY create_time DESC LIMIT count
-            std::stringstream cond;
-            cond << "session_id='" << session_id << "' ";
-            cond << "ORDER BY create_time DESC LIMIT " << count;
-
-            Result r(m_db->query<MessageEntity>(Query(cond.str())));
+            // session_id = ? ORDER BY create_time DESC, id DESC LIMIT ?
+            RecentKey *params = nullptr;
+            auto pq = CachedQuery<MessageEntity>("message-recent", params, [](RecentKey &p) {
+                return Query((Query::session_id == Query::_ref(p.session_id)) +
+                             "ORDER BY create_time DESC, id DESC LIMIT" + Query::_ref(p.count));
+            });
+            params->session_id = session_id;
+            params->count = count;
+            Result r(pq.execute(true));
             for (Result::iterator it(r.begin()); it != r.end(); ++it) 
             {
                 res.push_back(*it);
@@ -80,15 +280,21 @@ namespace InstantSocial
         std::vector<MessageEntity> res;
         try 
         {
-            odb::transaction t(m_db->begin());
+            auto db = ReadDb(session_id);
+            odb::transaction t(db->begin());
             typedef odb::query<MessageEntity> Query;
             typedef odb::result<MessageEntity> Result;
-            Result r = m_db->query<MessageEntity>(
-                Query::session_id == session_id &&
-                Query::create_time >= start_time && 
-                Query::create_time <= end_time,
-                "ORDER BY create_time ASC"
-            );
+            TimeRangeKey *params = nullptr;
+            auto pq = CachedQuery<MessageEntity>("message-time-range", params, [](TimeRangeKey &p) {
+                return Query((Query::session_id == Query::_ref(p.session_id) &&
+                              Query::create_time >= Query::_ref(p.start_time) &&
+                              Query::create_time <= Query::_ref(p.end_time)) +
+                             "ORDER BY create_time ASC, id ASC");
+            });
+            params->session_id = session_id;
+            params->start_time = start_time;
+            params->end_time = end_time;
+            Result r(pq.execute(true));
             for (auto it = r.begin(); it != r.end(); ++it) 
             {
                 res.push_back(*it);
@@ -103,4 +309,89 @@ namespace InstantSocial
         return res;
     }
 
+    std::string MessageHandler::CursorOf(const MessageEntity &message)
+    {
+        uint64_t micros = static_cast<uint64_t>((message.create_time() - kEpoch).total_microseconds());
+        return IdGenerator::ToString(micros) + IdGenerator::ToString(message.id());
+    }
+
+    std::vector<MessageEntity> MessageHandler::GetBefore(const std::string &session_id, const std::string &cursor, int32_t limit)
+    {
+        if (cursor.empty()) return GetRecent(session_id, limit);
+        return QueryPage(session_id, cursor, limit, true);
+    }
+
+    std::vector<MessageEntity> MessageHandler::GetAfter(const std::string &session_id, const std::string &cursor, int32_t limit)
+    {
+        return QueryPage(session_id, cursor, limit, false);
+    }
+
+    std::vector<MessageEntity> MessageHandler::QueryPage(const std::string &session_id, const std::string &cursor, int32_t limit, bool before)
+    {
+        std::vector<MessageEntity> res;
+        if (limit <= 0) return res;
+        boost::posix_time::ptime create_time;
+        uint64_t id = 0;
+        if (!cursor.empty() && !DecodeCursor(cursor, create_time, id))
+        {
+            LOG_WARN("Invalid message cursor {} for session {}", cursor, session_id);
+            return res;
+        }
+        try
+        {
+            auto db = ReadDb(session_id);
+            odb::transaction t(db->begin());
+            typedef odb::query<MessageEntity> Query;
+            typedef odb::result<MessageEntity> Result;
+
+            PageKey *params = nullptr;
+            odb::prepared_query<MessageEntity> pq;
+            if (cursor.empty())
+            {
+                // 只有 GetAfter 会走到这里, 从会话最早的消息开始
+                pq = CachedQuery<MessageEntity>("message-page-first", params, [](PageKey &p) {
+                    return Query((Query::session_id == Query::_ref(p.session_id)) +
+                                 "ORDER BY create_time ASC, id ASC LIMIT" + Query::_ref(p.limit));
+                });
+            }
+            else if (before)
+            {
+                // (create_time, id) < (?, ?) 展开成 OR, MySQL 对其生成索引范围扫描
+                pq = CachedQuery<MessageEntity>("message-page-before", params, [](PageKey &p) {
+                    return Query((Query::session_id == Query::_ref(p.session_id) &&
+                                  (Query::create_time < Query::_ref(p.create_time) ||
+                                   (Query::create_time == Query::_ref(p.create_time) && Query::id < Query::_ref(p.id)))) +
+                                 "ORDER BY create_time DESC, id DESC LIMIT" + Query::_ref(p.limit));
+                });
+            }
+            else
+            {
+                pq = CachedQuery<MessageEntity>("message-page-after", params, [](PageKey &p) {
+                    return Query((Query::session_id == Query::_ref(p.session_id) &&
+                                  (Query::create_time > Query::_ref(p.create_time) ||
+                                   (Query::create_time == Query::_ref(p.create_time) && Query::id > Query::_ref(p.id)))) +
+                                 "ORDER BY create_time ASC, id ASC LIMIT" + Query::_ref(p.limit));
+                });
+            }
+            params->session_id = session_id;
+            params->create_time = create_time;
+            params->id = id;
+            params->limit = limit;
+
+            Result r(pq.execute(true));
+            for (auto it = r.begin(); it != r.end(); ++it)
+            {
+                res.push_back(*it);
+            }
+            t.commit();
+            // 向前翻页按倒序取出, 逆序后最早的消息在前
+            if (before) std::reverse(res.begin(), res.end());
+            LOG_INFO("Retrieved {} messages {} cursor for session {}", res.size(), before ? "before" : "after", session_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Get messages {} cursor for session {} failed: {}", before ? "before" : "after", session_id, e.what());
+        }
+        return res;
+    }
 }
@@ -1,18 +1,42 @@
 #include "relation_handler.h"
+#include "friend_cache.h"
+#include "prepared_query_cache.h"
+#include "transaction_scope.h"
 #include "logger.h"
+#include <algorithm>
 
 namespace InstantSocial 
 {
+    namespace
+    {
+        // 预编译查询的绑定参数
+        struct RelationKey
+        {
+            std::string user_id;
+            std::string peer_id;
+        };
+
+        struct PeersKey
+        {
+            std::string user_id;
+        };
+    }
+
     bool RelationHandler::Insert(const std::string &user_id, const std::string &peer_id) 
     {
         try 
         {
             RelationEntity r1(user_id, peer_id);
             RelationEntity r2(peer_id, user_id);
-            odb::transaction t(m_db->begin());
-            m_db->persist(r1);
-            m_db->persist(r2);
-            t.commit();
+            TransactionScope t(m_db);
+            t.db().persist(r1);
+            t.db().persist(r2);
+            t.MarkWritten(m_router, {"relation:" + user_id, "relation:" + peer_id});
+            if (m_friend_cache)
+            {
+                t.AfterCommit([this, user_id, peer_id]() { AddToCache(user_id, peer_id); });
+            }
+            t.Commit();
             LOG_INFO("Inserted relation ({} -> {}) successfully", user_id, peer_id);
         } 
         catch (const std::exception &e) 
@@ -27,11 +51,16 @@ namespace InstantSocial
     {
         try 
         {
-            odb::transaction t(m_db->begin());
+            TransactionScope t(m_db);
             typedef odb::query<RelationEntity> Query;
-            m_db->erase_query<RelationEntity>(Query::user_id == user_id && Query::peer_id == peer_id);
-            m_db->erase_query<RelationEntity>(Query::user_id == peer_id && Query::peer_id == user_id);
-            t.commit();
+            t.db().erase_query<RelationEntity>(Query::user_id == user_id && Query::peer_id == peer_id);
+            t.db().erase_query<RelationEntity>(Query::user_id == peer_id && Query::peer_id == user_id);
+            t.MarkWritten(m_router, {"relation:" + user_id, "relation:" + peer_id});
+            if (m_friend_cache)
+            {
+                t.AfterCommit([this, user_id, peer_id]() { RemoveFromCache(user_id, peer_id); });
+            }
+            t.Commit();
             LOG_INFO("Removed relation ({} -> {}) successfully", user_id, peer_id);
         } 
         catch (const std::exception &e) 
@@ -43,17 +72,158 @@ namespace InstantSocial
     }
 
     bool RelationHandler::Exists(const std::string &user_id, const std::string &peer_id) 
+    {
+        // 工作单元内直接读库, 才能看到本单元尚未提交的写入; 也避免用未提交的数据回填缓存
+        if (!m_friend_cache || odb::transaction::has_current())
+        {
+            return QueryExists(user_id, peer_id);
+        }
+
+        try
+        {
+            bool found = false;
+            if (m_friend_cache->Contains(user_id, peer_id, found))
+            {
+                LOG_DEBUG("Checked existence of relation ({} -> {}) from cache: {}", user_id, peer_id, found);
+                return found;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Read friend cache of user {} failed: {}", user_id, e.what());
+            return QueryExists(user_id, peer_id);
+        }
+
+        // 未命中: 整体加载该用户的好友集合, 之后的判断都走缓存
+        std::vector<std::string> peers;
+        if (!LoadPeers(user_id, peers))
+        {
+            return false;
+        }
+        return std::find(peers.begin(), peers.end(), peer_id) != peers.end();
+    }
+
+    std::vector<std::string> RelationHandler::GetPeers(const std::string &user_id) 
+    {
+        std::vector<std::string> peers;
+        if (!m_friend_cache || odb::transaction::has_current())
+        {
+            QueryPeers(ReadDb(user_id), user_id, peers);
+            return peers;
+        }
+
+        try
+        {
+            if (m_friend_cache->Members(user_id, peers))
+            {
+                LOG_DEBUG("Retrieved {} peers for user {} from cache", peers.size(), user_id);
+                return peers;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Read friend cache of user {} failed: {}", user_id, e.what());
+            peers.clear();
+            QueryPeers(ReadDb(user_id), user_id, peers);
+            return peers;
+        }
+        LoadPeers(user_id, peers);
+        return peers;
+    }
+
+    bool RelationHandler::LoadPeers(const std::string &user_id, std::vector<std::string> &peers)
+    {
+        std::string token;
+        try
+        {
+            token = m_friend_cache->BeginFill(user_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Begin fill friend cache of user {} failed: {}", user_id, e.what());
+        }
+
+        // 回填读主库, 从库的复制延迟可能让缓存缺少令牌生效之前的写入
+        if (!QueryPeers(m_db, user_id, peers))
+        {
+            return false;
+        }
+        try
+        {
+            // 读库期间若有增删, 令牌已被删除, 回填会被放弃
+            m_friend_cache->Fill(user_id, token, peers);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Fill friend cache of user {} failed: {}", user_id, e.what());
+        }
+        return true;
+    }
+
+    std::shared_ptr<odb::core::database> RelationHandler::ReadDb(const std::string &user_id)
+    {
+        return m_router ? m_router->ForRead("relation:" + user_id) : m_db;
+    }
+
+    void RelationHandler::AddToCache(const std::string &user_id, const std::string &peer_id)
+    {
+        try
+        {
+            m_friend_cache->Add(user_id, peer_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Add relation ({} -> {}) to friend cache failed: {}", user_id, peer_id, e.what());
+            InvalidateCache(user_id, peer_id);
+        }
+    }
+
+    void RelationHandler::RemoveFromCache(const std::string &user_id, const std::string &peer_id)
+    {
+        try
+        {
+            m_friend_cache->Remove(user_id, peer_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Remove relation ({} -> {}) from friend cache failed: {}", user_id, peer_id, e.what());
+            InvalidateCache(user_id, peer_id);
+        }
+    }
+
+    void RelationHandler::InvalidateCache(const std::string &user_id, const std::string &peer_id)
+    {
+        // 写缓存失败时删除双方的集合, 下次读取从数据库重新加载
+        try
+        {
+            m_friend_cache->Invalidate(user_id);
+            m_friend_cache->Invalidate(peer_id);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Invalidate friend cache of ({} -> {}) failed: {}", user_id, peer_id, e.what());
+        }
+    }
+
+    bool RelationHandler::QueryExists(const std::string &user_id, const std::string &peer_id)
     {
         typedef odb::query<RelationEntity> Query;
         typedef odb::result<RelationEntity> Result;
         bool found = false;
         try 
         {
-            odb::transaction t(m_db->begin());
-            Result r = m_db->query<RelationEntity>(Query::user_id == user_id && Query::peer_id == peer_id);
+            auto db = ReadDb(user_id);
+            TransactionScope t(db);
+            RelationKey *params = nullptr;
+            auto pq = CachedQuery<RelationEntity>("relation-exists", params, [](RelationKey &p) {
+                return Query(Query::user_id == Query::_ref(p.user_id) && Query::peer_id == Query::_ref(p.peer_id));
+            });
+            params->user_id = user_id;
+            params->peer_id = peer_id;
+            Result r(pq.execute(true));
             // 在事务提交前检查结果
             found = !r.empty();
-            t.commit();
+            t.Commit();
             LOG_INFO("Checked existence of relation ({} -> {}): {}", user_id, peer_id, found);
         } 
         catch (const std::exception &e) 
@@ -63,26 +233,32 @@ namespace InstantSocial
         return found;
     }
 
-    std::vector<std::string> RelationHandler::GetPeers(const std::string &user_id) 
+    bool RelationHandler::QueryPeers(const std::shared_ptr<odb::core::database> &db, const std::string &user_id, std::vector<std::string> &peers)
     {
-        std::vector<std::string> peers;
         try 
         {
-            odb::transaction t(m_db->begin());
-            typedef odb::query<RelationEntity> Query;
-            typedef odb::result<RelationEntity> Result;
-            Result r = m_db->query<RelationEntity>(Query::user_id == user_id);
+            TransactionScope t(db);
+            typedef odb::query<RelationPeer> Query;
+            typedef odb::result<RelationPeer> Result;
+            PeersKey *params = nullptr;
+            auto pq = CachedQuery<RelationPeer>("relation-peers", params, [](PeersKey &p) {
+                return Query(Query::r::user_id == Query::_ref(p.user_id));
+            });
+            params->user_id = user_id;
+            Result r(pq.execute(true));
             for (auto it = r.begin(); it != r.end(); ++it) 
             {
-                peers.push_back(it->peer_id());
+                peers.push_back(std::move(it->m_peer_id));
             }
-            t.commit();
+            t.Commit();
             LOG_INFO("Retrieved {} peers for user {}", peers.size(), user_id);
         } 
         catch (const std::exception &e) 
         {
             LOG_ERROR("Get peers for user {} failed: {}", user_id, e.what());
+            peers.clear();
+            return false;
         }
-        return peers;
+        return true;
     }
-}
\ No newline at end of file
+}
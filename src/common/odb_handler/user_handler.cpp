@@ -1,15 +1,161 @@
 #include "user_handler.h"
+#include "prepared_query_cache.h"
+#include "transaction_scope.h"
+#include "user_cache.h"
+#include "redis_client.h"
 #include "logger.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace InstantSocial 
 {
+    namespace
+    {
+        // 读己之写: 按各个查询条件分别记录, 之后按任一条件读取该用户都能看到这次写入
+        std::vector<std::string> WrittenKeys(const UserEntity &user)
+        {
+            std::vector<std::string> keys = {"user:" + user.user_id()};
+            if (!user.phone().empty()) keys.push_back("phone:" + user.phone());
+            if (!user.email().empty()) keys.push_back("email:" + user.email());
+            if (!user.nickname().empty()) keys.push_back("nickname:" + user.nickname());
+            return keys;
+        }
+
+        // 单列等值查询的绑定参数
+        struct UserKey
+        {
+            std::string value;
+        };
+
+        template <typename Build>
+        UserEntity *QueryUser(const char *name, const std::string &value, Build build)
+        {
+            UserKey *params = nullptr;
+            odb::prepared_query<UserEntity> pq(CachedQuery<UserEntity>(name, params, build));
+            params->value = value;
+            return pq.execute_one();
+        }
+
+        // 批量查询每块的 id 个数. 块大小固定, 不同长度的请求共用一条预编译语句和同一个执行计划
+        constexpr size_t kUserIdChunk = 50;
+
+        struct UserIdsKey
+        {
+            std::string ids[kUserIdChunk];
+        };
+
+        // 查询 ids[0, count), 不足一块时用最后一个 id 补齐
+        void QueryUserChunk(const std::shared_ptr<odb::core::database> &db, const std::string *ids, size_t count,
+                            std::vector<UserEntity> &out)
+        {
+            typedef odb::query<UserEntity> Query;
+            typedef odb::result<UserEntity> Result;
+            TransactionScope t(db);
+            UserIdsKey *params = nullptr;
+            auto pq = CachedQuery<UserEntity>("users-by-ids", params, [](UserIdsKey &p) {
+                Query cond(Query("user_id IN (") + Query::_ref(p.ids[0]));
+                for (size_t i = 1; i < kUserIdChunk; ++i)
+                {
+                    cond = cond + "," + Query::_ref(p.ids[i]);
+                }
+                return Query(cond + ")");
+            });
+            for (size_t i = 0; i < kUserIdChunk; ++i)
+            {
+                params->ids[i] = ids[std::min(i, count - 1)];
+            }
+            Result r(pq.execute(true));
+            for (auto it = r.begin(); it != r.end(); ++it)
+            {
+                out.push_back(*it);
+            }
+            t.Commit();
+        }
+
+        // 一次批量查询的各块, 由调用线程和执行器线程领取. 执行器上的任务持有共享所有权,
+        // 排队到所有块都被领完才开始时直接返回, 调用方不必等它出队
+        struct UserChunkJob
+        {
+            std::shared_ptr<odb::core::database> db;
+            std::vector<std::string> ids;
+            size_t chunks = 0;
+            std::vector<std::vector<UserEntity>> found;
+            std::atomic<size_t> next{0};
+            std::atomic<bool> failed{false};
+            std::mutex mutex;
+            std::condition_variable cond;
+            size_t finished = 0;
+
+            void Work()
+            {
+                for (size_t c = next++; c < chunks; c = next++)
+                {
+                    if (!failed)
+                    {
+                        size_t begin = c * kUserIdChunk;
+                        try
+                        {
+                            QueryUserChunk(db, ids.data() + begin, std::min(kUserIdChunk, ids.size() - begin), found[c]);
+                        }
+                        catch (const std::exception &e)
+                        {
+                            LOG_ERROR("Get users by user_id list failed at chunk {}/{}: {}", c, chunks, e.what());
+                            failed = true;
+                        }
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (++finished == chunks) cond.notify_all();
+                }
+            }
+
+            // 等待已被领取的块执行完
+            void Wait()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this]() { return finished == chunks; });
+            }
+        };
+    }
+
+    // 带缓存的单条查询: lookup 读缓存, 未命中时给出已知的 user_id; load(db) 读库.
+    // 工作单元内不读写缓存, 以便看到本单元尚未提交的写入. 不走缓存时按 read_key 路由读库
+    template <typename Lookup, typename Load>
+    std::shared_ptr<UserEntity> UserHandler::CachedGet(const std::string &read_key, Lookup lookup, Load load)
+    {
+        if (!m_cache || odb::transaction::has_current())
+        {
+            return load(m_router ? m_router->ForRead(read_key) : m_db);
+        }
+        UserCache::User cached;
+        std::string user_id;
+        if (lookup(cached, user_id))
+        {
+            // 返回副本, 调用方可以修改后交给 Update
+            return std::make_shared<UserEntity>(*cached);
+        }
+        // 回填读主库: 从库落后时, 其他节点的失效消息可能先于数据到达, 读到的旧值会在缓存中留到过期
+        bool known = !user_id.empty();
+        uint64_t epoch = known ? m_cache->Epoch(user_id) : 0;
+        auto res = load(m_db);
+        if (res)
+        {
+            if (known && res->user_id() == user_id) m_cache->Fill(*res, epoch);
+            else m_cache->FillIndexes(*res);
+        }
+        return res;
+    }
+
     bool UserHandler::Insert(const std::shared_ptr<UserEntity> &user)
     {
         try 
         {
-            odb::transaction t(m_db->begin());
-            m_db->persist(*user);
-            t.commit();
+            TransactionScope t(m_db);
+            t.db().persist(*user);
+            t.MarkWritten(m_router, WrittenKeys(*user));
+            t.Commit();
             return true;
         }
         catch (const std::exception &e) 
@@ -23,9 +169,17 @@ namespace InstantSocial
     {
         try 
         {
-            odb::transaction t(m_db->begin());
-            m_db->update(*user);
-            t.commit();
+            TransactionScope t(m_db);
+            t.db().update(*user);
+            t.MarkWritten(m_router, WrittenKeys(*user));
+            if (m_cache || m_invalidator)
+            {
+                t.AfterCommit([cache = m_cache, invalidator = m_invalidator, user_id = user->user_id()]() {
+                    if (cache) cache->Invalidate(user_id);
+                    if (invalidator) invalidator->Publish(user_id);
+                });
+            }
+            t.Commit();
             return true;
         }
         catch (const std::exception &e) 
@@ -37,53 +191,62 @@ namespace InstantSocial
 
     std::shared_ptr<UserEntity> UserHandler::GetByUserID(const std::string &user_id)
     {
-        std::shared_ptr<UserEntity> res;
-        try 
-        {
-            odb::transaction t(m_db->begin());
-            typedef odb::query<UserEntity> Query;
-            res.reset(m_db->query_one<UserEntity>(Query(odb::query<UserEntity>::user_id == user_id)));
-            t.commit();
-        }
-        catch (const std::exception &e) 
-        {
-            LOG_ERROR("Get user by user_id {} failed: {}", user_id, e.what());
-        }
-        return res;
+        auto lookup = [&](UserCache::User &cached, std::string &id) { id = user_id; return m_cache->GetById(user_id, cached); };
+        return CachedGet("user:" + user_id, lookup, [&](const std::shared_ptr<odb::core::database> &db) {
+            std::shared_ptr<UserEntity> res;
+            try 
+            {
+                TransactionScope t(db);
+                typedef odb::query<UserEntity> Query;
+                res.reset(QueryUser("user-by-id", user_id, [](UserKey &p) { return Query(Query::user_id == Query::_ref(p.value)); }));
+                t.Commit();
+            }
+            catch (const std::exception &e) 
+            {
+                LOG_ERROR("Get user by user_id {} failed: {}", user_id, e.what());
+            }
+            return res;
+        });
     }
     
     std::shared_ptr<UserEntity> UserHandler::GetByPhone(const std::string &phone)
     {
-        std::shared_ptr<UserEntity> res;
-        try 
-        {
-            odb::transaction t(m_db->begin());
-            typedef odb::query<UserEntity> Query;
-            res.reset(m_db->query_one<UserEntity>(Query(odb::query<UserEntity>::phone == phone)));
-            t.commit();
-        }
-        catch (const std::exception &e) 
-        {
-            LOG_ERROR("Get user by phone {} failed: {}", phone, e.what());
-        }
-        return res;
+        auto lookup = [&](UserCache::User &cached, std::string &id) { return m_cache->GetByPhone(phone, cached, id); };
+        return CachedGet("phone:" + phone, lookup, [&](const std::shared_ptr<odb::core::database> &db) {
+            std::shared_ptr<UserEntity> res;
+            try 
+            {
+                TransactionScope t(db);
+                typedef odb::query<UserEntity> Query;
+                res.reset(QueryUser("user-by-phone", phone, [](UserKey &p) { return Query(Query::phone == Query::_ref(p.value)); }));
+                t.Commit();
+            }
+            catch (const std::exception &e) 
+            {
+                LOG_ERROR("Get user by phone {} failed: {}", phone, e.what());
+            }
+            return res;
+        });
     }
 
     std::shared_ptr<UserEntity> UserHandler::GetByEmail(const std::string &email)
     {
-        std::shared_ptr<UserEntity> res;
-        try 
-        {
-            odb::transaction t(m_db->begin());
-            typedef odb::query<UserEntity> Query;
-            res.reset(m_db->query_one<UserEntity>(Query(odb::query<UserEntity>::email == email)));
-            t.commit();
-        }
-        catch (const std::exception &e) 
-        {
-            LOG_ERROR("Get user by email {} failed: {}", email, e.what());
-        }
-        return res;
+        auto lookup = [&](UserCache::User &cached, std::string &id) { return m_cache->GetByEmail(email, cached, id); };
+        return CachedGet("email:" + email, lookup, [&](const std::shared_ptr<odb::core::database> &db) {
+            std::shared_ptr<UserEntity> res;
+            try 
+            {
+                TransactionScope t(db);
+                typedef odb::query<UserEntity> Query;
+                res.reset(QueryUser("user-by-email", email, [](UserKey &p) { return Query(Query::email == Query::_ref(p.value)); }));
+                t.Commit();
+            }
+            catch (const std::exception &e) 
+            {
+                LOG_ERROR("Get user by email {} failed: {}", email, e.what());
+            }
+            return res;
+        });
     }
 
     std::shared_ptr<UserEntity> UserHandler::GetByNickname(const std::string &nickname)
@@ -91,10 +254,11 @@ namespace InstantSocial
         std::shared_ptr<UserEntity> res;
         try 
         {
-            odb::transaction t(m_db->begin());
+            auto db = m_router ? m_router->ForRead("nickname:" + nickname) : m_db;
+            TransactionScope t(db);
             typedef odb::query<UserEntity> Query;
-            res.reset(m_db->query_one<UserEntity>(Query(odb::query<UserEntity>::nickname == nickname)));
-            t.commit();
+            res.reset(QueryUser("user-by-nickname", nickname, [](UserKey &p) { return Query(Query::nickname == Query::_ref(p.value)); }));
+            t.Commit();
         }
         catch (const std::exception &e) 
         {
@@ -106,39 +270,59 @@ namespace InstantSocial
     std::vector<UserEntity> UserHandler::GetByMultiUsers(const std::vector<std::string> &user_id_list)
     {
         std::vector<UserEntity> res;
-        try 
+        std::vector<std::string> ids;
+        std::unordered_set<std::string> seen;
+        for (auto &user_id : user_id_list)
         {
-            odb::transaction t(m_db->begin());
-            
-            if (!user_id_list.empty()) 
+            if (seen.insert(user_id).second) ids.push_back(user_id);
+        }
+        if (ids.empty()) return res;
+
+        std::vector<std::string> keys;
+        for (auto &user_id : ids) keys.push_back("user:" + user_id);
+        auto job = std::make_shared<UserChunkJob>();
+        job->db = m_router ? m_router->ForRead(keys) : m_db;
+        job->ids = std::move(ids);
+        job->chunks = (job->ids.size() + kUserIdChunk - 1) / kUserIdChunk;
+        job->found.resize(job->chunks);
+
+        // 工作单元内所有块都在调用线程上执行, 加入其事务. 调用线程自己占一个连接, 其余块交给执行器
+        size_t helpers = 0;
+        if (m_batch_executor && !odb::transaction::has_current())
+        {
+            helpers = std::min(m_batch_parallelism, job->chunks) - 1;
+            if (auto pool = MySQLConnectionPool::Of(*job->db))
             {
-                std::string condition = "user_id IN (";
-                for (size_t i = 0; i < user_id_list.size(); ++i) 
-                {
-                    condition += "'" + user_id_list[i] + "'";
-                    if (i < user_id_list.size() - 1) 
-                    {
-                        condition += ",";
-                    }
-                }
-                condition += ")";
-                
-                typedef odb::query<UserEntity> Query;
-                odb::result<UserEntity> result = m_db->query<UserEntity>(Query(condition));
-                
-                for (odb::result<UserEntity>::iterator it = result.begin(); it != result.end(); ++it) 
-                {
-                    res.push_back(*it);
-                }
+                size_t available = pool->Available();
+                helpers = std::min(helpers, available > 0 ? available - 1 : 0);
             }
-            
-            t.commit();
-            LOG_INFO("Get {} users by user_id list", res.size());
         }
-        catch (const std::exception &e) 
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            // 队列满时不再提交, 剩下的块由调用线程执行
+            if (!m_batch_executor->Post([job](bool run) { if (run) job->Work(); },
+                                        m_batch_executor->DeadlineAfter(std::chrono::milliseconds(0))))
+            {
+                break;
+            }
+        }
+        job->Work();
+        job->Wait();
+        if (job->failed) return res;
+
+        // 按调用方给出的顺序输出
+        std::unordered_map<std::string, UserEntity *> by_id;
+        for (auto &chunk : job->found)
+        {
+            for (auto &user : chunk) by_id.emplace(user.user_id(), &user);
+        }
+        res.reserve(by_id.size());
+        for (auto &user_id : job->ids)
         {
-            LOG_ERROR("Get users by user_id list failed: {}", e.what());
+            auto it = by_id.find(user_id);
+            if (it != by_id.end()) res.push_back(std::move(*it->second));
         }
+        LOG_INFO("Get {} users by {} user_ids in {} chunks", res.size(), job->ids.size(), job->chunks);
         return res;
     }
-}
\ No newline at end of file
+}
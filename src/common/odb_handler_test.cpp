@@ -6,6 +6,7 @@
 #include "relation_handler.h"
 #include "friend_apply_handler.h"
 #include "chat_session_member_handler.h"
+#include "etcd_client.h"
 #include "user_entity.h"
 #include "message_entity.h"
 #include "chat_session_entity.h"
@@ -105,7 +106,17 @@ namespace InstantSocial
     void TestMessageHandler(std::shared_ptr<odb::database> db)
     {
         LOG_INFO("=== 测试 MessageHandler ===");
-        MessageHandler handler(db);
+        IdGenerator::Ptr ids;
+        try
+        {
+            ids = LeasedIdGenerator(std::make_shared<WorkerIdLease>("http://192.168.113.205:2379", "/id_worker/", "odb_handler_test"));
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("租用 worker id 失败: {}", e.what());
+            return;
+        }
+        MessageHandler handler(db, ids);
         
         // 1. 测试插入消息
         LOG_INFO("--- 测试插入消息 ---");
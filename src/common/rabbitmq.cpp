@@ -1,11 +1,118 @@
 #include "rabbitmq.h"
 #include "logger.h"
+#include <future>
+#include <algorithm>
 
 namespace InstantSocial
 {
+    ConsumerWorkerPool::~ConsumerWorkerPool()
+    {
+        Stop();
+    }
+
+    void ConsumerWorkerPool::Resize(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stop) return;
+        ReapExited();
+        m_target = count;
+        while (m_live < m_target)
+        {
+            auto worker = std::make_unique<Worker>();
+            Worker *raw = worker.get();
+            worker->thread = std::thread([this, raw]() { WorkerLoop(raw); });
+            m_workers.push_back(std::move(worker));
+            ++m_live;
+        }
+        // 多出的线程在空闲时自行退出, 不阻塞调用方(事件循环线程)
+        m_cond.notify_all();
+    }
+
+    void ConsumerWorkerPool::Submit(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_cond.notify_one();
+    }
+
+    void ConsumerWorkerPool::Stop()
+    {
+        std::vector<std::unique_ptr<Worker>> workers;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_tasks.clear();
+            workers.swap(m_workers);
+        }
+        m_cond.notify_all();
+        for (auto &worker : workers)
+        {
+            if (worker->thread.joinable()) worker->thread.join();
+        }
+    }
+
+    size_t ConsumerWorkerPool::Size()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_target;
+    }
+
+    size_t ConsumerWorkerPool::Pending()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_tasks.size();
+    }
+
+    int64_t ConsumerWorkerPool::TakeBusyNanos()
+    {
+        return m_busy_ns.exchange(0);
+    }
+
+    void ConsumerWorkerPool::WorkerLoop(Worker *worker)
+    {
+        while (true)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_stop || m_live > m_target || !m_tasks.empty(); });
+                if (m_stop || m_live > m_target)
+                {
+                    --m_live;
+                    worker->exited = true;
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            auto start = std::chrono::steady_clock::now();
+            task();
+            m_busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    void ConsumerWorkerPool::ReapExited()
+    {
+        for (auto it = m_workers.begin(); it != m_workers.end();)
+        {
+            if ((*it)->exited)
+            {
+                (*it)->thread.join();
+                it = m_workers.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
     RabbitMQHandler::RabbitMQHandler(const std::string &user, const std::string &password, const std::string &host, int32_t port, bool use_ssl)
     {
-        m_event_loop = ev_default_loop(0);
+        // 每个实例独占一个事件循环, 多个 handler 共存时互不干扰
+        m_event_loop = ev_loop_new(EVFLAG_AUTO);
         m_handler = std::make_unique<AMQP::LibEvHandler>(m_event_loop);
         std::string protocol = use_ssl ? "amqps://" : "amqp://";
         std::string url = protocol + user + ":" + password + "@" + host + ":" + std::to_string(port);
@@ -13,6 +120,10 @@ namespace InstantSocial
         m_connection = std::make_unique<AMQP::TcpConnection>(m_handler.get(), address);
         m_channel = std::make_unique<AMQP::TcpChannel>(m_connection.get());
 
+        ev_async_init(&m_async_watcher, AsyncCallback);
+        m_async_watcher.data = this;
+        ev_async_start(m_event_loop, &m_async_watcher);
+
         m_loop_thread = std::thread([this]() {
             ev_run(m_event_loop, 0);
         });
@@ -20,80 +131,289 @@ namespace InstantSocial
 
     void RabbitMQHandler::DeclareComponents(const std::string &exchange, const std::string &queue, const std::string &routingKey, AMQP::ExchangeType type)
     {
-        m_channel->declareExchange(exchange, type).onSuccess([exchange]() 
+        RunInLoop([this, exchange, queue, routingKey, type]()
         {
-            LOG_INFO("Exchange declared: {}", exchange);
-        }).onError([exchange](const char* message) 
+            m_channel->declareExchange(exchange, type).onSuccess([exchange]()
+            {
+                LOG_INFO("Exchange declared: {}", exchange);
+            }).onError([exchange](const char* message)
+            {
+                LOG_ERROR("Failed to declare exchange {}: {}", exchange, message);
+            });
+
+            m_channel->declareQueue(queue).onSuccess([queue]()
+            {
+                LOG_INFO("Queue declared: {}", queue);
+            }).onError([queue](const char* message)
+            {
+                LOG_ERROR("Failed to declare queue {}: {}", queue, message);
+            });
+
+            // 绑定紧跟在声明之后发出, 信道内按序执行, 保证随后的 publish 不会因绑定尚未建立而丢失
+            m_channel->bindQueue(exchange, queue, routingKey).onSuccess([exchange, queue, routingKey]()
+            {
+                LOG_INFO("{} Queue {} bound to routing key {}",  exchange, queue, routingKey);
+            }).onError([exchange, queue, routingKey](const char* message)
+            {
+                LOG_ERROR("{} Failed to bind queue {} to routing key {}: {}", exchange, queue, routingKey, message);
+            });
+        });
+    }
+
+    void RabbitMQHandler::PublishMessage(const std::string &exchange, const std::string &msg, const std::string &routingKey)
+    {
+        RunInLoop([this, exchange, msg, routingKey]()
         {
-            LOG_ERROR("Failed to declare exchange {}: {}", exchange, message);
+            bool success = m_channel->publish(exchange, routingKey, msg);
+
+            if (success)
+            {
+                LOG_DEBUG("Message published to exchange {} with routing key {}", exchange, routingKey);
+            } else
+            {
+                LOG_ERROR("Failed to publish message to exchange {} with routing key {}", exchange, routingKey);
+            }
         });
+    }
 
-        m_channel->declareQueue(queue).onSuccess([this, exchange, queue, routingKey]() 
+    void RabbitMQHandler::ConsumeMessage(const std::string &queue, const MessageCallback &cb)
+    {
+        LOG_INFO("Starting to consume messages from queue {}", queue);
+        RunInLoop([this, queue, cb]()
         {
-            LOG_INFO("Queue declared: {}", queue);
-            m_channel->bindQueue(exchange, queue, routingKey).onSuccess([exchange, queue, routingKey]() 
+            // 不指定 consumer tag, 由服务端生成, 同一信道上的多个消费者才不会因 tag 重复而被关闭信道
+            m_channel->consume(queue).onReceived([this, cb](const AMQP::Message &message, uint64_t deliveryTag, bool redelivered)
             {
-                LOG_INFO("{} Queue {} bound to routing key {}",  exchange, queue, routingKey);
-            }).onError([exchange, queue, routingKey](const char* message) 
+                cb(message.body(), message.bodySize());
+                m_channel->ack(deliveryTag);
+            }).onSuccess([queue]()
             {
-                LOG_ERROR("{} Failed to bind queue {} to routing key {}: {}", exchange, queue, routingKey, message);
+                LOG_INFO("Started consuming messages from queue {}", queue);
+            }).onError([queue](const char* message)
+            {
+                LOG_ERROR("Failed to start consuming messages from queue {}: {}", queue, message);
             });
-        }).onError([queue](const char* message) 
+        });
+    }
+
+    void RabbitMQHandler::ConsumeMessage(const std::string &queue, const MessageCallback &cb, const ConsumerScalingOptions &options)
+    {
+        // 工作线程池与 global 预取属于整个信道, 只按第一个自动扩缩容队列的深度调整, 之后的队列共用同一个线程池
+        bool first = m_scaling_queue.empty();
+        if (first)
         {
-            LOG_ERROR("Failed to declare queue {}: {}", queue, message);
+            LOG_INFO("Starting to consume messages from queue {} with {}-{} workers", queue, options.min_workers, options.max_workers);
+            m_scaling = options;
+            m_scaling.min_workers = std::max<size_t>(options.min_workers, 1);
+            m_scaling.max_workers = std::max(options.max_workers, m_scaling.min_workers);
+            m_scaling.max_prefetch = std::max(options.max_prefetch, options.min_prefetch);
+            m_scaling_queue = queue;
+
+            m_metrics = std::make_unique<ScalingMetrics>();
+            m_metrics->workers.expose_as(m_scaling.metrics_prefix, queue + "_workers");
+            m_metrics->prefetch.expose_as(m_scaling.metrics_prefix, queue + "_prefetch");
+            m_metrics->queue_depth.expose_as(m_scaling.metrics_prefix, queue + "_queue_depth");
+            m_metrics->utilization.expose_as(m_scaling.metrics_prefix, queue + "_utilization");
+            m_metrics->scale_up.expose_as(m_scaling.metrics_prefix, queue + "_scale_up_count");
+            m_metrics->scale_down.expose_as(m_scaling.metrics_prefix, queue + "_scale_down_count");
+
+            size_t workers = m_scaling.min_workers;
+            uint16_t prefetch = static_cast<uint16_t>(std::min<size_t>(
+                std::max<size_t>(workers * m_scaling.prefetch_per_worker, m_scaling.min_prefetch), m_scaling.max_prefetch));
+            m_workers.Resize(workers);
+            m_prefetch = prefetch;
+            m_metrics->workers.set_value(workers);
+            m_metrics->prefetch.set_value(prefetch);
+        }
+        else
+        {
+            LOG_WARN("Queue {} shares consumer workers autoscaled by depth of queue {}, its scaling options are ignored",
+                     queue, m_scaling_queue);
+        }
+
+        uint16_t prefetch = m_prefetch.load();
+        RunInLoop([this, queue, cb, prefetch, first]()
+        {
+            if (first) m_channel->setQos(prefetch, true);
+            m_channel->consume(queue).onReceived([this, cb](const AMQP::Message &message, uint64_t deliveryTag, bool redelivered)
+            {
+                // 消息体在回调返回后失效, 拷贝后交给工作线程, 处理完成再回到事件循环线程确认
+                std::string body(message.body(), message.bodySize());
+                m_workers.Submit([this, cb, body, deliveryTag]()
+                {
+                    cb(body.data(), body.size());
+                    RunInLoop([this, deliveryTag]() { m_channel->ack(deliveryTag); });
+                });
+            }).onSuccess([queue]()
+            {
+                LOG_INFO("Started consuming messages from queue {}", queue);
+            }).onError([queue](const char* message)
+            {
+                LOG_ERROR("Failed to start consuming messages from queue {}: {}", queue, message);
+            });
+
+            // 定时器只初始化一次, 对活动中的 watcher 重复 ev_timer_init 会破坏 libev 的定时器堆
+            if (m_scaling_enabled) return;
+            double interval = std::chrono::duration<double>(m_scaling.interval).count();
+            m_last_tick = std::chrono::steady_clock::now();
+            m_workers.TakeBusyNanos();
+            ev_timer_init(&m_scale_timer, ScaleTimerCallback, interval, interval);
+            m_scale_timer.data = this;
+            ev_timer_start(m_event_loop, &m_scale_timer);
+            m_scaling_enabled = true;
         });
     }
 
-    void RabbitMQHandler::PublishMessage(const std::string &exchange, const std::string &msg, const std::string &routingKey)
+    void RabbitMQHandler::SetPrefetch(uint16_t prefetch)
     {
-        bool success = m_channel->publish(exchange, routingKey, msg);
-        
-        if (success) 
+        RunInLoop([this, prefetch]()
         {
-            LOG_INFO("Message published to exchange {} with routing key {}", exchange, routingKey);
-        } else 
+            m_channel->setQos(prefetch).onError([prefetch](const char* message)
+            {
+                LOG_ERROR("Failed to set prefetch {}: {}", prefetch, message);
+            });
+        });
+    }
+
+    void RabbitMQHandler::Flush()
+    {
+        if (std::this_thread::get_id() == m_loop_thread.get_id())
         {
-            LOG_ERROR("Failed to publish message to exchange {} with routing key {}", exchange, routingKey);
+            return;
         }
+        std::promise<void> done;
+        std::future<void> fut = done.get_future();
+        RunInLoop([&done]() { done.set_value(); });
+        fut.wait();
     }
 
-    void RabbitMQHandler::ConsumeMessage(const std::string &queue, MessageCallback &cb)
+    void RabbitMQHandler::RunInLoop(std::function<void()> task)
     {
-        LOG_INFO("Starting to consume messages from queue {}", queue);
-        m_channel->consume(queue, "consume-tag").onReceived([this, cb](const AMQP::Message &message, uint64_t deliveryTag, bool redelivered) 
         {
-            cb(message.body(), message.bodySize());
-            m_channel->ack(deliveryTag);
-        }).onSuccess([queue]() 
+            std::lock_guard<std::mutex> lock(m_task_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        ev_async_send(m_event_loop, &m_async_watcher);
+    }
+
+    void RabbitMQHandler::AsyncCallback(struct ev_loop *loop, ev_async *w, int32_t revents)
+    {
+        auto self = static_cast<RabbitMQHandler *>(w->data);
+        std::vector<std::function<void()>> tasks;
         {
-            LOG_INFO("Started consuming messages from queue {}", queue);
-        }).onError([queue](const char* message) 
+            std::lock_guard<std::mutex> lock(self->m_task_mutex);
+            tasks.swap(self->m_tasks);
+        }
+        for (auto &task : tasks)
         {
-            LOG_ERROR("Failed to start consuming messages from queue {}: {}", queue, message);
-        });
+            task();
+        }
     }
 
-    void RabbitMQHandler::WatchdogCallback(struct ev_loop *loop, ev_async *w, int32_t revents)
+    void RabbitMQHandler::ScaleTimerCallback(struct ev_loop *loop, ev_timer *w, int32_t revents)
     {
-        ev_break(loop, EVBREAK_ALL);
+        auto self = static_cast<RabbitMQHandler *>(w->data);
+        // 被动声明队列不会创建队列, 只返回当前消息数与消费者数
+        self->m_channel->declareQueue(self->m_scaling_queue, AMQP::passive)
+            .onSuccess([self](const std::string &name, uint32_t messagecount, uint32_t consumercount)
+            {
+                self->Rescale(messagecount);
+            }).onError([self](const char* message)
+            {
+                LOG_ERROR("Failed to inspect queue {}: {}", self->m_scaling_queue, message);
+            });
+    }
+
+    void RabbitMQHandler::Rescale(uint32_t queue_depth)
+    {
+        auto now = std::chrono::steady_clock::now();
+        int64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last_tick).count();
+        m_last_tick = now;
+
+        size_t workers = m_workers.Size();
+        size_t backlog = queue_depth + m_workers.Pending();
+        double utilization = static_cast<double>(m_workers.TakeBusyNanos()) / std::max<int64_t>(elapsed_ns * workers, 1);
+        uint16_t prefetch = m_prefetch.load();
+
+        m_metrics->queue_depth.set_value(queue_depth);
+        m_metrics->utilization.set_value(utilization);
+
+        size_t new_workers = workers;
+        uint16_t new_prefetch = prefetch;
+        if (backlog > workers * m_scaling.backlog_per_worker)
+        {
+            if (utilization >= m_scaling.scale_up_utilization && workers < m_scaling.max_workers)
+            {
+                // 工作线程已饱和, 按 50% 扩容
+                new_workers = std::min(m_scaling.max_workers, workers + std::max<size_t>(workers / 2, 1));
+            }
+            else if (utilization < m_scaling.scale_up_utilization && prefetch < m_scaling.max_prefetch)
+            {
+                // 有积压但线程空闲, 说明预取过小导致供给不足
+                new_prefetch = static_cast<uint16_t>(std::min<size_t>(static_cast<size_t>(prefetch) * 2, m_scaling.max_prefetch));
+            }
+        }
+        else if (backlog < m_scaling.backlog_per_worker && utilization < m_scaling.scale_down_utilization &&
+                 workers > m_scaling.min_workers)
+        {
+            new_workers = workers - 1;
+        }
+
+        if (new_workers != workers)
+        {
+            new_prefetch = static_cast<uint16_t>(std::min<size_t>(
+                std::max<size_t>(new_workers * m_scaling.prefetch_per_worker, m_scaling.min_prefetch), m_scaling.max_prefetch));
+            m_workers.Resize(new_workers);
+            m_metrics->workers.set_value(new_workers);
+            if (new_workers > workers)
+            {
+                m_metrics->scale_up << 1;
+            }
+            else
+            {
+                m_metrics->scale_down << 1;
+            }
+        }
+        if (new_prefetch != prefetch)
+        {
+            m_prefetch = new_prefetch;
+            m_metrics->prefetch.set_value(new_prefetch);
+            // global 预取对信道上已存在的消费者立即生效
+            m_channel->setQos(new_prefetch, true);
+        }
+        if (new_workers != workers || new_prefetch != prefetch)
+        {
+            LOG_INFO("Rescale consumer of queue {}: depth={}, utilization={:.2f}, workers {} -> {}, prefetch {} -> {}",
+                     m_scaling_queue, queue_depth, utilization, workers, new_workers, prefetch, new_prefetch);
+        }
     }
 
     RabbitMQHandler::~RabbitMQHandler()
     {
-        // 1. ensure all AMQP objects destroyed before stopping loop
-        m_channel.reset();
-        m_connection.reset();
+        // 1. stop consumer workers, pending deliveries are requeued by the broker
+        m_workers.Stop();
 
-        // 2. stop the event loop
-        ev_async_init(&m_async_watcher, WatchdogCallback);
-        ev_async_start(m_event_loop, &m_async_watcher);
-        ev_async_send(m_event_loop, &m_async_watcher);
+        // 2. destroy AMQP objects and stop the event loop inside the loop thread
+        RunInLoop([this]()
+        {
+            if (m_scaling_enabled)
+            {
+                ev_timer_stop(m_event_loop, &m_scale_timer);
+            }
+            m_channel.reset();
+            m_connection.reset();
+            ev_async_stop(m_event_loop, &m_async_watcher);
+            ev_break(m_event_loop, EVBREAK_ALL);
+        });
 
         // 3. wait for thread
         if (m_loop_thread.joinable()) {
             m_loop_thread.join();
         }
 
+        // 4. handler owns watchers registered on the loop, release it before the loop
+        m_handler.reset();
+        ev_loop_destroy(m_event_loop);
         m_event_loop = nullptr;
     }
-}
\ No newline at end of file
+}
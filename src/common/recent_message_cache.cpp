@@ -0,0 +1,131 @@
+#include "recent_message_cache.h"
+#include "message_codec.h"
+#include "logger.h"
+#include <random>
+#include <sstream>
+#include <iterator>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        // KEYS[1] 列表 KEYS[2] 回填令牌; ARGV[1] 消息 ARGV[2] 容量 ARGV[3] 过期毫秒 ARGV[4] 消息标识 ARGV[5] 标识在编码中的起始位置
+        // 同时删除回填令牌, 使进行中的回填失效. 提交之后、Push 之前完成的回填已包含这条消息, 列表中已有时不再追加
+        const RedisScript kPushScript(
+            "redis.call('DEL', KEYS[2]) "
+            "local from = tonumber(ARGV[5]) "
+            "for _, item in ipairs(redis.call('LRANGE', KEYS[1], 0, tonumber(ARGV[2]) - 1)) do "
+            "  if string.sub(item, from, from + #ARGV[4] - 1) == ARGV[4] then return 0 end "
+            "end "
+            "if redis.call('LPUSHX', KEYS[1], ARGV[1]) > 0 then "
+            "  redis.call('LTRIM', KEYS[1], 0, tonumber(ARGV[2]) - 1) "
+            "  redis.call('PEXPIRE', KEYS[1], ARGV[3]) "
+            "end "
+            "return 0");
+
+        // KEYS[1] 列表 KEYS[2] 回填令牌; ARGV[1] 令牌 ARGV[2] 过期毫秒 ARGV[3..] 从新到旧的消息
+        const RedisScript kFillScript(
+            "if redis.call('GET', KEYS[2]) ~= ARGV[1] then return 0 end "
+            "redis.call('DEL', KEYS[2]) "
+            "if redis.call('EXISTS', KEYS[1]) == 1 then return 0 end "
+            "redis.call('RPUSH', KEYS[1], unpack(ARGV, 3)) "
+            "redis.call('PEXPIRE', KEYS[1], ARGV[2]) "
+            "return 1");
+
+        const char *kCompleteSentinel = "";
+
+        std::string NewToken()
+        {
+            thread_local std::mt19937_64 rng(std::random_device{}());
+            std::ostringstream oss;
+            oss << std::hex << rng() << rng();
+            return oss.str();
+        }
+    }
+
+    void RecentMessageCache::Push(const MessageEntity &message)
+    {
+        if (!m_client) return;
+        std::vector<std::string> keys = {ListKey(message.session_id()), FillKey(message.session_id())};
+        std::vector<std::string> args = {EncodeMessage(message), std::to_string(m_options.capacity),
+                                         std::to_string(m_options.ttl.count()), EncodeMessageIdentity(message),
+                                         std::to_string(kMessageIdentityOffset + 1)};
+        m_client->Execute([&](auto &r)
+        {
+            kPushScript.Eval<long long>(r, keys, args);
+        });
+    }
+
+    bool RecentMessageCache::Get(const std::string &session_id, size_t count, std::vector<MessageEntity> &messages)
+    {
+        if (!m_client || count == 0 || count > m_options.capacity) return false;
+        // 多取一条, 用于判断是否读到了完整会话的哨兵
+        std::vector<std::string> items;
+        std::string key = ListKey(session_id);
+        m_client->Execute([&](auto &r)
+        {
+            r.lrange(key, 0, static_cast<long long>(count), std::back_inserter(items));
+        });
+        if (items.empty()) return false;
+
+        bool complete = items.back() == kCompleteSentinel;
+        if (complete) items.pop_back();
+        if (items.size() < count && !complete) return false;
+        if (items.size() > count) items.resize(count);
+
+        messages.clear();
+        messages.reserve(items.size());
+        for (auto &item : items)
+        {
+            MessageEntity message;
+            if (!DecodeMessage(item, message))
+            {
+                LOG_WARN("RecentMessageCache: corrupt entry in session {}, dropping cache", session_id);
+                Invalidate(session_id);
+                return false;
+            }
+            messages.push_back(std::move(message));
+        }
+        return true;
+    }
+
+    std::string RecentMessageCache::BeginFill(const std::string &session_id)
+    {
+        if (!m_client) return std::string();
+        std::string token = NewToken();
+        std::string key = FillKey(session_id);
+        m_client->Set(key, token, m_options.fill_timeout);
+        return token;
+    }
+
+    bool RecentMessageCache::Fill(const std::string &session_id, const std::string &token,
+                                  const std::vector<MessageEntity> &newest_first, bool complete)
+    {
+        if (!m_client || token.empty()) return false;
+        std::vector<std::string> keys = {ListKey(session_id), FillKey(session_id)};
+        std::vector<std::string> args = {token, std::to_string(m_options.ttl.count())};
+        size_t limit = std::min(newest_first.size(), m_options.capacity);
+        args.reserve(limit + 3);
+        for (size_t i = 0; i < limit; ++i)
+        {
+            args.push_back(EncodeMessage(newest_first[i]));
+        }
+        if (complete && newest_first.size() < m_options.capacity)
+        {
+            args.push_back(kCompleteSentinel);
+        }
+        if (args.size() == 2) return false;
+        auto filled = m_client->Execute([&](auto &r)
+        {
+            return kFillScript.Eval<long long>(r, keys, args);
+        });
+        return filled == 1;
+    }
+
+    void RecentMessageCache::Invalidate(const std::string &session_id)
+    {
+        if (!m_client) return;
+        std::vector<std::string> keys = {ListKey(session_id), FillKey(session_id)};
+        m_client->Execute([&](auto &r) { r.del(keys.begin(), keys.end()); });
+    }
+}
@@ -1,8 +1,475 @@
 #include "redis_client.h"
 #include "logger.h"
+#include <iterator>
+#include <openssl/sha.h>
+#include <random>
+#include <sstream>
 
 namespace InstantSocial
 {
+    namespace
+    {
+        uint16_t Crc16(const char *buf, size_t len)
+        {
+            // CRC16-CCITT (XModem), 与 Redis Cluster 的 keyHashSlot 一致
+            uint16_t crc = 0;
+            for (size_t i = 0; i < len; ++i)
+            {
+                crc ^= static_cast<uint16_t>(static_cast<uint8_t>(buf[i])) << 8;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+                }
+            }
+            return crc;
+        }
+
+        std::vector<std::string> Pick(const std::vector<std::string> &keys, const std::vector<size_t> &indexes)
+        {
+            std::vector<std::string> picked;
+            picked.reserve(indexes.size());
+            for (size_t i : indexes) picked.push_back(keys[i]);
+            return picked;
+        }
+
+        std::vector<std::pair<std::string, std::string>> Pick(const std::vector<std::pair<std::string, std::string>> &items,
+                                                              const std::vector<size_t> &indexes)
+        {
+            std::vector<std::pair<std::string, std::string>> picked;
+            picked.reserve(indexes.size());
+            for (size_t i : indexes) picked.push_back(items[i]);
+            return picked;
+        }
+
+        std::vector<std::string> KeysOf(const std::vector<std::pair<std::string, std::string>> &items)
+        {
+            std::vector<std::string> keys;
+            keys.reserve(items.size());
+            for (auto &item : items) keys.push_back(item.first);
+            return keys;
+        }
+
+        std::vector<sw::redis::OptionalString> MultiGet(sw::redis::Redis &redis, const std::vector<std::string> &keys)
+        {
+            std::vector<sw::redis::OptionalString> values;
+            values.reserve(keys.size());
+            redis.mget(keys.begin(), keys.end(), std::back_inserter(values));
+            return values;
+        }
+
+        // 集群下 MGET 要求所有 key 在同一槽位, 按槽位拆分后再按原顺序合并
+        std::vector<sw::redis::OptionalString> MultiGet(sw::redis::RedisCluster &cluster, const std::vector<std::string> &keys)
+        {
+            std::vector<sw::redis::OptionalString> values(keys.size());
+            for (auto &group : GroupKeysBySlot(keys))
+            {
+                std::vector<sw::redis::OptionalString> part;
+                part.reserve(group.second.size());
+                auto slot_keys = Pick(keys, group.second);
+                cluster.mget(slot_keys.begin(), slot_keys.end(), std::back_inserter(part));
+                for (size_t i = 0; i < part.size() && i < group.second.size(); ++i)
+                {
+                    values[group.second[i]] = std::move(part[i]);
+                }
+            }
+            return values;
+        }
+
+        void MultiSet(sw::redis::Redis &redis, const std::vector<std::pair<std::string, std::string>> &items)
+        {
+            redis.mset(items.begin(), items.end());
+        }
+
+        void MultiSet(sw::redis::RedisCluster &cluster, const std::vector<std::pair<std::string, std::string>> &items)
+        {
+            for (auto &group : GroupKeysBySlot(KeysOf(items)))
+            {
+                auto slot_items = Pick(items, group.second);
+                cluster.mset(slot_items.begin(), slot_items.end());
+            }
+        }
+
+        void MultiDel(sw::redis::Redis &redis, const std::vector<std::string> &keys)
+        {
+            redis.del(keys.begin(), keys.end());
+        }
+
+        void MultiDel(sw::redis::RedisCluster &cluster, const std::vector<std::string> &keys)
+        {
+            for (auto &group : GroupKeysBySlot(keys))
+            {
+                auto slot_keys = Pick(keys, group.second);
+                cluster.del(slot_keys.begin(), slot_keys.end());
+            }
+        }
+
+        // MSET 不支持过期时间, 用流水线批量发送 SET PX
+        void MultiSetWithTtl(sw::redis::Redis &redis, const std::vector<std::pair<std::string, std::string>> &items,
+                             const std::chrono::milliseconds &t)
+        {
+            auto pipe = redis.pipeline(false);
+            for (auto &item : items)
+            {
+                pipe.set(item.first, item.second, t);
+            }
+            pipe.exec();
+        }
+
+        void MultiSetWithTtl(sw::redis::RedisCluster &cluster, const std::vector<std::pair<std::string, std::string>> &items,
+                             const std::chrono::milliseconds &t)
+        {
+            auto keys = KeysOf(items);
+            for (auto &group : GroupKeysBySlot(keys))
+            {
+                auto pipe = cluster.pipeline(keys[group.second.front()], false);
+                for (size_t i : group.second)
+                {
+                    pipe.set(items[i].first, items[i].second, t);
+                }
+                pipe.exec();
+            }
+        }
+    }
+
+    uint16_t RedisKeySlot(const std::string &key)
+    {
+        auto start = key.find('{');
+        if (start != std::string::npos)
+        {
+            auto end = key.find('}', start + 1);
+            if (end != std::string::npos && end != start + 1)
+            {
+                return Crc16(key.data() + start + 1, end - start - 1) & 16383;
+            }
+        }
+        return Crc16(key.data(), key.size()) & 16383;
+    }
+
+    std::map<uint16_t, std::vector<size_t>> GroupKeysBySlot(const std::vector<std::string> &keys)
+    {
+        std::map<uint16_t, std::vector<size_t>> groups;
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            groups[RedisKeySlot(keys[i])].push_back(i);
+        }
+        return groups;
+    }
+
+    RedisClient::RedisClient(const std::shared_ptr<sw::redis::Redis> &redis, size_t pool_size, const std::string &metrics_prefix)
+        : m_redis(redis), m_pool_size(pool_size == 0 ? 1 : pool_size)
+    {
+        ExposeMetrics(metrics_prefix);
+    }
+
+    RedisClient::RedisClient(const std::shared_ptr<sw::redis::RedisCluster> &cluster, size_t pool_size, const std::string &metrics_prefix)
+        : m_cluster(cluster), m_pool_size(pool_size == 0 ? 1 : pool_size)
+    {
+        ExposeMetrics(metrics_prefix);
+    }
+
+    RedisClient::~RedisClient()
+    {
+        // 先停掉后台刷新线程, 它们会用到连接和指标
+        m_auto_pipeline.reset();
+    }
+
+    void RedisClient::EnableAutoPipeline(const AutoPipelineOptions &options)
+    {
+        if (!options.enabled) return;
+        m_auto_pipeline = std::make_unique<AutoPipeline>(this, options);
+    }
+
+    sw::redis::OptionalString RedisClient::Get(const std::string &key)
+    {
+        if (!m_auto_pipeline) return Execute([&](auto &r) { return r.get(key); });
+        return m_auto_pipeline->Submit<sw::redis::OptionalString>(key, [key](sw::redis::Pipeline &pipe) { pipe.get(key); }).get();
+    }
+
+    void RedisClient::Set(const std::string &key, const std::string &value, const std::chrono::milliseconds &ttl)
+    {
+        if (!m_auto_pipeline)
+        {
+            Execute([&](auto &r) { r.set(key, value, ttl); });
+            return;
+        }
+        m_auto_pipeline->Submit<bool>(key, [key, value, ttl](sw::redis::Pipeline &pipe) { pipe.set(key, value, ttl); }).get();
+    }
+
+    long long RedisClient::Del(const std::string &key)
+    {
+        if (!m_auto_pipeline) return Execute([&](auto &r) { return r.del(key); });
+        return m_auto_pipeline->Submit<long long>(key, [key](sw::redis::Pipeline &pipe) { pipe.del(key); }).get();
+    }
+
+    sw::redis::Subscriber RedisClient::Subscriber()
+    {
+        if (m_cluster) return m_cluster->subscriber();
+        return m_redis->subscriber();
+    }
+
+    RedisClient::Metrics::Metrics(RedisClient *client)
+        : in_flight(GetInFlight, client),
+          utilization(GetUtilization, client),
+          peak_window(&peak, 10)
+    {
+    }
+
+    void RedisClient::ExposeMetrics(const std::string &prefix)
+    {
+        if (prefix.empty()) return;
+        m_metrics = std::make_unique<Metrics>(this);
+        m_metrics->pool_size.set_value(static_cast<int64_t>(m_pool_size));
+        m_metrics->in_flight.expose_as(prefix, "in_flight");
+        m_metrics->utilization.expose_as(prefix, "pool_utilization");
+        m_metrics->pool_size.expose_as(prefix, "pool_size");
+        m_metrics->peak_window.expose_as(prefix, "in_flight_max_10s");
+        m_metrics->latency.expose(prefix);
+    }
+
+    int64_t RedisClient::GetInFlight(void *arg)
+    {
+        return static_cast<RedisClient *>(arg)->m_in_flight.load();
+    }
+
+    double RedisClient::GetUtilization(void *arg)
+    {
+        // 集群模式下连接池按节点划分, 这里按单个节点的池大小估算, 结果偏保守
+        auto client = static_cast<RedisClient *>(arg);
+        return static_cast<double>(client->m_in_flight.load()) / client->m_pool_size;
+    }
+
+    RedisClient::Lease::Lease(RedisClient *client)
+        : m_client(client), m_start(std::chrono::steady_clock::now())
+    {
+        int64_t in_flight = ++m_client->m_in_flight;
+        if (m_client->m_metrics)
+        {
+            m_client->m_metrics->peak << in_flight;
+        }
+    }
+
+    RedisClient::Lease::~Lease()
+    {
+        --m_client->m_in_flight;
+        if (m_client->m_metrics)
+        {
+            auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start);
+            m_client->m_metrics->latency << cost.count();
+        }
+    }
+
+    AutoPipeline::AutoPipeline(RedisClient *client, const AutoPipelineOptions &options)
+        : m_client(client), m_options(options)
+    {
+        if (m_options.max_batch == 0) m_options.max_batch = 1;
+        size_t flushers = std::max<size_t>(m_options.flushers, 1);
+        for (size_t i = 0; i < flushers; ++i)
+        {
+            m_flushers.emplace_back(&AutoPipeline::Run, this);
+        }
+    }
+
+    AutoPipeline::~AutoPipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        // 刷新线程退出前会把队列中剩余的命令发完
+        for (auto &t : m_flushers)
+        {
+            t.join();
+        }
+    }
+
+    void AutoPipeline::Push(Op op)
+    {
+        size_t size;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(std::move(op));
+            size = m_queue.size();
+        }
+        if (size == 1) m_cond.notify_one();
+        else if (size >= m_options.max_batch) m_cond.notify_all();
+    }
+
+    void AutoPipeline::Run()
+    {
+        std::vector<Op> batch;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty()) return;
+                if (m_options.window.count() > 0 && !m_stop && m_queue.size() < m_options.max_batch)
+                {
+                    m_cond.wait_for(lock, m_options.window, [this]() { return m_stop || m_queue.size() >= m_options.max_batch; });
+                }
+                size_t count = std::min(m_queue.size(), m_options.max_batch);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    batch.push_back(std::move(m_queue.front()));
+                    m_queue.pop_front();
+                }
+                // 剩余命令交给空闲的刷新线程, 不必等当前流水线返回
+                if (!m_queue.empty()) m_cond.notify_one();
+            }
+            Flush(batch);
+            batch.clear();
+        }
+    }
+
+    void AutoPipeline::Flush(std::vector<Op> &batch)
+    {
+        try
+        {
+            m_client->Execute([&](auto &r) { Exec(r, batch); });
+        }
+        catch (...)
+        {
+            // Exec 内部已逐条分发结果, 这里只处理还未分发就失败的情况(如取不到连接)
+            auto err = std::current_exception();
+            for (auto &op : batch)
+            {
+                if (op.fail) op.fail(err);
+            }
+        }
+    }
+
+    void AutoPipeline::Exec(sw::redis::Redis &redis, std::vector<Op> &batch)
+    {
+        auto pipe = redis.pipeline(false);
+        std::vector<size_t> indexes;
+        indexes.reserve(batch.size());
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            batch[i].append(pipe);
+            indexes.push_back(i);
+        }
+        auto replies = pipe.exec();
+        Dispatch(replies, batch, indexes);
+    }
+
+    void AutoPipeline::Exec(sw::redis::RedisCluster &cluster, std::vector<Op> &batch)
+    {
+        // 集群模式下同一条流水线只能发往一个节点, 按槽位分组, 各组独立成败
+        std::vector<std::string> keys;
+        keys.reserve(batch.size());
+        for (auto &op : batch) keys.push_back(op.key);
+        for (auto &group : GroupKeysBySlot(keys))
+        {
+            try
+            {
+                auto pipe = cluster.pipeline(keys[group.second.front()], false);
+                for (size_t i : group.second)
+                {
+                    batch[i].append(pipe);
+                }
+                auto replies = pipe.exec();
+                Dispatch(replies, batch, group.second);
+            }
+            catch (...)
+            {
+                auto err = std::current_exception();
+                for (size_t i : group.second)
+                {
+                    if (batch[i].fail) batch[i].fail(err);
+                    batch[i].fail = nullptr;
+                }
+            }
+        }
+    }
+
+    void AutoPipeline::Dispatch(sw::redis::QueuedReplies &replies, std::vector<Op> &batch, const std::vector<size_t> &indexes)
+    {
+        for (size_t n = 0; n < indexes.size(); ++n)
+        {
+            Op &op = batch[indexes[n]];
+            try
+            {
+                op.reply(replies, n);
+            }
+            catch (...)
+            {
+                op.fail(std::current_exception());
+            }
+            // 已分发, 避免外层出错时重复设置 promise
+            op.fail = nullptr;
+        }
+    }
+
+    namespace
+    {
+        void ExecutePipelined(sw::redis::Redis &redis, const std::vector<std::string> &keys,
+                              const PipelineAppendFunc &append, const PipelineReadFunc &read)
+        {
+            auto pipe = redis.pipeline(false);
+            std::vector<size_t> offsets;
+            offsets.reserve(keys.size());
+            size_t offset = 0;
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                offsets.push_back(offset);
+                offset += append(pipe, i);
+            }
+            auto replies = pipe.exec();
+            for (size_t i = 0; i < keys.size(); ++i)
+            {
+                read(replies, offsets[i], i);
+            }
+        }
+
+        void ExecutePipelined(sw::redis::RedisCluster &cluster, const std::vector<std::string> &keys,
+                              const PipelineAppendFunc &append, const PipelineReadFunc &read)
+        {
+            for (auto &group : GroupKeysBySlot(keys))
+            {
+                auto pipe = cluster.pipeline(keys[group.second.front()], false);
+                std::vector<size_t> offsets;
+                offsets.reserve(group.second.size());
+                size_t offset = 0;
+                for (size_t i : group.second)
+                {
+                    offsets.push_back(offset);
+                    offset += append(pipe, i);
+                }
+                auto replies = pipe.exec();
+                for (size_t n = 0; n < group.second.size(); ++n)
+                {
+                    read(replies, offsets[n], group.second[n]);
+                }
+            }
+        }
+    }
+
+    void ExecutePipelined(RedisClient &client, const std::vector<std::string> &keys,
+                          const PipelineAppendFunc &append, const PipelineReadFunc &read)
+    {
+        if (keys.empty()) return;
+        client.Execute([&](auto &r) { ExecutePipelined(r, keys, append, read); });
+    }
+
+    RedisScript::RedisScript(std::string source) : m_source(std::move(source))
+    {
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        SHA1(reinterpret_cast<const unsigned char *>(m_source.data()), m_source.size(), digest);
+        static const char *kHex = "0123456789abcdef";
+        m_sha.reserve(SHA_DIGEST_LENGTH * 2);
+        for (unsigned char c : digest)
+        {
+            m_sha.push_back(kHex[c >> 4]);
+            m_sha.push_back(kHex[c & 0xf]);
+        }
+    }
+
+    bool RedisScript::IsNoScript(const sw::redis::ReplyError &e)
+    {
+        return std::string(e.what()).compare(0, 8, "NOSCRIPT") == 0;
+    }
+
     std::shared_ptr<sw::redis::Redis> RedisFactory::Create(const std::string &host, int port, bool keep_alive, const std::string &password, int db)
     {
         try {
@@ -29,39 +496,516 @@ namespace InstantSocial
         }
     }
 
+    RedisClient::Ptr RedisFactory::Create(const RedisOptions &options)
+    {
+        try {
+            sw::redis::ConnectionOptions connection_options;
+            connection_options.host = options.host;
+            connection_options.port = options.port;
+            connection_options.db = options.db;
+            connection_options.keep_alive = options.keep_alive;
+            connection_options.socket_timeout = options.socket_timeout;
+            connection_options.connect_timeout = options.connect_timeout;
+            if (!options.user.empty()) {
+                connection_options.user = options.user;
+            }
+            if (!options.password.empty()) {
+                connection_options.password = options.password;
+            }
+
+            sw::redis::ConnectionPoolOptions pool_options;
+            pool_options.size = options.pool_size;
+            pool_options.wait_timeout = options.wait_timeout;
+            pool_options.connection_lifetime = options.connection_lifetime;
+
+            if (options.mode == RedisOptions::Mode::Cluster) {
+                // 构造时即拉取槽位分布, 节点不可达会直接抛异常
+                auto cluster = std::make_shared<sw::redis::RedisCluster>(connection_options, pool_options);
+                auto client = std::make_shared<RedisClient>(cluster, options.pool_size, options.metrics_prefix);
+                client->EnableAutoPipeline(options.auto_pipeline);
+                return client;
+            }
+
+            std::shared_ptr<sw::redis::Redis> redis_client;
+            if (options.mode == RedisOptions::Mode::Sentinel) {
+                sw::redis::SentinelOptions sentinel_options;
+                sentinel_options.nodes = options.sentinels;
+                sentinel_options.connect_timeout = options.connect_timeout;
+                sentinel_options.socket_timeout = options.socket_timeout;
+                if (!options.sentinel_user.empty()) {
+                    sentinel_options.user = options.sentinel_user;
+                }
+                if (!options.sentinel_password.empty()) {
+                    sentinel_options.password = options.sentinel_password;
+                }
+                auto sentinel = std::make_shared<sw::redis::Sentinel>(sentinel_options);
+                redis_client = std::make_shared<sw::redis::Redis>(sentinel, options.master_name, sw::redis::Role::MASTER,
+                                                                  connection_options, pool_options);
+            } else {
+                redis_client = std::make_shared<sw::redis::Redis>(connection_options, pool_options);
+            }
+
+            redis_client->ping();
+
+            auto client = std::make_shared<RedisClient>(redis_client, options.pool_size, options.metrics_prefix);
+            client->EnableAutoPipeline(options.auto_pipeline);
+            return client;
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to create Redis client: {} ", e.what());
+            return nullptr;
+        }
+    }
+
+    CacheInvalidator::CacheInvalidator(const RedisClient::Ptr &client, const std::string &channel,
+                                       const InvalidateCallback &on_invalidate, const ResetCallback &on_reset)
+        : m_client(client), m_channel(channel),
+          m_on_invalidate(on_invalidate), m_on_reset(on_reset), m_running(true)
+    {
+        std::random_device rd;
+        std::ostringstream oss;
+        oss << channel << ":wakeup:" << std::hex << rd() << rd() << rd() << rd();
+        m_wakeup_channel = oss.str();
+        m_thread = std::thread(&CacheInvalidator::Run, this);
+    }
+
+    CacheInvalidator::~CacheInvalidator()
+    {
+        // socket_timeout 为 0 时 consume 不会超时返回, 向唤醒频道发布消息使其返回.
+        // 订阅命令在 consume 时才发出, 消息可能早于订阅到达而丢失, 未退出则重发
+        m_running = false;
+        auto stopped = m_stopped.get_future();
+        while (stopped.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+        {
+            try
+            {
+                m_client->Execute([&](auto &r) { r.publish(m_wakeup_channel, ""); });
+            }
+            catch (const std::exception &e)
+            {
+                LOG_WARN("Failed to wake cache invalidation channel {}: {}", m_channel, e.what());
+            }
+            stopped.wait_for(std::chrono::milliseconds(200));
+        }
+        m_thread.join();
+    }
+
+    void CacheInvalidator::Publish(const std::string &key)
+    {
+        m_client->Execute([&](auto &r) { r.publish(m_channel, key); });
+    }
+
+    void CacheInvalidator::Publish(const std::vector<std::string> &keys)
+    {
+        if (keys.empty()) return;
+        std::string msg;
+        for (auto &key : keys)
+        {
+            if (!msg.empty()) msg.push_back('\n');
+            msg += key;
+        }
+        m_client->Execute([&](auto &r) { r.publish(m_channel, msg); });
+    }
+
+    void CacheInvalidator::Run()
+    {
+        while (m_running)
+        {
+            try
+            {
+                auto subscriber = m_client->Subscriber();
+                subscriber.on_message([this](std::string channel, std::string msg)
+                {
+                    if (channel == m_wakeup_channel) return;
+                    size_t begin = 0;
+                    while (begin <= msg.size())
+                    {
+                        size_t end = msg.find('\n', begin);
+                        if (end == std::string::npos) end = msg.size();
+                        m_on_invalidate(msg.substr(begin, end - begin));
+                        begin = end + 1;
+                    }
+                });
+                subscriber.subscribe(m_channel);
+                subscriber.subscribe(m_wakeup_channel);
+                m_on_reset();
+                LOG_INFO("Subscribed cache invalidation channel {}", m_channel);
+                while (m_running)
+                {
+                    try
+                    {
+                        subscriber.consume();
+                    }
+                    catch (const sw::redis::TimeoutError &)
+                    {
+                        continue;
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("Cache invalidation channel {} broken: {}", m_channel, e.what());
+                m_on_reset();
+                for (int i = 0; i < 10 && m_running; ++i)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            }
+        }
+        m_stopped.set_value();
+    }
+
+    Session::Session(const std::shared_ptr<sw::redis::Redis> &redis_client)
+        : m_client(redis_client ? std::make_shared<RedisClient>(redis_client) : nullptr)
+    {
+    }
+
+    Session::Session(const std::shared_ptr<sw::redis::Redis> &redis_client, const NearCacheOptions &options)
+        : Session(redis_client ? std::make_shared<RedisClient>(redis_client) : nullptr, options)
+    {
+    }
+
+    Session::Session(const std::shared_ptr<sw::redis::RedisCluster> &cluster_client)
+        : m_client(cluster_client ? std::make_shared<RedisClient>(cluster_client) : nullptr)
+    {
+    }
+
+    Session::Session(const RedisClient::Ptr &client, const NearCacheOptions &options)
+        : m_client(client)
+    {
+        if (!m_client) return;
+        UidCache::Options cache_options;
+        cache_options.shards = options.shards;
+        cache_options.capacity = options.capacity;
+        cache_options.ttl = options.ttl;
+        auto cache = std::make_shared<UidCache>(cache_options);
+        m_cache = cache;
+        m_invalidator = std::make_shared<CacheInvalidator>(m_client, options.channel,
+            [cache](const std::string &ssid) { cache->Erase(ssid); },
+            [cache]() { cache->Clear(); });
+    }
+
     void Session::Append(const std::string &ssid, const std::string &uid)
     {
-        if (!m_redis_client) return;
-        m_redis_client->set(ssid, uid);
+        if (!m_client) return;
+        m_client->Set(ssid, uid);
+        Invalidate(ssid);
     }
 
     void Session::Remove(const std::string &ssid)
     {
-        if (!m_redis_client) return;
-        m_redis_client->del(ssid);
+        if (!m_client) return;
+        m_client->Del(ssid);
+        Invalidate(ssid);
     }
 
     sw::redis::OptionalString Session::GetUid(const std::string &ssid)
     {
-        if (!m_redis_client) return sw::redis::OptionalString();
-        return m_redis_client->get(ssid);
+        if (!m_client) return sw::redis::OptionalString();
+        if (!m_cache) return m_client->Get(ssid);
+
+        std::string uid;
+        if (m_cache->Get(ssid, uid))
+        {
+            return sw::redis::OptionalString(uid);
+        }
+        // 读取前记录分片版本, 读取期间发生失效则放弃回填
+        uint64_t epoch = m_cache->Epoch(ssid);
+        auto res = m_client->Get(ssid);
+        if (res)
+        {
+            m_cache->Put(ssid, *res, epoch);
+        }
+        return res;
+    }
+
+    std::vector<sw::redis::OptionalString> Session::GetUids(const std::vector<std::string> &ssids)
+    {
+        if (ssids.empty()) return {};
+        if (!m_client) return std::vector<sw::redis::OptionalString>(ssids.size());
+        if (!m_cache) return m_client->Execute([&](auto &r) { return MultiGet(r, ssids); });
+
+        // 先查近端缓存, 只对未命中的 key 发一次 MGET
+        std::vector<sw::redis::OptionalString> values(ssids.size());
+        std::vector<size_t> missed;
+        std::vector<uint64_t> epochs;
+        std::string uid;
+        for (size_t i = 0; i < ssids.size(); ++i)
+        {
+            if (m_cache->Get(ssids[i], uid))
+            {
+                values[i] = uid;
+            }
+            else
+            {
+                missed.push_back(i);
+                epochs.push_back(m_cache->Epoch(ssids[i]));
+            }
+        }
+        if (missed.empty()) return values;
+
+        auto missed_keys = Pick(ssids, missed);
+        auto fetched = m_client->Execute([&](auto &r) { return MultiGet(r, missed_keys); });
+        for (size_t i = 0; i < missed.size() && i < fetched.size(); ++i)
+        {
+            if (fetched[i])
+            {
+                m_cache->Put(ssids[missed[i]], *fetched[i], epochs[i]);
+            }
+            values[missed[i]] = std::move(fetched[i]);
+        }
+        return values;
+    }
+
+    void Session::AppendMany(const std::vector<std::pair<std::string, std::string>> &items)
+    {
+        if (items.empty() || !m_client) return;
+        m_client->Execute([&](auto &r) { MultiSet(r, items); });
+        Invalidate(KeysOf(items));
+    }
+
+    void Session::RemoveMany(const std::vector<std::string> &ssids)
+    {
+        if (ssids.empty() || !m_client) return;
+        m_client->Execute([&](auto &r) { MultiDel(r, ssids); });
+        Invalidate(ssids);
+    }
+
+    void Session::Invalidate(const std::string &ssid)
+    {
+        if (!m_cache) return;
+        m_cache->Erase(ssid);
+        m_invalidator->Publish(ssid);
+    }
+
+    void Session::Invalidate(const std::vector<std::string> &ssids)
+    {
+        if (!m_cache) return;
+        for (auto &ssid : ssids)
+        {
+            m_cache->Erase(ssid);
+        }
+        m_invalidator->Publish(ssids);
+    }
+
+    Codes::Codes(const std::shared_ptr<sw::redis::Redis> &redis_client)
+        : m_client(redis_client ? std::make_shared<RedisClient>(redis_client) : nullptr)
+    {
+    }
+
+    Codes::Codes(const std::shared_ptr<sw::redis::RedisCluster> &cluster_client)
+        : m_client(cluster_client ? std::make_shared<RedisClient>(cluster_client) : nullptr)
+    {
     }
 
     void Codes::Append(const std::string &cid, const std::string &code, const std::chrono::milliseconds &t)
     {
-        if (!m_redis_client) return;
-        m_redis_client->set(cid, code , t);
+        if (!m_client) return;
+        m_client->Set(cid, code, t);
     }
 
     void Codes::Remove(const std::string &cid)
     {
-        if (!m_redis_client) return;
-        m_redis_client->del(cid);
+        if (!m_client) return;
+        m_client->Del(cid);
     }
 
     sw::redis::OptionalString Codes::GetCode(const std::string &cid)
     {
-        if (!m_redis_client) return sw::redis::OptionalString();
-        return m_redis_client->get(cid);
+        if (!m_client) return sw::redis::OptionalString();
+        return m_client->Get(cid);
+    }
+
+    std::vector<sw::redis::OptionalString> Codes::GetCodes(const std::vector<std::string> &cids)
+    {
+        if (cids.empty()) return {};
+        if (!m_client) return std::vector<sw::redis::OptionalString>(cids.size());
+        return m_client->Execute([&](auto &r) { return MultiGet(r, cids); });
+    }
+
+    void Codes::AppendMany(const std::vector<std::pair<std::string, std::string>> &items, const std::chrono::milliseconds &t)
+    {
+        if (items.empty() || !m_client) return;
+        m_client->Execute([&](auto &r) { MultiSetWithTtl(r, items, t); });
+    }
+
+    void Codes::RemoveMany(const std::vector<std::string> &cids)
+    {
+        if (cids.empty() || !m_client) return;
+        m_client->Execute([&](auto &r) { MultiDel(r, cids); });
+    }
+
+    namespace
+    {
+        int64_t NowMillis()
+        {
+            // 各节点共用 score 判断过期, 使用墙上时间, 依赖节点间时钟基本同步
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    Presence::Presence(const RedisClient::Ptr &client, const PresenceOptions &options)
+        : m_client(client), m_options(options)
+    {
+        m_flusher = std::thread(&Presence::Run, this);
+    }
+
+    Presence::~Presence()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        if (m_flusher.joinable())
+        {
+            m_flusher.join();
+        }
+    }
+
+    std::string Presence::Key(const std::string &uid) const
+    {
+        return m_options.key_prefix + uid;
+    }
+
+    void Presence::Heartbeat(const std::string &uid, const std::string &device)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending[uid].insert(device);
+    }
+
+    void Presence::Online(const std::string &uid, const std::string &device)
+    {
+        if (!m_client) return;
+        Write(Build({{uid, {device}}}, NowMillis()));
+    }
+
+    void Presence::Offline(const std::string &uid, const std::string &device)
+    {
+        {
+            // 丢弃尚未写入的心跳, 避免下线后又被刷新为在线
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_pending.find(uid);
+            if (it != m_pending.end())
+            {
+                it->second.erase(device);
+                if (it->second.empty()) m_pending.erase(it);
+            }
+        }
+        if (!m_client) return;
+        std::string key = Key(uid);
+        m_client->Execute([&](auto &r) { r.zrem(key, device); });
+    }
+
+    void Presence::Flush()
+    {
+        auto batch = TakeBatch(NowMillis());
+        if (batch.entries.empty() || !m_client) return;
+        Write(batch);
+    }
+
+    PresenceBatch Presence::TakeBatch(int64_t now_ms)
+    {
+        std::unordered_map<std::string, std::set<std::string>> beats;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            beats.swap(m_pending);
+        }
+        return Build(beats, now_ms);
+    }
+
+    PresenceBatch Presence::Build(const std::unordered_map<std::string, std::set<std::string>> &beats, int64_t now_ms) const
+    {
+        PresenceBatch batch;
+        batch.now_ms = now_ms;
+        batch.expire_ms = now_ms + m_options.ttl.count();
+        batch.entries.reserve(beats.size());
+        for (auto &beat : beats)
+        {
+            batch.entries.push_back({Key(beat.first), std::vector<std::string>(beat.second.begin(), beat.second.end())});
+        }
+        return batch;
+    }
+
+    void Presence::Write(const PresenceBatch &batch)
+    {
+        double now = static_cast<double>(batch.now_ms);
+        double expire = static_cast<double>(batch.expire_ms);
+        std::vector<std::string> keys;
+        keys.reserve(batch.entries.size());
+        for (auto &entry : batch.entries) keys.push_back(entry.key);
+        // 每个用户: 刷新设备过期时间, 清理已过期设备, 整个 key 随最后一个设备过期
+        ExecutePipelined(*m_client, keys,
+            [&](sw::redis::Pipeline &pipe, size_t i)
+            {
+                auto &devices = batch.entries[i].devices;
+                for (auto &device : devices)
+                {
+                    pipe.zadd(keys[i], device, expire);
+                }
+                pipe.zremrangebyscore(keys[i], sw::redis::RightBoundedInterval<double>(now, sw::redis::BoundType::CLOSED));
+                pipe.pexpire(keys[i], m_options.ttl);
+                return devices.size() + 2;
+            },
+            [](sw::redis::QueuedReplies &, size_t, size_t) {});
+    }
+
+    void Presence::Run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            m_cond.wait_for(lock, m_options.flush_interval, [this]() { return m_stop; });
+            lock.unlock();
+            try
+            {
+                Flush();
+            }
+            catch (const std::exception &e)
+            {
+                // 本周期的心跳丢弃, 设备在 ttl 内仍保持在线, 下个周期会重新写入
+                LOG_ERROR("Failed to flush presence heartbeats: {}", e.what());
+            }
+            lock.lock();
+        }
+    }
+
+    bool Presence::IsOnline(const std::string &uid)
+    {
+        return AreOnline({uid}).front();
+    }
+
+    std::vector<bool> Presence::AreOnline(const std::vector<std::string> &uids)
+    {
+        std::vector<bool> online(uids.size(), false);
+        if (uids.empty() || !m_client) return online;
+        double now = static_cast<double>(NowMillis());
+        std::vector<std::string> keys;
+        keys.reserve(uids.size());
+        for (auto &uid : uids) keys.push_back(Key(uid));
+        ExecutePipelined(*m_client, keys,
+            [&](sw::redis::Pipeline &pipe, size_t i)
+            {
+                pipe.zcount(keys[i], sw::redis::LeftBoundedInterval<double>(now, sw::redis::BoundType::OPEN));
+                return size_t(1);
+            },
+            [&](sw::redis::QueuedReplies &replies, size_t offset, size_t i)
+            {
+                online[i] = replies.get<long long>(offset) > 0;
+            });
+        return online;
+    }
+
+    std::vector<std::string> Presence::OnlineDevices(const std::string &uid)
+    {
+        std::vector<std::string> devices;
+        if (!m_client) return devices;
+        std::string key = Key(uid);
+        double now = static_cast<double>(NowMillis());
+        m_client->Execute([&](auto &r)
+        {
+            r.zrangebyscore(key, sw::redis::LeftBoundedInterval<double>(now, sw::redis::BoundType::OPEN), std::back_inserter(devices));
+        });
+        return devices;
     }
-} // namespace InstantSocial
\ No newline at end of file
+} // namespace InstantSocial
@@ -0,0 +1,363 @@
+#include "schema_migrator.h"
+#include "schema_migration_entity.h"
+#include "schema_migration_entity-odb.hxx"
+#include "logger.h"
+#include <odb/connection.hxx>
+#include <odb/schema-catalog.hxx>
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::chrono::milliseconds Since(Clock::time_point start)
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start);
+        }
+
+        ColumnDefinition FindColumn(const SchemaMigrator::Database &db, const std::string &table, const std::string &column)
+        {
+            typedef odb::query<ColumnDefinition> Query;
+            typedef odb::result<ColumnDefinition> Result;
+            ColumnDefinition definition;
+            odb::transaction t(db->begin());
+            Result r(db->query<ColumnDefinition>(Query("table_name =") + Query::_val(table) + "AND column_name =" + Query::_val(column)));
+            for (auto it = r.begin(); it != r.end(); ++it)
+            {
+                definition = *it;
+            }
+            t.commit();
+            return definition;
+        }
+    }
+
+    std::vector<SchemaMigrator::Migration> BuiltinMigrations()
+    {
+        std::vector<SchemaMigrator::Migration> migrations;
+        migrations.push_back({1, "message: add (session_id, create_time, id) index for cursor paging", true,
+            [](SchemaMigrator &m) {
+                m.AddIndex("message", "message_session_time_idx", "session_id, create_time, id");
+            }});
+        migrations.push_back({2, "message: drop session_id index covered by message_session_time_idx", true,
+            [](SchemaMigrator &m) {
+                m.DropIndex("message", "message_session_id_i");
+            }});
+        migrations.push_back({3, "message: store create_time with microsecond precision", false,
+            [](SchemaMigrator &m) {
+                m.ModifyColumn("message", "create_time", "TIMESTAMP(6) NULL", "timestamp(6)");
+            }});
+        migrations.push_back({4, "message: drop unique message_id index, message_id is derived from id", true,
+            [](SchemaMigrator &m) {
+                m.DropIndex("message", "message_message_id_i");
+            }});
+        return migrations;
+    }
+
+    SchemaMigrator::SchemaMigrator(const Database &db, const SchemaMigratorOptions &options)
+        : m_db(db), m_options(options)
+    {
+        for (auto &migration : BuiltinMigrations())
+        {
+            Register(migration);
+        }
+    }
+
+    void SchemaMigrator::Register(const Migration &migration)
+    {
+        auto pos = std::lower_bound(m_migrations.begin(), m_migrations.end(), migration.version,
+            [](const Migration &m, uint64_t version) { return m.version < version; });
+        if (pos != m_migrations.end() && pos->version == migration.version)
+        {
+            throw std::invalid_argument("duplicate schema migration version " + std::to_string(migration.version));
+        }
+        m_migrations.insert(pos, migration);
+    }
+
+    uint64_t SchemaMigrator::CurrentVersion()
+    {
+        if (!TableExists("schema_migrations")) return 0;
+        auto applied = AppliedVersions();
+        return applied.empty() ? 0 : *applied.rbegin();
+    }
+
+    std::vector<SchemaMigrator::Migration> SchemaMigrator::Pending()
+    {
+        std::set<uint64_t> applied;
+        if (TableExists("schema_migrations")) applied = AppliedVersions();
+        std::vector<Migration> pending;
+        for (auto &migration : m_migrations)
+        {
+            if (!applied.count(migration.version)) pending.push_back(migration);
+        }
+        return pending;
+    }
+
+    bool SchemaMigrator::Migrate()
+    {
+        odb::connection_ptr lock_conn(m_db->connection());
+        if (!Lock(lock_conn))
+        {
+            LOG_ERROR("Acquire schema migration lock failed within {}s", m_options.lock_timeout.count());
+            return false;
+        }
+
+        bool ok = true;
+        try
+        {
+            if (IsEmptyDatabase())
+            {
+                // 空库: ODB 生成的建表语句已是最新结构, 所有迁移直接记为已执行
+                CreateSchema();
+                for (auto &migration : m_migrations)
+                {
+                    Record(migration, std::chrono::milliseconds(0));
+                }
+                LOG_INFO("Created schema at version {}", m_migrations.empty() ? 0 : m_migrations.back().version);
+            }
+            else
+            {
+                EnsureTable();
+                auto applied = AppliedVersions();
+                for (auto &migration : m_migrations)
+                {
+                    if (applied.count(migration.version)) continue;
+                    if (!migration.online && !m_options.allow_blocking)
+                    {
+                        LOG_WARN("Schema migration {} ({}) blocks writes while it runs, "
+                                 "run tools/schema_migrate --allow_blocking in a maintenance window",
+                                 migration.version, migration.description);
+                        ok = false;
+                        break;
+                    }
+                    LOG_INFO("Applying schema migration {}: {}", migration.version, migration.description);
+                    auto start = Clock::now();
+                    migration.apply(*this);
+                    Record(migration, Since(start));
+                    LOG_INFO("Applied schema migration {} in {}ms", migration.version, Since(start).count());
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Schema migration failed: {}", e.what());
+            ok = false;
+        }
+        Unlock(lock_conn);
+        return ok;
+    }
+
+    bool SchemaMigrator::TableExists(const std::string &table)
+    {
+        typedef odb::query<TableCount> Query;
+        odb::transaction t(m_db->begin());
+        TableCount count(m_db->query_value<TableCount>(Query("table_name =") + Query::_val(table)));
+        t.commit();
+        return count.count > 0;
+    }
+
+    bool SchemaMigrator::IndexExists(const std::string &table, const std::string &index)
+    {
+        typedef odb::query<IndexCount> Query;
+        odb::transaction t(m_db->begin());
+        IndexCount count(m_db->query_value<IndexCount>(
+            Query("table_name =") + Query::_val(table) + "AND index_name =" + Query::_val(index)));
+        t.commit();
+        return count.count > 0;
+    }
+
+    std::string SchemaMigrator::ColumnType(const std::string &table, const std::string &column)
+    {
+        return FindColumn(m_db, table, column).type;
+    }
+
+    std::string SchemaMigrator::ColumnExtra(const std::string &table, const std::string &column)
+    {
+        return FindColumn(m_db, table, column).extra;
+    }
+
+    void SchemaMigrator::AddIndex(const std::string &table, const std::string &index, const std::string &columns)
+    {
+        if (IndexExists(table, index))
+        {
+            LOG_INFO("Index {}.{} already exists, skipped", table, index);
+            return;
+        }
+        RunDdl("ALTER TABLE `" + table + "` ADD INDEX `" + index + "` (" + columns + "), ALGORITHM=INPLACE, LOCK=NONE");
+    }
+
+    void SchemaMigrator::DropIndex(const std::string &table, const std::string &index)
+    {
+        if (!IndexExists(table, index))
+        {
+            LOG_INFO("Index {}.{} does not exist, skipped", table, index);
+            return;
+        }
+        RunDdl("ALTER TABLE `" + table + "` DROP INDEX `" + index + "`, ALGORITHM=INPLACE, LOCK=NONE");
+    }
+
+    void SchemaMigrator::ModifyColumn(const std::string &table, const std::string &column, const std::string &definition,
+                                      const std::string &expected_type)
+    {
+        if (ColumnType(table, column) == expected_type)
+        {
+            LOG_INFO("Column {}.{} is already {}, skipped", table, column, expected_type);
+            return;
+        }
+        // 允许读不允许写, 比 LOCK=EXCLUSIVE 对线上影响小
+        RunDdl("ALTER TABLE `" + table + "` MODIFY COLUMN `" + column + "` " + definition + ", ALGORITHM=COPY, LOCK=SHARED");
+    }
+
+    void SchemaMigrator::DropAutoIncrement(const std::string &table, const std::string &column, const std::string &definition)
+    {
+        if (ColumnExtra(table, column).find("auto_increment") == std::string::npos)
+        {
+            LOG_INFO("Column {}.{} has no AUTO_INCREMENT, skipped", table, column);
+            return;
+        }
+        RunDdl("ALTER TABLE `" + table + "` MODIFY COLUMN `" + column + "` " + definition + ", ALGORITHM=COPY, LOCK=SHARED");
+    }
+
+    void SchemaMigrator::RunDdl(const std::string &sql)
+    {
+        LOG_INFO("Executing: {}", sql);
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done = false;
+        std::exception_ptr error;
+
+        // DDL 在独立连接上执行, 当前线程定期查询进度
+        std::thread worker([&]() {
+            try
+            {
+                odb::connection_ptr conn(m_db->connection());
+                conn->execute(sql);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            cond.notify_one();
+        });
+
+        auto start = Clock::now();
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (cond.wait_for(lock, m_options.progress_interval, [&]() { return done; })) break;
+            }
+            ReportProgress(Since(start));
+        }
+        worker.join();
+        if (error) std::rethrow_exception(error);
+        LOG_INFO("Finished in {}ms: {}", Since(start).count(), sql);
+    }
+
+    void SchemaMigrator::ReportProgress(std::chrono::milliseconds elapsed)
+    {
+        bool reported = false;
+        try
+        {
+            typedef odb::result<AlterProgress> Result;
+            odb::transaction t(m_db->begin());
+            Result r(m_db->query<AlterProgress>());
+            for (auto it = r.begin(); it != r.end(); ++it)
+            {
+                double percent = it->estimated > 0 ? 100.0 * it->completed / it->estimated : 0.0;
+                LOG_INFO("DDL progress {}: {}/{} ({:.1f}%), elapsed {}s",
+                         it->stage, it->completed, it->estimated, percent, elapsed.count() / 1000);
+                if (m_progress) m_progress(it->stage, it->completed, it->estimated, elapsed);
+                reported = true;
+            }
+            t.commit();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_DEBUG("Query DDL progress failed: {}", e.what());
+        }
+        if (!reported)
+        {
+            // performance_schema 未开启相应埋点, 或 DDL 处于不上报进度的阶段
+            LOG_INFO("DDL running, elapsed {}s", elapsed.count() / 1000);
+            if (m_progress) m_progress("", 0, 0, elapsed);
+        }
+    }
+
+    bool SchemaMigrator::Lock(const odb::connection_ptr &conn)
+    {
+        // 命名锁属于会话, 在同一连接上加锁与释放
+        typedef odb::query<MigrationLock> Query;
+        odb::transaction t(conn->begin());
+        MigrationLock lock(m_db->query_value<MigrationLock>(Query::_val(static_cast<long long>(m_options.lock_timeout.count()))));
+        t.commit();
+        return lock.acquired == 1;
+    }
+
+    void SchemaMigrator::Unlock(const odb::connection_ptr &conn)
+    {
+        try
+        {
+            conn->execute("DO RELEASE_LOCK('instant_social_schema_migration')");
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Release schema migration lock failed: {}", e.what());
+        }
+    }
+
+    bool SchemaMigrator::IsEmptyDatabase()
+    {
+        return !TableExists("schema_migrations") && !TableExists("message") && !TableExists("users");
+    }
+
+    void SchemaMigrator::CreateSchema()
+    {
+        odb::transaction t(m_db->begin());
+        odb::schema_catalog::create_schema(*m_db, "", false);
+        t.commit();
+    }
+
+    void SchemaMigrator::EnsureTable()
+    {
+        // 与 SchemaMigrationEntity 生成的建表语句一致, 用于在已有库上补建
+        odb::transaction t(m_db->begin());
+        m_db->execute("CREATE TABLE IF NOT EXISTS `schema_migrations` ("
+                      "`version` BIGINT UNSIGNED NOT NULL PRIMARY KEY, "
+                      "`description` VARCHAR(255) NOT NULL, "
+                      "`applied_at` TIMESTAMP(6) NULL, "
+                      "`duration_ms` BIGINT NOT NULL) ENGINE=InnoDB");
+        t.commit();
+    }
+
+    std::set<uint64_t> SchemaMigrator::AppliedVersions()
+    {
+        typedef odb::result<SchemaMigrationEntity> Result;
+        std::set<uint64_t> versions;
+        odb::transaction t(m_db->begin());
+        Result r(m_db->query<SchemaMigrationEntity>());
+        for (auto it = r.begin(); it != r.end(); ++it)
+        {
+            versions.insert(it->version());
+        }
+        t.commit();
+        return versions;
+    }
+
+    void SchemaMigrator::Record(const Migration &migration, std::chrono::milliseconds duration)
+    {
+        SchemaMigrationEntity entity(migration.version, migration.description,
+                                     boost::posix_time::microsec_clock::universal_time(), duration.count());
+        odb::transaction t(m_db->begin());
+        m_db->persist(entity);
+        t.commit();
+    }
+}
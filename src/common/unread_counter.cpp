@@ -0,0 +1,104 @@
+#include "unread_counter.h"
+#include "logger.h"
+#include <algorithm>
+#include <iterator>
+
+namespace InstantSocial
+{
+    bool UnreadCounter::OnMessage(const std::string &session_id, const std::string &sender_id)
+    {
+        if (!m_member_handler) return false;
+        auto members = m_member_handler->GetMemberListBySessionId(session_id);
+        members.erase(std::remove(members.begin(), members.end(), sender_id), members.end());
+        return Increment(session_id, members);
+    }
+
+    bool UnreadCounter::Increment(const std::string &session_id, const std::vector<std::string> &user_ids, long long delta)
+    {
+        if (user_ids.empty()) return true;
+        if (!m_client) return false;
+        try
+        {
+            std::vector<std::string> keys;
+            keys.reserve(user_ids.size());
+            for (auto &user_id : user_ids) keys.push_back(Key(user_id));
+            ExecutePipelined(*m_client, keys,
+                [&](sw::redis::Pipeline &pipe, size_t i)
+                {
+                    pipe.hincrby(keys[i], session_id, delta);
+                    return size_t(1);
+                },
+                [](sw::redis::QueuedReplies &, size_t, size_t) {});
+            LOG_DEBUG("UnreadCounter::Increment success: session_id={}, count={}", session_id, user_ids.size());
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("UnreadCounter::Increment failed: session_id={}, count={}, error={}", session_id, user_ids.size(), e.what());
+            return false;
+        }
+        return true;
+    }
+
+    bool UnreadCounter::Reset(const std::string &user_id, const std::string &session_id)
+    {
+        if (!m_client) return false;
+        try
+        {
+            std::string key = Key(user_id);
+            m_client->Execute([&](auto &r) { r.hdel(key, session_id); });
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("UnreadCounter::Reset failed: user_id={}, session_id={}, error={}", user_id, session_id, e.what());
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<long long> UnreadCounter::Get(const std::string &user_id, const std::vector<std::string> &session_ids)
+    {
+        std::vector<long long> counts(session_ids.size(), 0);
+        if (session_ids.empty() || !m_client) return counts;
+        try
+        {
+            std::string key = Key(user_id);
+            std::vector<sw::redis::OptionalString> values;
+            values.reserve(session_ids.size());
+            m_client->Execute([&](auto &r)
+            {
+                r.hmget(key, session_ids.begin(), session_ids.end(), std::back_inserter(values));
+            });
+            for (size_t i = 0; i < values.size() && i < counts.size(); ++i)
+            {
+                if (values[i]) counts[i] = std::stoll(*values[i]);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("UnreadCounter::Get failed: user_id={}, count={}, error={}", user_id, session_ids.size(), e.what());
+        }
+        return counts;
+    }
+
+    std::unordered_map<std::string, long long> UnreadCounter::GetAll(const std::string &user_id)
+    {
+        std::unordered_map<std::string, long long> counts;
+        if (!m_client) return counts;
+        try
+        {
+            std::string key = Key(user_id);
+            std::unordered_map<std::string, std::string> values;
+            m_client->Execute([&](auto &r) { r.hgetall(key, std::inserter(values, values.end())); });
+            for (auto &kv : values)
+            {
+                long long count = std::stoll(kv.second);
+                if (count != 0) counts.emplace(kv.first, count);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("UnreadCounter::GetAll failed: user_id={}, error={}", user_id, e.what());
+        }
+        return counts;
+    }
+}
@@ -0,0 +1,208 @@
+#include "user_cache.h"
+
+namespace InstantSocial
+{
+    namespace
+    {
+        // 链表节点、哈希桶与 shared_ptr 控制块的大致开销
+        constexpr size_t kEntryOverhead = 96;
+
+        template <typename Value>
+        typename ShardedLruCache<std::string, Value>::Options CacheOptions(const UserCacheOptions &options, size_t capacity)
+        {
+            typename ShardedLruCache<std::string, Value>::Options cache_options;
+            cache_options.shards = options.shards;
+            cache_options.capacity = capacity;
+            cache_options.ttl = options.ttl;
+            return cache_options;
+        }
+
+        size_t UserCharge(const std::string &key, const UserCache::User &user)
+        {
+            return kEntryOverhead + sizeof(UserEntity) + key.size() + user->user_id().size() + user->nickname().size() +
+                   user->description().size() + user->password().size() + user->phone().size() +
+                   user->email().size() + user->avatar_id().size();
+        }
+
+        size_t IndexCharge(const std::string &key, const std::string &user_id)
+        {
+            return kEntryOverhead + key.size() + user_id.size();
+        }
+    }
+
+    UserCache::UserCache(const UserCacheOptions &options)
+        : m_users(CacheOptions<User>(options, options.capacity_bytes / 4 * 3), UserCharge),
+          m_phones(CacheOptions<std::string>(options, options.capacity_bytes / 8), IndexCharge),
+          m_emails(CacheOptions<std::string>(options, options.capacity_bytes / 8), IndexCharge)
+    {
+        ExposeMetrics(options.metrics_prefix);
+    }
+
+    bool UserCache::GetById(const std::string &user_id, User &user)
+    {
+        return m_users.Get(user_id, user) ? Hit() : Miss();
+    }
+
+    bool UserCache::GetByPhone(const std::string &phone, User &user, std::string &user_id)
+    {
+        return GetByIndex(m_phones, phone, &UserEntity::phone, user, user_id);
+    }
+
+    bool UserCache::GetByEmail(const std::string &email, User &user, std::string &user_id)
+    {
+        return GetByIndex(m_emails, email, &UserEntity::email, user, user_id);
+    }
+
+    bool UserCache::GetByIndex(IndexCache &index, const std::string &key, std::string (UserEntity::*field)() const, User &user,
+                               std::string &user_id)
+    {
+        user_id.clear();
+        if (!index.Get(key, user_id)) return Miss();
+        User cached;
+        if (!m_users.Get(user_id, cached)) return Miss();
+        if (((*cached).*field)() != key)
+        {
+            // 该用户已改用其他手机号/邮箱
+            index.Erase(key);
+            user_id.clear();
+            return Miss();
+        }
+        user = cached;
+        return Hit();
+    }
+
+    void UserCache::Fill(const UserEntity &user, uint64_t epoch)
+    {
+        // 检查 epoch 与写入在同一把分片锁内完成
+        if (!m_users.Put(user.user_id(), std::make_shared<const UserEntity>(user), epoch))
+        {
+            if (m_metrics) m_metrics->stale_fills << 1;
+        }
+        FillIndexes(user);
+    }
+
+    void UserCache::FillIndexes(const UserEntity &user)
+    {
+        if (!user.phone().empty()) m_phones.Put(user.phone(), user.user_id());
+        if (!user.email().empty()) m_emails.Put(user.email(), user.user_id());
+    }
+
+    void UserCache::Invalidate(const std::string &user_id)
+    {
+        m_users.Erase(user_id);
+        if (m_metrics) m_metrics->invalidations << 1;
+    }
+
+    void UserCache::Clear()
+    {
+        m_users.Clear();
+        m_phones.Clear();
+        m_emails.Clear();
+        if (m_metrics) m_metrics->invalidations << 1;
+    }
+
+    bool UserCache::Hit()
+    {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool UserCache::Miss()
+    {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    double UserCache::ShardHitRate(size_t shard) const
+    {
+        auto stats = m_users.ShardStatsAt(shard);
+        uint64_t total = stats.hits + stats.misses;
+        return total == 0 ? 0.0 : static_cast<double>(stats.hits) / total;
+    }
+
+    int64_t UserCache::ShardBytes(size_t shard) const
+    {
+        return static_cast<int64_t>(m_users.ShardStatsAt(shard).charge);
+    }
+
+    int64_t UserCache::IndexBytes(const IndexCache &index)
+    {
+        int64_t bytes = 0;
+        for (size_t i = 0; i < index.ShardCount(); ++i)
+        {
+            bytes += static_cast<int64_t>(index.ShardStatsAt(i).charge);
+        }
+        return bytes;
+    }
+
+    UserCache::ShardMetrics::ShardMetrics(UserCache *cache, size_t shard)
+        : cache(cache), shard(shard), hit_rate(GetShardHitRate, this), bytes(GetShardBytes, this)
+    {
+    }
+
+    UserCache::Metrics::Metrics(UserCache *cache)
+        : hit_rate(GetHitRate, cache), bytes(GetBytes, cache),
+          phone_index_bytes(GetPhoneIndexBytes, cache), email_index_bytes(GetEmailIndexBytes, cache)
+    {
+    }
+
+    void UserCache::ExposeMetrics(const std::string &prefix)
+    {
+        if (prefix.empty()) return;
+        m_metrics = std::make_unique<Metrics>(this);
+        m_metrics->hit_rate.expose_as(prefix, "hit_rate");
+        m_metrics->bytes.expose_as(prefix, "bytes");
+        m_metrics->phone_index_bytes.expose_as(prefix, "phone_index_bytes");
+        m_metrics->email_index_bytes.expose_as(prefix, "email_index_bytes");
+        m_metrics->invalidations.expose_as(prefix, "invalidations");
+        m_metrics->stale_fills.expose_as(prefix, "stale_fills");
+        for (size_t i = 0; i < ShardCount(); ++i)
+        {
+            auto shard = std::make_unique<ShardMetrics>(this, i);
+            shard->hit_rate.expose_as(prefix, "shard" + std::to_string(i) + "_hit_rate");
+            shard->bytes.expose_as(prefix, "shard" + std::to_string(i) + "_bytes");
+            m_metrics->shards.push_back(std::move(shard));
+        }
+    }
+
+    double UserCache::GetHitRate(void *arg)
+    {
+        auto cache = static_cast<UserCache *>(arg);
+        uint64_t hits = cache->m_hits.load(std::memory_order_relaxed);
+        uint64_t total = hits + cache->m_misses.load(std::memory_order_relaxed);
+        return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+    }
+
+    int64_t UserCache::GetBytes(void *arg)
+    {
+        auto cache = static_cast<UserCache *>(arg);
+        int64_t bytes = 0;
+        for (size_t i = 0; i < cache->ShardCount(); ++i)
+        {
+            bytes += cache->ShardBytes(i);
+        }
+        return bytes + cache->PhoneIndexBytes() + cache->EmailIndexBytes();
+    }
+
+    int64_t UserCache::GetPhoneIndexBytes(void *arg)
+    {
+        return static_cast<UserCache *>(arg)->PhoneIndexBytes();
+    }
+
+    int64_t UserCache::GetEmailIndexBytes(void *arg)
+    {
+        return static_cast<UserCache *>(arg)->EmailIndexBytes();
+    }
+
+    double UserCache::GetShardHitRate(void *arg)
+    {
+        auto metrics = static_cast<ShardMetrics *>(arg);
+        return metrics->cache->ShardHitRate(metrics->shard);
+    }
+
+    int64_t UserCache::GetShardBytes(void *arg)
+    {
+        auto metrics = static_cast<ShardMetrics *>(arg);
+        return metrics->cache->ShardBytes(metrics->shard);
+    }
+}
@@ -0,0 +1,125 @@
+#include "db_executor.h"
+#include "async_handler.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        // 模拟 handler 的同步接口
+        class FakeHandler
+        {
+        public:
+            std::shared_ptr<std::string> Get(const std::string &id)
+            {
+                ++calls;
+                return std::make_shared<std::string>("user:" + id);
+            }
+            bool Insert(const std::string &id, int value)
+            {
+                ++calls;
+                return !id.empty() && value > 0;
+            }
+
+            std::atomic<int> calls{0};
+        };
+
+        DbExecutorOptions TestOptions(size_t threads, size_t capacity)
+        {
+            DbExecutorOptions options;
+            options.threads = threads;
+            options.queue_capacity = capacity;
+            options.metrics_prefix = "";
+            return options;
+        }
+    }
+
+    class DbExecutorTest : public ::testing::Test
+    {
+    protected:
+        static void SetUpTestSuite()
+        {
+            init_logger(false, "test_logs.txt", 0);
+        }
+    };
+
+    TEST_F(DbExecutorTest, CallAndThenReturnHandlerResult)
+    {
+        auto executor = std::make_shared<DbExecutor>(TestOptions(2, 16));
+        auto handler = std::make_shared<FakeHandler>();
+        AsyncHandler<FakeHandler> async(handler, executor);
+
+        std::string id = "u1";
+        auto user = async.Call(&FakeHandler::Get, id);
+        EXPECT_TRUE(async.Call(&FakeHandler::Insert, std::string("u2"), 3).get());
+        ASSERT_NE(user.get(), nullptr);
+
+        std::promise<bool> inserted;
+        async.Then([&](bool ok) { inserted.set_value(ok); }, &FakeHandler::Insert, std::string("u3"), 0);
+        EXPECT_FALSE(inserted.get_future().get());
+        EXPECT_EQ(handler->calls.load(), 3);
+    }
+
+    TEST_F(DbExecutorTest, RejectsWhenQueueIsFull)
+    {
+        DbExecutor executor(TestOptions(1, 1));
+        std::promise<void> release;
+        std::shared_future<void> released(release.get_future());
+        std::promise<void> started;
+
+        // 占住唯一的线程, 再排入一个调用把队列占满
+        auto blocking = executor.Submit([&]() { started.set_value(); released.wait(); return true; });
+        started.get_future().wait();
+        auto queued = executor.Submit([]() { return 1; });
+        EXPECT_EQ(executor.Queued(), 1u);
+
+        bool called = false;
+        int rejected = -1;
+        executor.Dispatch([&]() { called = true; return 2; }, [&](int result) { rejected = result; });
+        EXPECT_EQ(rejected, 0);
+        EXPECT_FALSE(called);
+
+        release.set_value();
+        EXPECT_TRUE(blocking.get());
+        EXPECT_EQ(queued.get(), 1);
+    }
+
+    TEST_F(DbExecutorTest, DropsCallsPastDeadline)
+    {
+        DbExecutor executor(TestOptions(1, 16));
+        std::promise<void> release;
+        std::shared_future<void> released(release.get_future());
+        std::promise<void> started;
+
+        auto blocking = executor.Submit([&]() { started.set_value(); released.wait(); return true; });
+        started.get_future().wait();
+        std::atomic<bool> called{false};
+        auto expired = executor.Submit([&]() { called = true; return std::vector<int>{1, 2}; }, std::chrono::milliseconds(10));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        release.set_value();
+
+        EXPECT_TRUE(expired.get().empty());
+        EXPECT_FALSE(called.load());
+        EXPECT_TRUE(blocking.get());
+    }
+
+    TEST_F(DbExecutorTest, StopRunsQueuedCallsThenRejects)
+    {
+        DbExecutor executor(TestOptions(1, 16));
+        std::vector<std::future<int>> results;
+        for (int i = 1; i <= 5; ++i)
+        {
+            results.push_back(executor.Submit([i]() { return i; }, std::chrono::seconds(10)));
+        }
+        executor.Stop();
+        for (int i = 1; i <= 5; ++i)
+        {
+            EXPECT_EQ(results[i - 1].get(), i);
+        }
+        EXPECT_EQ(executor.Submit([]() { return 7; }).get(), 0);
+    }
+}
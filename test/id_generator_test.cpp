@@ -0,0 +1,89 @@
+#include "id_generator.h"
+#include "logger.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InstantSocial
+{
+    class IdGeneratorTest : public ::testing::Test
+    {
+    protected:
+        static void SetUpTestSuite()
+        {
+            init_logger(false, "test_logs.txt", 0);
+        }
+    };
+
+    TEST_F(IdGeneratorTest, IdsIncreaseAndCarryWorker)
+    {
+        IdGenerator ids(37);
+        uint64_t last = 0;
+        // 超过单毫秒 4096 个, 覆盖序号用完后等待下一毫秒
+        for (int i = 0; i < 10000; ++i)
+        {
+            uint64_t id = ids.Next();
+            ASSERT_GT(id, last);
+            EXPECT_EQ(IdGenerator::WorkerOf(id), 37u);
+            last = id;
+        }
+        int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        EXPECT_LE(ids.TimestampOf(last), now_ms);
+        EXPECT_GT(ids.TimestampOf(last), now_ms - 5000);
+    }
+
+    TEST_F(IdGeneratorTest, UniqueAcrossThreads)
+    {
+        auto ids = std::make_shared<IdGenerator>(1);
+        const int threads = 8, per_thread = 5000;
+        std::mutex mutex;
+        std::set<uint64_t> seen;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&]() {
+                std::vector<uint64_t> local;
+                for (int i = 0; i < per_thread; ++i) local.push_back(ids->Next());
+                std::lock_guard<std::mutex> lock(mutex);
+                seen.insert(local.begin(), local.end());
+            });
+        }
+        for (auto &w : workers) w.join();
+        EXPECT_EQ(seen.size(), static_cast<size_t>(threads * per_thread));
+        EXPECT_EQ(seen.count(0), 0u);
+    }
+
+    TEST_F(IdGeneratorTest, StringFormRoundTripsAndSorts)
+    {
+        IdGenerator ids(2);
+        uint64_t a = ids.Next(), b = ids.Next();
+        std::string sa = IdGenerator::ToString(a), sb = IdGenerator::ToString(b);
+        EXPECT_EQ(sa.size(), 16u);
+        EXPECT_LT(sa, sb);
+
+        uint64_t parsed = 0;
+        ASSERT_TRUE(IdGenerator::FromString(sa, parsed));
+        EXPECT_EQ(parsed, a);
+        EXPECT_EQ(IdGenerator::ToString(1), "0000000000000001");
+        EXPECT_FALSE(IdGenerator::FromString("123", parsed));
+        EXPECT_FALSE(IdGenerator::FromString("000000000000000G", parsed));
+        EXPECT_FALSE(IdGenerator::FromString("00000000000000AB", parsed));
+    }
+
+    TEST_F(IdGeneratorTest, RejectsInvalidWorkerAndLostLease)
+    {
+        EXPECT_THROW(IdGenerator(IdGenerator::kMaxWorkerId + 1), std::invalid_argument);
+
+        std::atomic<bool> alive{true};
+        IdGenerator ids(3, IdGeneratorOptions(), [&alive]() { return alive.load(); });
+        EXPECT_NE(ids.Next(), 0u);
+        alive = false;
+        EXPECT_EQ(ids.Next(), 0u);
+    }
+}
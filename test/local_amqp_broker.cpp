@@ -0,0 +1,898 @@
+#include "local_amqp_broker.h"
+#include "logger.h"
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <cstring>
+#include <algorithm>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        constexpr uint8_t kFrameMethod = 1;
+        constexpr uint8_t kFrameHeader = 2;
+        constexpr uint8_t kFrameBody = 3;
+        constexpr uint8_t kFrameHeartbeat = 8;
+        constexpr uint8_t kFrameEnd = 0xCE;
+        constexpr uint32_t kFrameMax = 131072;
+
+        constexpr uint32_t Method(uint16_t class_id, uint16_t method_id)
+        {
+            return (static_cast<uint32_t>(class_id) << 16) | method_id;
+        }
+
+        // AMQP 字段均为网络字节序
+        class Writer
+        {
+        public:
+            Writer &Octet(uint8_t v) { m_buf.push_back(static_cast<char>(v)); return *this; }
+            Writer &Short(uint16_t v) { Octet(v >> 8); return Octet(v & 0xFF); }
+            Writer &Long(uint32_t v) { Short(v >> 16); return Short(v & 0xFFFF); }
+            Writer &LongLong(uint64_t v) { Long(static_cast<uint32_t>(v >> 32)); return Long(static_cast<uint32_t>(v)); }
+            Writer &ShortStr(const std::string &s)
+            {
+                size_t n = std::min<size_t>(s.size(), 255);
+                Octet(static_cast<uint8_t>(n));
+                m_buf.append(s, 0, n);
+                return *this;
+            }
+            Writer &LongStr(const std::string &s) { Long(static_cast<uint32_t>(s.size())); m_buf += s; return *this; }
+            Writer &EmptyTable() { return Long(0); }
+            const std::string &Data() const { return m_buf; }
+
+        private:
+            std::string m_buf;
+        };
+
+        class Reader
+        {
+        public:
+            explicit Reader(const std::string &buf, size_t pos = 0) : m_buf(buf), m_pos(pos) {}
+
+            uint8_t Octet()
+            {
+                if (!Need(1)) return 0;
+                return static_cast<uint8_t>(m_buf[m_pos++]);
+            }
+            uint16_t Short()
+            {
+                uint16_t hi = Octet();
+                return static_cast<uint16_t>((hi << 8) | Octet());
+            }
+            uint32_t Long()
+            {
+                uint32_t hi = Short();
+                return (hi << 16) | Short();
+            }
+            uint64_t LongLong()
+            {
+                uint64_t hi = Long();
+                return (hi << 32) | Long();
+            }
+            std::string ShortStr() { return Bytes(Octet()); }
+            std::string LongStr() { return Bytes(Long()); }
+            void SkipTable() { Bytes(Long()); }
+            bool Ok() const { return m_ok; }
+
+        private:
+            bool Need(size_t n)
+            {
+                if (!m_ok || m_pos + n > m_buf.size())
+                {
+                    m_ok = false;
+                    return false;
+                }
+                return true;
+            }
+            std::string Bytes(size_t n)
+            {
+                if (!Need(n)) return std::string();
+                std::string s = m_buf.substr(m_pos, n);
+                m_pos += n;
+                return s;
+            }
+
+        private:
+            const std::string &m_buf;
+            size_t m_pos;
+            bool m_ok = true;
+        };
+
+        void SetNonBlocking(int fd)
+        {
+            int flags = ::fcntl(fd, F_GETFL, 0);
+            ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        }
+
+        std::vector<std::string> SplitWords(const std::string &key)
+        {
+            std::vector<std::string> words;
+            size_t start = 0;
+            while (true)
+            {
+                size_t pos = key.find('.', start);
+                words.push_back(key.substr(start, pos - start));
+                if (pos == std::string::npos) break;
+                start = pos + 1;
+            }
+            return words;
+        }
+
+        bool MatchWords(const std::vector<std::string> &p, size_t pi, const std::vector<std::string> &k, size_t ki)
+        {
+            if (pi == p.size()) return ki == k.size();
+            if (p[pi] == "#")
+            {
+                for (size_t skip = ki; skip <= k.size(); ++skip)
+                {
+                    if (MatchWords(p, pi + 1, k, skip)) return true;
+                }
+                return false;
+            }
+            if (ki == k.size()) return false;
+            if (p[pi] != "*" && p[pi] != k[ki]) return false;
+            return MatchWords(p, pi + 1, k, ki + 1);
+        }
+    }
+
+    LocalAmqpBroker::~LocalAmqpBroker()
+    {
+        Stop();
+    }
+
+    uint16_t LocalAmqpBroker::Start(uint16_t port)
+    {
+        if (m_running) return m_port;
+
+        m_listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listen_fd < 0)
+        {
+            LOG_ERROR("LocalAmqpBroker create socket failed: {}", strerror(errno));
+            return 0;
+        }
+        int on = 1;
+        ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        socklen_t len = sizeof(addr);
+        if (::bind(m_listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+            ::listen(m_listen_fd, 128) < 0 ||
+            ::getsockname(m_listen_fd, reinterpret_cast<sockaddr *>(&addr), &len) < 0 ||
+            ::pipe(m_wakeup_fd) < 0)
+        {
+            LOG_ERROR("LocalAmqpBroker listen on port {} failed: {}", port, strerror(errno));
+            ::close(m_listen_fd);
+            m_listen_fd = -1;
+            return 0;
+        }
+        SetNonBlocking(m_listen_fd);
+        SetNonBlocking(m_wakeup_fd[0]);
+        m_port = ntohs(addr.sin_port);
+
+        m_running = true;
+        m_thread = std::thread(&LocalAmqpBroker::Run, this);
+        LOG_INFO("LocalAmqpBroker listening on 127.0.0.1:{}", m_port);
+        return m_port;
+    }
+
+    void LocalAmqpBroker::Stop()
+    {
+        if (!m_running.exchange(false)) return;
+
+        char c = 0;
+        (void)::write(m_wakeup_fd[1], &c, 1);
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &kv : m_connections)
+        {
+            ::close(kv.first);
+        }
+        m_connections.clear();
+        m_exchanges.clear();
+        m_queues.clear();
+        ::close(m_listen_fd);
+        ::close(m_wakeup_fd[0]);
+        ::close(m_wakeup_fd[1]);
+        m_listen_fd = m_wakeup_fd[0] = m_wakeup_fd[1] = -1;
+    }
+
+    int64_t LocalAmqpBroker::QueueDepth(const std::string &queue)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_queues.find(queue);
+        if (it == m_queues.end()) return -1;
+        return static_cast<int64_t>(it->second.messages.size());
+    }
+
+    void LocalAmqpBroker::Run()
+    {
+        std::vector<pollfd> fds;
+        while (m_running)
+        {
+            fds.clear();
+            fds.push_back({m_listen_fd, POLLIN, 0});
+            fds.push_back({m_wakeup_fd[0], POLLIN, 0});
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto &kv : m_connections)
+                {
+                    short events = POLLIN;
+                    if (!kv.second->out.empty()) events |= POLLOUT;
+                    fds.push_back({kv.first, events, 0});
+                }
+            }
+
+            int n = ::poll(fds.data(), fds.size(), 100);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                LOG_ERROR("LocalAmqpBroker poll failed: {}", strerror(errno));
+                break;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (fds[0].revents & POLLIN)
+            {
+                int fd;
+                while ((fd = ::accept(m_listen_fd, nullptr, nullptr)) >= 0)
+                {
+                    SetNonBlocking(fd);
+                    int on = 1;
+                    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                    auto conn = std::make_unique<Connection>();
+                    conn->fd = fd;
+                    m_connections[fd] = std::move(conn);
+                }
+            }
+            if (fds[1].revents & POLLIN)
+            {
+                char buf[64];
+                while (::read(m_wakeup_fd[0], buf, sizeof(buf)) > 0) {}
+            }
+
+            for (size_t i = 2; i < fds.size(); ++i)
+            {
+                auto it = m_connections.find(fds[i].fd);
+                if (it == m_connections.end()) continue;
+                Connection &conn = *it->second;
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+                {
+                    OnReadable(conn);
+                }
+                if (fds[i].revents & POLLNVAL)
+                {
+                    conn.dead = true;
+                }
+            }
+
+            Dispatch();
+
+            std::vector<int> to_close;
+            for (auto &kv : m_connections)
+            {
+                Connection &conn = *kv.second;
+                if (!conn.dead && !conn.out.empty())
+                {
+                    OnWritable(conn);
+                }
+                if (conn.dead || (conn.closing && conn.out.empty()))
+                {
+                    to_close.push_back(kv.first);
+                }
+            }
+            for (int fd : to_close)
+            {
+                CloseConnection(fd);
+            }
+        }
+    }
+
+    void LocalAmqpBroker::OnReadable(Connection &conn)
+    {
+        char buf[65536];
+        while (true)
+        {
+            ssize_t n = ::read(conn.fd, buf, sizeof(buf));
+            if (n > 0)
+            {
+                conn.in.append(buf, n);
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                conn.dead = true;
+            }
+            break;
+        }
+
+        if (!conn.handshake)
+        {
+            if (conn.in.size() < 8) return;
+            if (conn.in.compare(0, 4, "AMQP") != 0)
+            {
+                conn.dead = true;
+                return;
+            }
+            conn.in.erase(0, 8);
+            conn.handshake = true;
+
+            // connection.start: version 0-9, 空 server-properties
+            Writer w;
+            w.Octet(0).Octet(9).EmptyTable().LongStr("PLAIN AMQPLAIN").LongStr("en_US");
+            SendMethod(conn, 0, 10, 10, w.Data());
+        }
+
+        size_t pos = 0;
+        while (!conn.dead && conn.in.size() - pos >= 7)
+        {
+            Reader r(conn.in, pos);
+            uint8_t type = r.Octet();
+            uint16_t channel = r.Short();
+            uint32_t size = r.Long();
+            if (conn.in.size() - pos < static_cast<size_t>(size) + 8) break;
+            if (static_cast<uint8_t>(conn.in[pos + 7 + size]) != kFrameEnd)
+            {
+                LOG_ERROR("LocalAmqpBroker bad frame end on fd {}", conn.fd);
+                conn.dead = true;
+                return;
+            }
+            std::string payload = conn.in.substr(pos + 7, size);
+            pos += static_cast<size_t>(size) + 8;
+            HandleFrame(conn, type, channel, payload);
+        }
+        conn.in.erase(0, pos);
+    }
+
+    void LocalAmqpBroker::OnWritable(Connection &conn)
+    {
+        while (!conn.out.empty())
+        {
+            ssize_t n = ::send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                conn.out.erase(0, n);
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) break;
+            conn.dead = true;
+            break;
+        }
+    }
+
+    void LocalAmqpBroker::CloseConnection(int fd)
+    {
+        auto it = m_connections.find(fd);
+        if (it == m_connections.end()) return;
+        Connection &conn = *it->second;
+        while (!conn.channels.empty())
+        {
+            CloseChannel(conn, conn.channels.begin()->first);
+        }
+        ::close(fd);
+        m_connections.erase(it);
+    }
+
+    void LocalAmqpBroker::HandleFrame(Connection &conn, uint8_t type, uint16_t channel, const std::string &payload)
+    {
+        if (type == kFrameMethod)
+        {
+            HandleMethod(conn, channel, payload);
+            return;
+        }
+        if (type == kFrameHeartbeat) return;
+
+        auto it = conn.channels.find(channel);
+        if (it == conn.channels.end() || !it->second.publishing) return;
+        Channel &ch = it->second;
+
+        if (type == kFrameHeader)
+        {
+            Reader r(payload);
+            r.Short();  // class-id
+            r.Short();  // weight
+            ch.pending_size = r.LongLong();
+            ch.pending.header = payload;
+        }
+        else if (type == kFrameBody)
+        {
+            ch.pending.body += payload;
+        }
+
+        if (!ch.pending.header.empty() && ch.pending.body.size() >= ch.pending_size)
+        {
+            ch.publishing = false;
+            Route(std::move(ch.pending));
+            ch.pending = Message();
+            if (ch.confirm)
+            {
+                Writer w;
+                w.LongLong(++ch.publish_seq).Octet(0);
+                SendMethod(conn, channel, 60, 80, w.Data());
+            }
+        }
+    }
+
+    void LocalAmqpBroker::HandleMethod(Connection &conn, uint16_t channel, const std::string &payload)
+    {
+        Reader r(payload);
+        uint16_t class_id = r.Short();
+        uint16_t method_id = r.Short();
+        uint32_t method = Method(class_id, method_id);
+
+        // connection 类方法只出现在 0 号信道
+        switch (method)
+        {
+            case Method(10, 11):    // connection.start-ok
+            {
+                Writer w;
+                w.Short(2047).Long(kFrameMax).Short(0);
+                SendMethod(conn, 0, 10, 30, w.Data());
+                return;
+            }
+            case Method(10, 31):    // connection.tune-ok
+            {
+                r.Short();
+                uint32_t frame_max = r.Long();
+                if (frame_max != 0 && frame_max < conn.frame_max) conn.frame_max = frame_max;
+                return;
+            }
+            case Method(10, 40):    // connection.open
+                SendMethod(conn, 0, 10, 41, Writer().ShortStr("").Data());
+                return;
+            case Method(10, 50):    // connection.close
+                while (!conn.channels.empty())
+                {
+                    CloseChannel(conn, conn.channels.begin()->first);
+                }
+                SendMethod(conn, 0, 10, 51);
+                conn.closing = true;
+                return;
+            case Method(10, 51):    // connection.close-ok
+                conn.dead = true;
+                return;
+            case Method(20, 10):    // channel.open
+                conn.channels[channel] = Channel();
+                SendMethod(conn, channel, 20, 11, Writer().LongStr("").Data());
+                return;
+            default:
+                break;
+        }
+
+        auto cit = conn.channels.find(channel);
+        if (cit == conn.channels.end())
+        {
+            // 已关闭的信道上的后续帧直接丢弃(包括 channel.close-ok)
+            return;
+        }
+        Channel &ch = cit->second;
+
+        switch (method)
+        {
+            case Method(20, 40):    // channel.close
+                CloseChannel(conn, channel);
+                SendMethod(conn, channel, 20, 41);
+                break;
+            case Method(40, 10):    // exchange.declare
+            {
+                r.Short();
+                std::string name = r.ShortStr();
+                std::string type = r.ShortStr();
+                uint8_t bits = r.Octet();
+                r.SkipTable();
+                bool passive = bits & 0x01;
+                bool no_wait = bits & 0x10;
+                if (!name.empty() && m_exchanges.find(name) == m_exchanges.end())
+                {
+                    if (passive)
+                    {
+                        ChannelError(conn, channel, 404, "NOT_FOUND - no exchange '" + name + "'", 40, 10);
+                        break;
+                    }
+                    m_exchanges[name].type = type;
+                }
+                if (!no_wait) SendMethod(conn, channel, 40, 11);
+                break;
+            }
+            case Method(40, 20):    // exchange.delete
+            {
+                r.Short();
+                std::string name = r.ShortStr();
+                uint8_t bits = r.Octet();
+                m_exchanges.erase(name);
+                if (!(bits & 0x02)) SendMethod(conn, channel, 40, 21);
+                break;
+            }
+            case Method(50, 10):    // queue.declare
+            {
+                r.Short();
+                std::string name = r.ShortStr();
+                uint8_t bits = r.Octet();
+                r.SkipTable();
+                bool passive = bits & 0x01;
+                bool no_wait = bits & 0x10;
+                if (name.empty()) name = "amq.gen-" + std::to_string(++m_name_seq);
+                auto qit = m_queues.find(name);
+                if (qit == m_queues.end())
+                {
+                    if (passive)
+                    {
+                        ChannelError(conn, channel, 404, "NOT_FOUND - no queue '" + name + "'", 50, 10);
+                        break;
+                    }
+                    qit = m_queues.emplace(name, Queue()).first;
+                }
+                if (!no_wait)
+                {
+                    Writer w;
+                    w.ShortStr(name)
+                     .Long(static_cast<uint32_t>(qit->second.messages.size()))
+                     .Long(static_cast<uint32_t>(qit->second.consumers.size()));
+                    SendMethod(conn, channel, 50, 11, w.Data());
+                }
+                break;
+            }
+            case Method(50, 20):    // queue.bind
+            {
+                r.Short();
+                std::string queue = r.ShortStr();
+                std::string exchange = r.ShortStr();
+                std::string key = r.ShortStr();
+                uint8_t bits = r.Octet();
+                r.SkipTable();
+                auto eit = m_exchanges.find(exchange);
+                if (m_queues.find(queue) == m_queues.end() || eit == m_exchanges.end())
+                {
+                    ChannelError(conn, channel, 404, "NOT_FOUND - no queue or exchange", 50, 20);
+                    break;
+                }
+                auto &bindings = eit->second.bindings;
+                bool exists = std::any_of(bindings.begin(), bindings.end(), [&](const Binding &b)
+                {
+                    return b.queue == queue && b.routing_key == key;
+                });
+                if (!exists) bindings.push_back(Binding{queue, key});
+                if (!(bits & 0x01)) SendMethod(conn, channel, 50, 21);
+                break;
+            }
+            case Method(50, 50):    // queue.unbind
+            {
+                r.Short();
+                std::string queue = r.ShortStr();
+                std::string exchange = r.ShortStr();
+                std::string key = r.ShortStr();
+                auto eit = m_exchanges.find(exchange);
+                if (eit != m_exchanges.end())
+                {
+                    auto &bindings = eit->second.bindings;
+                    bindings.erase(std::remove_if(bindings.begin(), bindings.end(), [&](const Binding &b)
+                    {
+                        return b.queue == queue && b.routing_key == key;
+                    }), bindings.end());
+                }
+                SendMethod(conn, channel, 50, 51);
+                break;
+            }
+            case Method(50, 30):    // queue.purge
+            {
+                r.Short();
+                std::string queue = r.ShortStr();
+                uint8_t bits = r.Octet();
+                uint32_t count = 0;
+                auto qit = m_queues.find(queue);
+                if (qit != m_queues.end())
+                {
+                    count = static_cast<uint32_t>(qit->second.messages.size());
+                    qit->second.messages.clear();
+                }
+                if (!(bits & 0x01)) SendMethod(conn, channel, 50, 31, Writer().Long(count).Data());
+                break;
+            }
+            case Method(50, 40):    // queue.delete
+            {
+                r.Short();
+                std::string queue = r.ShortStr();
+                uint8_t bits = r.Octet();
+                uint32_t count = 0;
+                auto qit = m_queues.find(queue);
+                if (qit != m_queues.end())
+                {
+                    count = static_cast<uint32_t>(qit->second.messages.size());
+                    m_queues.erase(qit);
+                }
+                for (auto &kv : m_exchanges)
+                {
+                    auto &bindings = kv.second.bindings;
+                    bindings.erase(std::remove_if(bindings.begin(), bindings.end(), [&](const Binding &b)
+                    {
+                        return b.queue == queue;
+                    }), bindings.end());
+                }
+                if (!(bits & 0x04)) SendMethod(conn, channel, 50, 41, Writer().Long(count).Data());
+                break;
+            }
+            case Method(60, 10):    // basic.qos
+            {
+                r.Long();
+                ch.prefetch = r.Short();
+                SendMethod(conn, channel, 60, 11);
+                break;
+            }
+            case Method(60, 20):    // basic.consume
+            {
+                r.Short();
+                std::string queue = r.ShortStr();
+                std::string tag = r.ShortStr();
+                uint8_t bits = r.Octet();
+                r.SkipTable();
+                auto qit = m_queues.find(queue);
+                if (qit == m_queues.end())
+                {
+                    ChannelError(conn, channel, 404, "NOT_FOUND - no queue '" + queue + "'", 60, 20);
+                    break;
+                }
+                if (tag.empty()) tag = "amq.ctag-" + std::to_string(++m_name_seq);
+                qit->second.consumers.push_back(Consumer{conn.fd, channel, tag, (bits & 0x02) != 0});
+                if (!(bits & 0x08)) SendMethod(conn, channel, 60, 21, Writer().ShortStr(tag).Data());
+                break;
+            }
+            case Method(60, 30):    // basic.cancel
+            {
+                std::string tag = r.ShortStr();
+                uint8_t bits = r.Octet();
+                for (auto &kv : m_queues)
+                {
+                    auto &consumers = kv.second.consumers;
+                    consumers.erase(std::remove_if(consumers.begin(), consumers.end(), [&](const Consumer &c)
+                    {
+                        return c.fd == conn.fd && c.channel == channel && c.tag == tag;
+                    }), consumers.end());
+                }
+                if (!(bits & 0x01)) SendMethod(conn, channel, 60, 31, Writer().ShortStr(tag).Data());
+                break;
+            }
+            case Method(60, 40):    // basic.publish, 随后是 content header 与 body 帧
+            {
+                r.Short();
+                ch.publishing = true;
+                ch.pending = Message();
+                ch.pending.exchange = r.ShortStr();
+                ch.pending.routing_key = r.ShortStr();
+                ch.pending_size = 0;
+                break;
+            }
+            case Method(60, 80):    // basic.ack
+            {
+                uint64_t tag = r.LongLong();
+                bool multiple = r.Octet() & 0x01;
+                if (multiple)
+                {
+                    auto end = tag == 0 ? ch.unacked.end() : ch.unacked.upper_bound(tag);
+                    ch.unacked.erase(ch.unacked.begin(), end);
+                }
+                else
+                {
+                    ch.unacked.erase(tag);
+                }
+                break;
+            }
+            case Method(60, 90):    // basic.reject
+            case Method(60, 120):   // basic.nack
+            {
+                uint64_t tag = r.LongLong();
+                uint8_t bits = r.Octet();
+                bool multiple = method == Method(60, 120) && (bits & 0x01);
+                bool requeue = method == Method(60, 120) ? (bits & 0x02) : (bits & 0x01);
+                auto begin = multiple ? ch.unacked.begin() : ch.unacked.find(tag);
+                auto end = multiple ? (tag == 0 ? ch.unacked.end() : ch.unacked.upper_bound(tag))
+                                    : (begin == ch.unacked.end() ? begin : std::next(begin));
+                std::vector<Unacked> rejected;
+                for (auto it = begin; it != end; ++it)
+                {
+                    rejected.push_back(std::move(it->second));
+                }
+                ch.unacked.erase(begin, end);
+                if (requeue)
+                {
+                    for (auto it = rejected.rbegin(); it != rejected.rend(); ++it)
+                    {
+                        Requeue(std::move(*it));
+                    }
+                }
+                break;
+            }
+            case Method(60, 110):   // basic.recover
+            {
+                for (auto it = ch.unacked.rbegin(); it != ch.unacked.rend(); ++it)
+                {
+                    Requeue(std::move(it->second));
+                }
+                ch.unacked.clear();
+                SendMethod(conn, channel, 60, 111);
+                break;
+            }
+            case Method(85, 10):    // confirm.select
+            {
+                uint8_t bits = r.Octet();
+                ch.confirm = true;
+                if (!(bits & 0x01)) SendMethod(conn, channel, 85, 11);
+                break;
+            }
+            default:
+                LOG_WARN("LocalAmqpBroker unsupported method {}.{} on channel {}", class_id, method_id, channel);
+                break;
+        }
+
+        if (!r.Ok())
+        {
+            LOG_ERROR("LocalAmqpBroker malformed method {}.{} on fd {}", class_id, method_id, conn.fd);
+            conn.dead = true;
+        }
+    }
+
+    void LocalAmqpBroker::CloseChannel(Connection &conn, uint16_t channel)
+    {
+        auto it = conn.channels.find(channel);
+        if (it == conn.channels.end()) return;
+
+        for (auto &kv : m_queues)
+        {
+            auto &consumers = kv.second.consumers;
+            consumers.erase(std::remove_if(consumers.begin(), consumers.end(), [&](const Consumer &c)
+            {
+                return c.fd == conn.fd && c.channel == channel;
+            }), consumers.end());
+        }
+        // 未确认的消息按原顺序放回队首
+        auto &unacked = it->second.unacked;
+        for (auto uit = unacked.rbegin(); uit != unacked.rend(); ++uit)
+        {
+            Requeue(std::move(uit->second));
+        }
+        conn.channels.erase(it);
+    }
+
+    void LocalAmqpBroker::ChannelError(Connection &conn, uint16_t channel, uint16_t code, const std::string &text,
+                                       uint16_t class_id, uint16_t method_id)
+    {
+        LOG_WARN("LocalAmqpBroker closing channel {}: {}", channel, text);
+        Writer w;
+        w.Short(code).ShortStr(text).Short(class_id).Short(method_id);
+        SendMethod(conn, channel, 20, 40, w.Data());
+        CloseChannel(conn, channel);
+    }
+
+    void LocalAmqpBroker::Route(Message message)
+    {
+        std::vector<std::string> targets;
+        if (message.exchange.empty())
+        {
+            targets.push_back(message.routing_key);
+        }
+        else
+        {
+            auto eit = m_exchanges.find(message.exchange);
+            if (eit == m_exchanges.end()) return;
+            const Exchange &exchange = eit->second;
+            for (const auto &binding : exchange.bindings)
+            {
+                bool match = exchange.type == "fanout" ||
+                             (exchange.type == "topic" ? TopicMatch(binding.routing_key, message.routing_key)
+                                                       : binding.routing_key == message.routing_key);
+                if (match && std::find(targets.begin(), targets.end(), binding.queue) == targets.end())
+                {
+                    targets.push_back(binding.queue);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            auto qit = m_queues.find(targets[i]);
+            if (qit == m_queues.end()) continue;
+            if (i + 1 == targets.size())
+            {
+                qit->second.messages.push_back(std::move(message));
+            }
+            else
+            {
+                qit->second.messages.push_back(message);
+            }
+        }
+    }
+
+    void LocalAmqpBroker::Dispatch()
+    {
+        for (auto &kv : m_queues)
+        {
+            Queue &queue = kv.second;
+            while (!queue.messages.empty() && !queue.consumers.empty())
+            {
+                // 轮询寻找一个仍有预取余量的消费者
+                Consumer *consumer = nullptr;
+                Connection *conn = nullptr;
+                Channel *channel = nullptr;
+                size_t count = queue.consumers.size();
+                for (size_t n = 0; n < count; ++n)
+                {
+                    Consumer &c = queue.consumers[(queue.next + n) % count];
+                    auto cit = m_connections.find(c.fd);
+                    if (cit == m_connections.end() || cit->second->dead || cit->second->closing) continue;
+                    auto chit = cit->second->channels.find(c.channel);
+                    if (chit == cit->second->channels.end()) continue;
+                    Channel &ch = chit->second;
+                    if (!c.no_ack && ch.prefetch != 0 && ch.unacked.size() >= ch.prefetch) continue;
+                    consumer = &c;
+                    conn = cit->second.get();
+                    channel = &ch;
+                    queue.next = (queue.next + n + 1) % count;
+                    break;
+                }
+                if (consumer == nullptr) break;
+
+                Message message = std::move(queue.messages.front());
+                queue.messages.pop_front();
+                uint64_t tag = channel->next_delivery_tag++;
+
+                Writer w;
+                w.ShortStr(consumer->tag)
+                 .LongLong(tag)
+                 .Octet(message.redelivered ? 1 : 0)
+                 .ShortStr(message.exchange)
+                 .ShortStr(message.routing_key);
+                SendMethod(*conn, consumer->channel, 60, 60, w.Data());
+                SendFrame(*conn, kFrameHeader, consumer->channel, message.header);
+                size_t chunk = conn->frame_max - 8;
+                for (size_t off = 0; off < message.body.size(); off += chunk)
+                {
+                    SendFrame(*conn, kFrameBody, consumer->channel, message.body.substr(off, chunk));
+                }
+                if (!consumer->no_ack)
+                {
+                    channel->unacked.emplace(tag, Unacked{kv.first, std::move(message)});
+                }
+            }
+        }
+    }
+
+    void LocalAmqpBroker::Requeue(Unacked &&unacked)
+    {
+        auto qit = m_queues.find(unacked.queue);
+        if (qit == m_queues.end()) return;
+        unacked.message.redelivered = true;
+        qit->second.messages.push_front(std::move(unacked.message));
+    }
+
+    void LocalAmqpBroker::SendFrame(Connection &conn, uint8_t type, uint16_t channel, const std::string &payload)
+    {
+        Writer w;
+        w.Octet(type).Short(channel).Long(static_cast<uint32_t>(payload.size()));
+        conn.out += w.Data();
+        conn.out += payload;
+        conn.out.push_back(static_cast<char>(kFrameEnd));
+    }
+
+    void LocalAmqpBroker::SendMethod(Connection &conn, uint16_t channel, uint16_t class_id, uint16_t method_id, const std::string &args)
+    {
+        Writer w;
+        w.Short(class_id).Short(method_id);
+        SendFrame(conn, kFrameMethod, channel, w.Data() + args);
+    }
+
+    bool LocalAmqpBroker::TopicMatch(const std::string &pattern, const std::string &key)
+    {
+        return MatchWords(SplitWords(pattern), 0, SplitWords(key), 0);
+    }
+}
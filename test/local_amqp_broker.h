@@ -0,0 +1,133 @@
+#ifndef LOCAL_AMQP_BROKER_H
+#define LOCAL_AMQP_BROKER_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+namespace InstantSocial
+{
+    // 进程内的最小 AMQP 0-9-1 代理, 只实现 RabbitMQHandler 用到的方法子集
+    // (connection/channel 握手, exchange/queue 声明与绑定, qos, consume, publish, ack/nack, confirm),
+    // 供单元测试与基准测试在没有真实 RabbitMQ 的环境中使用. 消息不持久化, 不支持认证与心跳.
+    class LocalAmqpBroker
+    {
+    public:
+        using Ptr = std::shared_ptr<LocalAmqpBroker>;
+        LocalAmqpBroker() = default;
+        ~LocalAmqpBroker();
+
+        // 监听 127.0.0.1:port, port 为 0 时由系统分配; 返回实际监听端口, 失败返回 0
+        uint16_t Start(uint16_t port = 0);
+        void Stop();
+        uint16_t Port() const { return m_port; }
+        // 队列中等待投递的消息数, 队列不存在返回 -1
+        int64_t QueueDepth(const std::string &queue);
+
+    private:
+        struct Message
+        {
+            std::string exchange;
+            std::string routing_key;
+            std::string header;     // content header 帧的原始负载, 投递时原样转发
+            std::string body;
+            bool redelivered = false;
+        };
+
+        struct Consumer
+        {
+            int fd;
+            uint16_t channel;
+            std::string tag;
+            bool no_ack;
+        };
+
+        struct Queue
+        {
+            std::deque<Message> messages;
+            std::vector<Consumer> consumers;
+            size_t next = 0;        // 轮询投递下标
+        };
+
+        struct Binding
+        {
+            std::string queue;
+            std::string routing_key;
+        };
+
+        struct Exchange
+        {
+            std::string type;
+            std::vector<Binding> bindings;
+        };
+
+        struct Unacked
+        {
+            std::string queue;
+            Message message;
+        };
+
+        struct Channel
+        {
+            uint16_t prefetch = 0;
+            uint64_t next_delivery_tag = 1;
+            std::map<uint64_t, Unacked> unacked;
+            bool confirm = false;
+            uint64_t publish_seq = 0;
+
+            // 正在接收的 basic.publish 内容
+            bool publishing = false;
+            Message pending;
+            uint64_t pending_size = 0;
+        };
+
+        struct Connection
+        {
+            int fd;
+            bool handshake = false;
+            bool closing = false;   // 已回复 connection.close-ok, 发送完缓冲后关闭
+            bool dead = false;      // 读写出错或协议错误, 本轮结束时关闭
+            uint32_t frame_max = 131072;
+            std::string in;
+            std::string out;
+            std::map<uint16_t, Channel> channels;
+        };
+
+    private:
+        void Run();
+        void OnReadable(Connection &conn);
+        void OnWritable(Connection &conn);
+        void CloseConnection(int fd);
+        void HandleFrame(Connection &conn, uint8_t type, uint16_t channel, const std::string &payload);
+        void HandleMethod(Connection &conn, uint16_t channel, const std::string &payload);
+        void CloseChannel(Connection &conn, uint16_t channel);
+        void ChannelError(Connection &conn, uint16_t channel, uint16_t code, const std::string &text, uint16_t class_id, uint16_t method_id);
+        void Route(Message message);
+        void Dispatch();
+        void Requeue(Unacked &&unacked);
+        void SendFrame(Connection &conn, uint8_t type, uint16_t channel, const std::string &payload);
+        void SendMethod(Connection &conn, uint16_t channel, uint16_t class_id, uint16_t method_id, const std::string &args = std::string());
+        static bool TopicMatch(const std::string &pattern, const std::string &key);
+
+    private:
+        std::mutex m_mutex;
+        std::thread m_thread;
+        std::atomic<bool> m_running{false};
+        int m_listen_fd = -1;
+        int m_wakeup_fd[2] = {-1, -1};
+        uint16_t m_port = 0;
+        uint64_t m_name_seq = 0;
+
+        std::map<int, std::unique_ptr<Connection>> m_connections;
+        std::map<std::string, Exchange> m_exchanges;
+        std::map<std::string, Queue> m_queues;
+    };
+}
+
+#endif // LOCAL_AMQP_BROKER_H
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "local_cache.h"
+#include <string>
+#include <thread>
+#include <chrono>
+
+namespace InstantSocial
+{
+    using StringCache = ShardedLruCache<std::string, std::string>;
+
+    TEST(ShardedLruCacheTest, GetAfterPut)
+    {
+        StringCache cache(StringCache::Options{});
+        std::string value;
+        EXPECT_FALSE(cache.Get("ssid", value));
+        cache.Put("ssid", "uid");
+        ASSERT_TRUE(cache.Get("ssid", value));
+        EXPECT_EQ(value, "uid");
+
+        cache.Erase("ssid");
+        EXPECT_FALSE(cache.Get("ssid", value));
+    }
+
+    TEST(ShardedLruCacheTest, EvictsLeastRecentlyUsed)
+    {
+        StringCache::Options options;
+        options.shards = 1;
+        options.capacity = 2;
+        StringCache cache(options);
+        cache.Put("a", "1");
+        cache.Put("b", "2");
+        std::string value;
+        ASSERT_TRUE(cache.Get("a", value));     // a 变为最近使用
+        cache.Put("c", "3");
+
+        EXPECT_TRUE(cache.Get("a", value));
+        EXPECT_FALSE(cache.Get("b", value));
+        EXPECT_TRUE(cache.Get("c", value));
+        EXPECT_EQ(cache.Stats()[0].evictions, 1u);
+    }
+
+    TEST(ShardedLruCacheTest, ChargeBoundsMemory)
+    {
+        StringCache::Options options;
+        options.shards = 1;
+        options.capacity = 10;
+        StringCache cache(options, [](const std::string &, const std::string &v) { return v.size(); });
+        cache.Put("a", "12345");
+        cache.Put("b", "12345");
+        cache.Put("c", "12345");
+
+        auto stats = cache.Stats();
+        EXPECT_EQ(stats[0].entries, 2u);
+        EXPECT_EQ(stats[0].charge, 10u);
+    }
+
+    TEST(ShardedLruCacheTest, EntriesExpireAfterTtl)
+    {
+        StringCache::Options options;
+        options.ttl = std::chrono::milliseconds(20);
+        StringCache cache(options);
+        cache.Put("ssid", "uid");
+        std::string value;
+        EXPECT_TRUE(cache.Get("ssid", value));
+        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        EXPECT_FALSE(cache.Get("ssid", value));
+    }
+
+    TEST(ShardedLruCacheTest, StalePutAfterEraseIsDropped)
+    {
+        StringCache cache(StringCache::Options{});
+        uint64_t epoch = cache.Epoch("ssid");
+        // 读取源数据期间发生了失效
+        cache.Erase("ssid");
+        EXPECT_FALSE(cache.Put("ssid", "stale", epoch));
+        std::string value;
+        EXPECT_FALSE(cache.Get("ssid", value));
+
+        epoch = cache.Epoch("ssid");
+        EXPECT_TRUE(cache.Put("ssid", "fresh", epoch));
+        ASSERT_TRUE(cache.Get("ssid", value));
+        EXPECT_EQ(value, "fresh");
+    }
+
+    TEST(ShardedLruCacheTest, ClearDropsAllShards)
+    {
+        StringCache cache(StringCache::Options{});
+        for (int i = 0; i < 100; ++i)
+        {
+            cache.Put("key_" + std::to_string(i), "value");
+        }
+        cache.Clear();
+        size_t entries = 0;
+        for (auto &s : cache.Stats()) entries += s.entries;
+        EXPECT_EQ(entries, 0u);
+    }
+}
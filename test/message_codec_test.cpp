@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "message_codec.h"
+#include <string>
+
+namespace InstantSocial
+{
+    TEST(MessageCodecTest, RoundTripTextMessage)
+    {
+        auto now = boost::posix_time::microsec_clock::universal_time();
+        MessageEntity message("msg_1", "session_1", "user_1", MessageType::TEXT, now);
+        message.id(0x0123456789abcdefULL);
+        message.content("hello world");
+
+        MessageEntity decoded;
+        ASSERT_TRUE(DecodeMessage(EncodeMessage(message), decoded));
+        EXPECT_EQ(decoded.id(), 0x0123456789abcdefULL);
+        EXPECT_EQ(decoded.message_id(), "msg_1");
+        EXPECT_EQ(decoded.session_id(), "session_1");
+        EXPECT_EQ(decoded.user_id(), "user_1");
+        EXPECT_EQ(decoded.message_type(), MessageType::TEXT);
+        EXPECT_EQ(decoded.create_time(), now);
+        EXPECT_EQ(decoded.content(), message.content());
+        EXPECT_EQ(decoded.file_id(), "");
+        EXPECT_EQ(decoded.file_size(), 0u);
+    }
+
+    TEST(MessageCodecTest, RoundTripFileMessage)
+    {
+        auto now = boost::posix_time::microsec_clock::universal_time();
+        MessageEntity message("msg_2", "session_1", "user_2", MessageType::FILE, now);
+        message.file_id("file_1");
+        message.file_name("report.pdf");
+        message.file_path("/files/report.pdf");
+        message.file_size(4096);
+
+        MessageEntity decoded;
+        ASSERT_TRUE(DecodeMessage(EncodeMessage(message), decoded));
+        EXPECT_EQ(decoded.message_type(), MessageType::FILE);
+        EXPECT_EQ(decoded.content(), "");
+        EXPECT_EQ(decoded.file_id(), "file_1");
+        EXPECT_EQ(decoded.file_name(), "report.pdf");
+        EXPECT_EQ(decoded.file_path(), "/files/report.pdf");
+        EXPECT_EQ(decoded.file_size(), 4096u);
+    }
+
+    TEST(MessageCodecTest, RejectsCorruptData)
+    {
+        MessageEntity message("msg_3", "session_1", "user_1", MessageType::TEXT,
+                              boost::posix_time::microsec_clock::universal_time());
+        message.content("payload");
+        std::string data = EncodeMessage(message);
+
+        MessageEntity decoded;
+        EXPECT_FALSE(DecodeMessage("", decoded));
+        EXPECT_FALSE(DecodeMessage(data.substr(0, data.size() - 1), decoded));
+        EXPECT_FALSE(DecodeMessage(data + "x", decoded));
+        data[0] = 0x7f;
+        EXPECT_FALSE(DecodeMessage(data, decoded));
+    }
+
+    TEST(MessageCodecTest, IdentityIsEmbeddedInEncoding)
+    {
+        auto now = boost::posix_time::microsec_clock::universal_time();
+        MessageEntity message("msg_4", "session_1", "user_1", MessageType::TEXT, now);
+        message.id(42);
+        message.content("payload");
+        std::string identity = EncodeMessageIdentity(message);
+        EXPECT_EQ(EncodeMessage(message).compare(kMessageIdentityOffset, identity.size(), identity), 0);
+
+        // 内容不参与标识, 同一条消息从库中读回后仍能识别
+        MessageEntity reloaded(message);
+        reloaded.content("");
+        EXPECT_EQ(EncodeMessage(reloaded).compare(kMessageIdentityOffset, identity.size(), identity), 0);
+        message.id(43);
+        EXPECT_NE(EncodeMessageIdentity(message), identity);
+    }
+}
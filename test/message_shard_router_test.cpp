@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include "message_shard_router.h"
+#include <string>
+
+namespace InstantSocial
+{
+    TEST(MessageShardRouterTest, Crc32MatchesMySQL)
+    {
+        // SELECT CRC32('123456789') = 3421780262
+        EXPECT_EQ(Crc32("123456789"), 0xCBF43926u);
+        EXPECT_EQ(Crc32(""), 0u);
+    }
+
+    TEST(MessageShardRouterTest, UniformSplitsBucketsEvenly)
+    {
+        auto map = ShardMap::Uniform(4, 1024);
+        ASSERT_EQ(map.Buckets(), 1024u);
+        EXPECT_EQ(map.owner[0], 0);
+        EXPECT_EQ(map.owner[255], 0);
+        EXPECT_EQ(map.owner[256], 1);
+        EXPECT_EQ(map.owner[1023], 3);
+        EXPECT_EQ(map.migrating_to[512], ShardMap::kNone);
+        EXPECT_EQ(map.BucketOf("session_1"), Crc32("session_1") % 1024);
+    }
+
+    TEST(MessageShardRouterTest, FormatParseRoundTrip)
+    {
+        auto map = ShardMap::Uniform(2, 16);
+        map.version = 7;
+        for (size_t b = 12; b < 16; ++b) map.migrating_to[b] = 2;
+
+        std::string text = map.Format();
+        EXPECT_EQ(text, "version 7\nbuckets 16\n0-7 0\n8-11 1\n12-15 1 -> 2\n");
+
+        ShardMap parsed;
+        ASSERT_TRUE(ShardMap::Parse(text, parsed));
+        EXPECT_EQ(parsed.version, 7u);
+        EXPECT_EQ(parsed.owner, map.owner);
+        EXPECT_EQ(parsed.migrating_to, map.migrating_to);
+    }
+
+    TEST(MessageShardRouterTest, ParseRejectsInvalidMaps)
+    {
+        ShardMap map;
+        // 缺少桶 4-7
+        EXPECT_FALSE(ShardMap::Parse("version 1\nbuckets 8\n0-3 0\n", map));
+        // 范围重叠
+        EXPECT_FALSE(ShardMap::Parse("version 1\nbuckets 8\n0-4 0\n4-7 1\n", map));
+        // 越界
+        EXPECT_FALSE(ShardMap::Parse("version 1\nbuckets 8\n0-8 0\n", map));
+        // 迁往自身
+        EXPECT_FALSE(ShardMap::Parse("version 1\nbuckets 8\n0-7 0 -> 0\n", map));
+        // 未声明桶数
+        EXPECT_FALSE(ShardMap::Parse("version 1\n0-7 0\n", map));
+        EXPECT_TRUE(ShardMap::Parse("# comment\nversion 1\nbuckets 8\n0-7 0\n", map));
+    }
+}
@@ -7,6 +7,11 @@
 #include "relation_handler.h"
 #include "friend_apply_handler.h"
 #include "chat_session_member_handler.h"
+#include "schema_migrator.h"
+#include "transaction_scope.h"
+#include "user_cache.h"
+#include "unread_counter.h"
+#include "id_generator.h"
 #include "user_entity.h"
 #include "message_entity.h"
 #include "chat_session_entity.h"
@@ -16,8 +21,10 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <string>
 #include <thread>
+#include <atomic>
 #include <chrono>
 #include <sstream>
 #include <iomanip>
@@ -62,6 +69,8 @@ namespace InstantSocial
         }
         
         std::shared_ptr<odb::database> db_;
+        // 单元测试固定用 worker 0, 所有用例共用, 各自新建同一 worker id 的生成器会在同一毫秒内发出相同的 id
+        static inline IdGenerator::Ptr ids_ = std::make_shared<IdGenerator>(0);
     };
 
     // 辅助函数：生成唯一的测试ID
@@ -197,10 +206,65 @@ namespace InstantSocial
         EXPECT_GE(users.size(), 2);
     }
 
+    TEST_F(ODBHandlerTest, UserHandler_GetByMultiUsersChunked)
+    {
+        UserHandler handler(db_);
+        DbExecutorOptions executor_options;
+        executor_options.threads = 2;
+        executor_options.metrics_prefix = "";
+        handler.SetBatchExecutor(std::make_shared<DbExecutor>(executor_options), 3);
+
+        // 超过一块(50 个)的请求, 倒序传入并带重复 id, 结果按传入顺序去重返回
+        std::vector<std::string> user_ids;
+        for (int i = 0; i < 120; ++i)
+        {
+            std::string user_id = GenerateTestID("gtest_batch_" + std::to_string(i));
+            ASSERT_TRUE(handler.Insert(std::make_shared<UserEntity>(user_id, user_id, "password")));
+            user_ids.push_back(user_id);
+        }
+        std::vector<std::string> request(user_ids.rbegin(), user_ids.rend());
+        request.push_back(user_ids[0]);
+        request.insert(request.begin() + 10, "not_exist");
+
+        auto users = handler.GetByMultiUsers(request);
+        ASSERT_EQ(users.size(), user_ids.size());
+        for (size_t i = 0; i < users.size(); ++i)
+        {
+            EXPECT_EQ(users[i].user_id(), user_ids[user_ids.size() - 1 - i]);
+        }
+    }
+
+    TEST_F(ODBHandlerTest, UserHandler_CacheInvalidatedOnUpdate)
+    {
+        UserHandler handler(db_);
+        UserCacheOptions options;
+        options.metrics_prefix = "";
+        auto cache = std::make_shared<UserCache>(options);
+        handler.EnableCache(cache);
+
+        std::string user_id = GenerateTestID("gtest_user_cache");
+        auto user = std::make_shared<UserEntity>(user_id, user_id, std::string("password"));
+        user->phone(user_id);
+        ASSERT_TRUE(handler.Insert(user));
+
+        auto loaded = handler.GetByUserID(user_id);
+        ASSERT_NE(loaded, nullptr);
+        UserCache::User cached;
+        std::string cached_id;
+        ASSERT_TRUE(cache->GetByPhone(user_id, cached, cached_id));
+
+        loaded->description("GTest缓存失效");
+        ASSERT_TRUE(handler.Update(loaded));
+        EXPECT_FALSE(cache->GetById(user_id, cached));
+        auto updated = handler.GetByPhone(user_id);
+        ASSERT_NE(updated, nullptr);
+        EXPECT_EQ(updated->description(), "GTest缓存失效");
+    }
+
     // 测试 MessageHandler
     TEST_F(ODBHandlerTest, MessageHandler_Insert)
     {
-        MessageHandler handler(db_);
+        MessageHandler handler(db_, ids_);
         
         auto now = boost::posix_time::second_clock::local_time();
         std::string msg_id = GenerateTestID("gtest_msg_001");
@@ -211,9 +275,29 @@ namespace InstantSocial
         EXPECT_TRUE(handler.Insert(msg));
     }
 
+    TEST_F(ODBHandlerTest, MessageHandler_AssignsIdFromGenerator)
+    {
+        std::string session_id = GenerateTestID("gtest_session_007");
+        auto now = boost::posix_time::second_clock::local_time();
+        // 调用方带来的 message_id 会被主键的字符串形式覆盖
+        MessageEntity msg("client_msg_id", session_id, "gtest_user001", MessageType::TEXT, now);
+
+        EXPECT_THROW(MessageHandler(db_, nullptr), std::invalid_argument);
+
+        MessageHandler handler(db_, ids_);
+        ASSERT_TRUE(handler.Insert(msg));
+        ASSERT_NE(msg.id(), 0u);
+        EXPECT_EQ(msg.message_id(), IdGenerator::ToString(msg.id()));
+
+        auto recent = handler.GetRecent(session_id, 1);
+        ASSERT_EQ(recent.size(), 1u);
+        EXPECT_EQ(recent[0].id(), msg.id());
+        EXPECT_TRUE(handler.Remove(session_id));
+    }
+
     TEST_F(ODBHandlerTest, MessageHandler_GetRecent)
     {
-        MessageHandler handler(db_);
+        MessageHandler handler(db_, ids_);
         
         std::string session_id = GenerateTestID("gtest_session_002");
         auto now = boost::posix_time::second_clock::local_time();
@@ -237,7 +321,7 @@ namespace InstantSocial
 
     TEST_F(ODBHandlerTest, MessageHandler_GetByTimeRange)
     {
-        MessageHandler handler(db_);
+        MessageHandler handler(db_, ids_);
         
         std::string session_id = GenerateTestID("gtest_session_003");
         auto now = boost::posix_time::second_clock::local_time();
@@ -256,7 +340,7 @@ namespace InstantSocial
 
     TEST_F(ODBHandlerTest, MessageHandler_Remove)
     {
-        MessageHandler handler(db_);
+        MessageHandler handler(db_, ids_);
         
         std::string message_id = GenerateTestID("gtest_msg_005");
         auto now = boost::posix_time::second_clock::local_time();
@@ -269,6 +353,89 @@ namespace InstantSocial
     }
 
     // 测试 ChatSessionHandler
+    TEST_F(ODBHandlerTest, MessageHandler_CursorPaging)
+    {
+        MessageHandler handler(db_, ids_);
+
+        std::string session_id = GenerateTestID("gtest_session_006");
+        auto now = boost::posix_time::second_clock::local_time();
+        std::vector<std::string> ids;
+        for (int i = 0; i < 5; ++i)
+        {
+            // 后两条时间相同, 由按插入顺序递增的 id 决定先后
+            auto time = now + boost::posix_time::seconds(std::min(i, 3));
+            MessageEntity msg("", session_id, "gtest_user001", MessageType::TEXT, time);
+            ASSERT_TRUE(handler.Insert(msg));
+            ids.push_back(msg.message_id());
+        }
+
+        auto page = handler.GetBefore(session_id, "", 2);
+        ASSERT_EQ(page.size(), 2u);
+        EXPECT_EQ(page[0].message_id(), ids[3]);
+        EXPECT_EQ(page[1].message_id(), ids[4]);
+
+        page = handler.GetBefore(session_id, MessageHandler::CursorOf(page[0]), 2);
+        ASSERT_EQ(page.size(), 2u);
+        EXPECT_EQ(page[0].message_id(), ids[1]);
+        EXPECT_EQ(page[1].message_id(), ids[2]);
+
+        page = handler.GetBefore(session_id, MessageHandler::CursorOf(page[0]), 2);
+        ASSERT_EQ(page.size(), 1u);
+        EXPECT_EQ(page[0].message_id(), ids[0]);
+
+        page = handler.GetAfter(session_id, "", 3);
+        ASSERT_EQ(page.size(), 3u);
+        EXPECT_EQ(page[0].message_id(), ids[0]);
+        EXPECT_EQ(page[2].message_id(), ids[2]);
+
+        page = handler.GetAfter(session_id, MessageHandler::CursorOf(page[2]), 3);
+        ASSERT_EQ(page.size(), 2u);
+        EXPECT_EQ(page[0].message_id(), ids[3]);
+        EXPECT_EQ(page[1].message_id(), ids[4]);
+
+        EXPECT_TRUE(handler.GetAfter(session_id, "not-a-cursor", 3).empty());
+        EXPECT_TRUE(handler.Remove(session_id));
+    }
+
+    TEST_F(ODBHandlerTest, MessageHandler_GroupCommit)
+    {
+        MessageHandler handler(db_, ids_);
+        MessageBatchWriterOptions options;
+        options.max_batch = 16;
+        options.metrics_prefix = "";
+        handler.EnableGroupCommit(options);
+
+        std::string session_id = GenerateTestID("gtest_session_005");
+        auto now = boost::posix_time::second_clock::local_time();
+        const int threads = 8, per_thread = 10;
+        std::atomic<int> inserted{0};
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                for (int i = 0; i < per_thread; ++i)
+                {
+                    MessageEntity msg(session_id + "_" + std::to_string(t) + "_" + std::to_string(i),
+                                      session_id, "gtest_user001", MessageType::TEXT, now);
+                    msg.content("组提交测试消息");
+                    if (handler.Insert(msg)) ++inserted;
+                }
+            });
+        }
+        for (auto &w : workers) w.join();
+        EXPECT_EQ(inserted.load(), threads * per_thread);
+        EXPECT_EQ(handler.GetRecent(session_id, threads * per_thread + 1).size(), static_cast<size_t>(threads * per_thread));
+
+        // 主键重复的消息只让自己失败
+        auto existing = handler.GetRecent(session_id, 1);
+        ASSERT_EQ(existing.size(), 1u);
+        MessageEntity dup("", session_id, "gtest_user001", MessageType::TEXT, now);
+        dup.id(existing[0].id());
+        EXPECT_FALSE(handler.Insert(dup));
+        EXPECT_TRUE(handler.Remove(session_id));
+    }
+
     TEST_F(ODBHandlerTest, ChatSessionHandler_Insert)
     {
         ChatSessionHandler handler(db_);
@@ -442,6 +609,67 @@ namespace InstantSocial
         EXPECT_GE(member_list.size(), 2);
     }
 
+    // UnreadCounter 另外需要测试机上的 Redis
+    RedisClient::Ptr TestRedis()
+    {
+        RedisOptions options;
+        options.host = "192.168.113.205";
+        options.metrics_prefix = "";
+        return RedisFactory::Create(options);
+    }
+
+    TEST_F(ODBHandlerTest, UnreadCounter_IncrementResetAndGetAll)
+    {
+        auto redis = TestRedis();
+        ASSERT_NE(redis, nullptr) << "Redis 连接失败";
+        UnreadCounter counter(redis, nullptr, GenerateTestID("gtest_unread") + ":");
+        EXPECT_TRUE(counter.Increment("s1", {"u1", "u2"}));
+        EXPECT_TRUE(counter.Increment("s1", {"u1"}, 2));
+        EXPECT_TRUE(counter.Increment("s2", {"u1"}));
+        EXPECT_TRUE(counter.Increment("s3", {}));
+
+        EXPECT_EQ(counter.Get("u1", {"s2", "missing", "s1"}), (std::vector<long long>{1, 0, 3}));
+        EXPECT_EQ(counter.Get("u2", {"s1", "s2"}), (std::vector<long long>{1, 0}));
+        EXPECT_EQ(counter.GetAll("u1"), (std::unordered_map<std::string, long long>{{"s1", 3}, {"s2", 1}}));
+
+        EXPECT_TRUE(counter.Reset("u1", "s1"));
+        EXPECT_TRUE(counter.Reset("u1", "missing"));
+        EXPECT_EQ(counter.GetAll("u1"), (std::unordered_map<std::string, long long>{{"s2", 1}}));
+        // 计数回到 0 的会话不出现在 GetAll 中
+        EXPECT_TRUE(counter.Increment("s2", {"u1"}, -1));
+        EXPECT_TRUE(counter.GetAll("u1").empty());
+        EXPECT_TRUE(counter.Reset("u1", "s2"));
+        EXPECT_TRUE(counter.Reset("u2", "s1"));
+
+        // 没有成员 handler 时无法扇出
+        EXPECT_FALSE(counter.OnMessage("s1", "u1"));
+    }
+
+    TEST_F(ODBHandlerTest, UnreadCounter_OnMessageFansOutToMembers)
+    {
+        auto redis = TestRedis();
+        ASSERT_NE(redis, nullptr) << "Redis 连接失败";
+
+        auto members = std::make_shared<ChatSessionMemberHandler>(db_);
+        std::string session_id = GenerateTestID("gtest_session_unread");
+        std::string sender = GenerateTestID("gtest_unread_sender");
+        std::string receiver = GenerateTestID("gtest_unread_receiver");
+        std::vector<ChatSessionMemberEntity> list = {ChatSessionMemberEntity(session_id, sender),
+                                                     ChatSessionMemberEntity(session_id, receiver)};
+        ASSERT_TRUE(members->Apeend(list));
+
+        UnreadCounter counter(redis, members, GenerateTestID("gtest_unread") + ":");
+        EXPECT_TRUE(counter.OnMessage(session_id, sender));
+        EXPECT_TRUE(counter.OnMessage(session_id, sender));
+        // 发送者自己不计未读
+        EXPECT_EQ(counter.Get(receiver, {session_id}), (std::vector<long long>{2}));
+        EXPECT_EQ(counter.Get(sender, {session_id}), (std::vector<long long>{0}));
+
+        EXPECT_TRUE(counter.Reset(receiver, session_id));
+        EXPECT_TRUE(counter.GetAll(receiver).empty());
+        EXPECT_TRUE(members->RemoveAllBySessionId(session_id));
+    }
+
     TEST_F(ODBHandlerTest, ChatSessionMemberHandler_RemoveBySessionIdAndUserId)
     {
         ChatSessionMemberHandler handler(db_);
@@ -466,6 +694,92 @@ namespace InstantSocial
         
         EXPECT_TRUE(handler.RemoveAllBySessionId(session_id));
     }
+
+    // 测试 UnitOfWork
+    TEST_F(ODBHandlerTest, UnitOfWork_CommitsSessionAndMembersTogether)
+    {
+        ChatSessionHandler session_handler(db_);
+        ChatSessionMemberHandler member_handler(db_);
+
+        std::string session_id = GenerateTestID("gtest_session_uow_1");
+        ChatSessionEntity session(session_id, "GTest工作单元群聊", ChatSessionType::GROUP);
+        std::vector<ChatSessionMemberEntity> members = {
+            ChatSessionMemberEntity(session_id, GenerateTestID("gtest_user_uow_1")),
+            ChatSessionMemberEntity(session_id, GenerateTestID("gtest_user_uow_2")),
+        };
+        {
+            UnitOfWork uow(db_);
+            ASSERT_TRUE(session_handler.Insert(session));
+            ASSERT_TRUE(member_handler.Apeend(members));
+            // 单元内的读加入同一事务, 能看到尚未提交的写入
+            EXPECT_EQ(member_handler.GetMemberListBySessionId(session_id).size(), 2u);
+            uow.Commit();
+        }
+        EXPECT_NE(session_handler.GetBySessionId(session_id), nullptr);
+        EXPECT_EQ(member_handler.GetMemberListBySessionId(session_id).size(), 2u);
+        EXPECT_TRUE(session_handler.RemoveBySessionId(session_id));
+    }
+
+    TEST_F(ODBHandlerTest, UnitOfWork_RollsBackWithoutCommit)
+    {
+        ChatSessionHandler session_handler(db_);
+        ChatSessionMemberHandler member_handler(db_);
+
+        std::string session_id = GenerateTestID("gtest_session_uow_2");
+        ChatSessionEntity session(session_id, "GTest工作单元回滚", ChatSessionType::GROUP);
+        ChatSessionMemberEntity member(session_id, GenerateTestID("gtest_user_uow_3"));
+        {
+            UnitOfWork uow(db_);
+            ASSERT_TRUE(session_handler.Insert(session));
+            ASSERT_TRUE(member_handler.Apeend(member));
+        }
+        EXPECT_EQ(session_handler.GetBySessionId(session_id), nullptr);
+        EXPECT_TRUE(member_handler.GetMemberListBySessionId(session_id).empty());
+    }
+
+    // 测试 SchemaMigrator
+    TEST_F(ODBHandlerTest, SchemaMigrator_AppliesOnce)
+    {
+        // 用当前时间作版本号, 避免与内置迁移及之前的测试记录冲突
+        uint64_t version = static_cast<uint64_t>(std::time(nullptr)) * 1000;
+        std::string table = "gtest_migration_" + std::to_string(version);
+        {
+            odb::transaction t(db_->begin());
+            db_->execute("CREATE TABLE " + table + " (id INT PRIMARY KEY, name VARCHAR(32))");
+            t.commit();
+        }
+
+        int applied = 0;
+        SchemaMigratorOptions options;
+        options.progress_interval = std::chrono::milliseconds(100);
+        // 迁移按版本顺序执行, 测试库上允许内置的阻塞迁移, 否则会停在它前面
+        options.allow_blocking = true;
+        SchemaMigrator migrator(db_, options);
+        migrator.Register({version, "gtest add index", true, [&](SchemaMigrator &m) {
+            ++applied;
+            m.AddIndex(table, "gtest_name_idx", "name");
+        }});
+        EXPECT_THROW(migrator.Register({version, "duplicate", true, nullptr}), std::invalid_argument);
+
+        EXPECT_TRUE(migrator.Migrate());
+        EXPECT_EQ(applied, 1);
+        EXPECT_TRUE(migrator.IndexExists(table, "gtest_name_idx"));
+        // 无论新建还是迁移上来, message 表都不再有 message_id 上的索引
+        EXPECT_TRUE(migrator.IndexExists("message", "message_session_time_idx"));
+        EXPECT_FALSE(migrator.IndexExists("message", "message_message_id_i"));
+        for (auto &pending : migrator.Pending())
+        {
+            EXPECT_NE(pending.version, version);
+        }
+
+        EXPECT_TRUE(migrator.Migrate());
+        EXPECT_EQ(applied, 1);
+
+        odb::transaction t(db_->begin());
+        db_->execute("DROP TABLE " + table);
+        db_->execute("DELETE FROM schema_migrations WHERE version = " + std::to_string(version));
+        t.commit();
+    }
 }
 
 // 主函数
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include "logger.h"
+#include "rabbitmq.h"
+#include "local_amqp_broker.h"
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+
+namespace InstantSocial
+{
+    // 使用进程内 AMQP 代理测试 RabbitMQHandler, 不依赖外部 RabbitMQ
+    class RabbitMQHandlerTest : public ::testing::Test
+    {
+    protected:
+        static void SetUpTestSuite()
+        {
+            init_logger(false, "test_logs.txt", 0);
+        }
+
+        void SetUp() override
+        {
+            port_ = broker_.Start();
+            ASSERT_NE(port_, 0) << "本地 AMQP 代理启动失败";
+        }
+
+        void TearDown() override
+        {
+            broker_.Stop();
+        }
+
+        LocalAmqpBroker broker_;
+        uint16_t port_ = 0;
+    };
+
+    TEST_F(RabbitMQHandlerTest, PublishAndConsume)
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::string> received;
+        const size_t total = 100;
+
+        RabbitMQHandler mq("guest", "guest", "127.0.0.1", port_);
+        mq.DeclareComponents("test_exchange", "test_queue", "test_key");
+        mq.ConsumeMessage("test_queue", [&](const char *data, size_t len)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            received.emplace_back(data, len);
+            cond.notify_all();
+        });
+        for (size_t i = 0; i < total; ++i)
+        {
+            mq.PublishMessage("test_exchange", "message_" + std::to_string(i), "test_key");
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(cond.wait_for(lock, std::chrono::seconds(5), [&]() { return received.size() == total; }))
+            << "只收到 " << received.size() << " 条消息";
+        for (size_t i = 0; i < total; ++i)
+        {
+            EXPECT_EQ(received[i], "message_" + std::to_string(i));
+        }
+    }
+
+    TEST_F(RabbitMQHandlerTest, PrefetchLimitsUnackedDeliveries)
+    {
+        RabbitMQHandler producer("guest", "guest", "127.0.0.1", port_);
+        producer.DeclareComponents("prefetch_exchange", "prefetch_queue", "prefetch_key");
+        for (int i = 0; i < 20; ++i)
+        {
+            producer.PublishMessage("prefetch_exchange", "payload", "prefetch_key");
+        }
+        producer.Flush();
+
+        // 回调阻塞在事件循环线程上, 消息无法确认, 代理最多投递 prefetch 条
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool release = false;
+        RabbitMQHandler consumer("guest", "guest", "127.0.0.1", port_);
+        consumer.SetPrefetch(5);
+        consumer.ConsumeMessage("prefetch_queue", [&](const char *, size_t)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return release; });
+        });
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (broker_.QueueDepth("prefetch_queue") != 15 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(broker_.QueueDepth("prefetch_queue"), 15);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            release = true;
+        }
+        cond.notify_all();
+
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (broker_.QueueDepth("prefetch_queue") != 0 && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(broker_.QueueDepth("prefetch_queue"), 0);
+    }
+
+    TEST_F(RabbitMQHandlerTest, ConsumerScalesWithBacklog)
+    {
+        const size_t total = 3000;
+        RabbitMQHandler producer("guest", "guest", "127.0.0.1", port_);
+        producer.DeclareComponents("scale_exchange", "scale_queue", "scale_key");
+        for (size_t i = 0; i < total; ++i)
+        {
+            producer.PublishMessage("scale_exchange", "payload", "scale_key");
+        }
+        producer.Flush();
+
+        ConsumerScalingOptions options;
+        options.min_workers = 1;
+        options.max_workers = 4;
+        options.min_prefetch = 8;
+        options.prefetch_per_worker = 8;
+        options.backlog_per_worker = 50;
+        options.interval = std::chrono::milliseconds(100);
+        options.metrics_prefix = "rabbitmq_test";
+
+        std::atomic<size_t> consumed{0};
+        RabbitMQHandler consumer("guest", "guest", "127.0.0.1", port_);
+        consumer.ConsumeMessage("scale_queue", [&](const char *, size_t)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            ++consumed;
+        }, options);
+        EXPECT_EQ(consumer.ConsumerWorkers(), 1u);
+
+        // 积压期间扩容到上限
+        size_t max_workers = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (consumed < total && std::chrono::steady_clock::now() < deadline)
+        {
+            max_workers = std::max(max_workers, consumer.ConsumerWorkers());
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        EXPECT_EQ(consumed.load(), total);
+        EXPECT_EQ(max_workers, options.max_workers);
+
+        // 积压清空后逐步缩回下限
+        deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (consumer.ConsumerWorkers() > options.min_workers && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        EXPECT_EQ(consumer.ConsumerWorkers(), options.min_workers);
+    }
+
+    TEST_F(RabbitMQHandlerTest, MultipleConsumersShareOneHandler)
+    {
+        RabbitMQHandler mq("guest", "guest", "127.0.0.1", port_);
+        mq.DeclareComponents("multi_exchange", "multi_scaled_queue", "scaled_key");
+        mq.DeclareComponents("multi_exchange", "multi_second_queue", "second_key");
+        mq.DeclareComponents("multi_exchange", "multi_plain_queue", "plain_key");
+
+        ConsumerScalingOptions options;
+        options.interval = std::chrono::milliseconds(50);
+        options.metrics_prefix = "rabbitmq_multi_test";
+        std::atomic<size_t> scaled{0}, second{0}, plain{0};
+        // 第二个自动扩缩容消费者不能重复初始化定时器, 普通消费者不能与之重用 consumer tag
+        mq.ConsumeMessage("multi_scaled_queue", [&](const char *, size_t) { ++scaled; }, options);
+        mq.ConsumeMessage("multi_second_queue", [&](const char *, size_t) { ++second; }, options);
+        mq.ConsumeMessage("multi_plain_queue", [&](const char *, size_t) { ++plain; });
+
+        const size_t total = 50;
+        for (size_t i = 0; i < total; ++i)
+        {
+            mq.PublishMessage("multi_exchange", "payload", "scaled_key");
+            mq.PublishMessage("multi_exchange", "payload", "second_key");
+            mq.PublishMessage("multi_exchange", "payload", "plain_key");
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while ((scaled < total || second < total || plain < total) && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        EXPECT_EQ(scaled.load(), total);
+        EXPECT_EQ(second.load(), total);
+        EXPECT_EQ(plain.load(), total);
+        // 跨过几个扩缩容周期, 定时器仍正常工作
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        EXPECT_GE(mq.ConsumerWorkers(), options.min_workers);
+    }
+}
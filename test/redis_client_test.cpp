@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include "redis_client.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace InstantSocial
+{
+    TEST(RedisKeySlotTest, MatchesClusterHashSlot)
+    {
+        EXPECT_EQ(RedisKeySlot("123456789"), 12739);
+        EXPECT_EQ(RedisKeySlot("foo"), 12182);
+    }
+
+    TEST(RedisKeySlotTest, UsesHashTag)
+    {
+        EXPECT_EQ(RedisKeySlot("{user1000}.following"), RedisKeySlot("user1000"));
+        EXPECT_EQ(RedisKeySlot("{user1000}.followers"), RedisKeySlot("{user1000}.following"));
+        // 空 tag 与未闭合的 tag 按整个 key 计算
+        EXPECT_NE(RedisKeySlot("foo{}{bar}"), RedisKeySlot("bar"));
+        EXPECT_NE(RedisKeySlot("foo{bar"), RedisKeySlot("bar"));
+    }
+
+    TEST(RedisKeySlotTest, GroupsKeysBySlotPreservingOrder)
+    {
+        std::vector<std::string> keys = {"{a}1", "b", "{a}2", "{a}3"};
+        auto groups = GroupKeysBySlot(keys);
+        ASSERT_EQ(groups.size(), 2u);
+        EXPECT_EQ(groups[RedisKeySlot("a")], (std::vector<size_t>{0, 2, 3}));
+        EXPECT_EQ(groups[RedisKeySlot("b")], (std::vector<size_t>{1}));
+    }
+
+    // 不连 Redis, 只检查心跳在本地的合并结果; 刷新周期设得很长, 避免后台线程先取走缓冲
+    PresenceOptions LocalPresenceOptions()
+    {
+        PresenceOptions options;
+        options.ttl = std::chrono::milliseconds(90000);
+        options.flush_interval = std::chrono::hours(1);
+        options.key_prefix = "p:";
+        return options;
+    }
+
+    TEST(RedisScriptTest, ShaMatchesScriptLoad)
+    {
+        // 与 SCRIPT LOAD "return 1" 返回的摘要一致
+        RedisScript script("return 1");
+        EXPECT_EQ(script.Sha(), "e0e1f9fabfc9d4800c877a703b823ac0578ff8db");
+        EXPECT_EQ(script.Source(), "return 1");
+    }
+
+    std::map<std::string, std::vector<std::string>> ByKey(const PresenceBatch &batch)
+    {
+        std::map<std::string, std::vector<std::string>> res;
+        for (auto &entry : batch.entries) res[entry.key] = entry.devices;
+        return res;
+    }
+
+    TEST(PresenceBatchTest, MergesHeartbeatsPerUser)
+    {
+        Presence presence(nullptr, LocalPresenceOptions());
+        presence.Heartbeat("u1", "phone");
+        presence.Heartbeat("u1", "phone");
+        presence.Heartbeat("u1", "pc");
+        presence.Heartbeat("u2", "phone");
+
+        auto batch = presence.TakeBatch(1000);
+        EXPECT_EQ(batch.now_ms, 1000);
+        EXPECT_EQ(batch.expire_ms, 1000 + 90000);
+        auto keys = ByKey(batch);
+        ASSERT_EQ(keys.size(), 2u);
+        EXPECT_EQ(keys["p:u1"], (std::vector<std::string>{"pc", "phone"}));
+        EXPECT_EQ(keys["p:u2"], (std::vector<std::string>{"phone"}));
+
+        // 已取走的心跳不会在下一批重复写入
+        EXPECT_TRUE(presence.TakeBatch(2000).entries.empty());
+    }
+
+    TEST(PresenceBatchTest, OfflineDropsBufferedHeartbeat)
+    {
+        Presence presence(nullptr, LocalPresenceOptions());
+        presence.Heartbeat("u1", "phone");
+        presence.Heartbeat("u1", "pc");
+        presence.Heartbeat("u2", "phone");
+        presence.Offline("u1", "phone");
+        presence.Offline("u2", "phone");
+
+        auto keys = ByKey(presence.TakeBatch(1000));
+        ASSERT_EQ(keys.size(), 1u);
+        EXPECT_EQ(keys["p:u1"], (std::vector<std::string>{"pc"}));
+    }
+}
@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include "logger.h"
+#include "redis_client.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InstantSocial
+{
+    // 需要可连接的 Redis, 地址与 odb_handler_test 的数据库在同一台测试机上
+    class RedisIntegrationTest : public ::testing::Test
+    {
+    protected:
+        static void SetUpTestSuite()
+        {
+            init_logger(false, "test_logs.txt", 0);
+        }
+
+        void SetUp() override
+        {
+            RedisOptions options;
+            options.host = "192.168.113.205";
+            options.port = 6379;
+            options.metrics_prefix = "";
+            client_ = RedisFactory::Create(options);
+            ASSERT_NE(client_, nullptr) << "Redis 连接失败";
+        }
+
+        // 每个用例使用独立的 key 前缀, 互不干扰, 也不会读到之前运行残留的数据
+        static std::string TestPrefix(const std::string &name)
+        {
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            return "gtest:" + name + ":" + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(now).count()) + ":";
+        }
+
+        RedisClient::Ptr client_;
+    };
+
+    TEST_F(RedisIntegrationTest, PresenceHeartbeatAndExpiry)
+    {
+        PresenceOptions options;
+        options.ttl = std::chrono::milliseconds(500);
+        options.flush_interval = std::chrono::hours(1);
+        options.key_prefix = TestPrefix("presence");
+        Presence presence(client_, options);
+
+        presence.Online("u1", "phone");
+        EXPECT_TRUE(presence.IsOnline("u1"));
+
+        // 心跳在 Flush 之前只在本地缓冲
+        presence.Heartbeat("u2", "phone");
+        presence.Heartbeat("u2", "pc");
+        EXPECT_FALSE(presence.IsOnline("u2"));
+        presence.Flush();
+        EXPECT_EQ(presence.AreOnline({"u2", "u3", "u1"}), (std::vector<bool>{true, false, true}));
+        auto devices = presence.OnlineDevices("u2");
+        std::sort(devices.begin(), devices.end());
+        EXPECT_EQ(devices, (std::vector<std::string>{"pc", "phone"}));
+        // 整个 key 随 ttl 过期, 不会遗留离线用户的 ZSET
+        long long pttl = client_->Execute([&](auto &r) { return r.pttl(options.key_prefix + "u2"); });
+        EXPECT_GT(pttl, 0);
+        EXPECT_LE(pttl, 500);
+
+        presence.Offline("u1", "phone");
+        EXPECT_FALSE(presence.IsOnline("u1"));
+
+        // 超过 ttl 没有心跳视为离线, 即使 key 还没被 Redis 删除
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        EXPECT_EQ(presence.AreOnline({"u1", "u2"}), (std::vector<bool>{false, false}));
+        EXPECT_TRUE(presence.OnlineDevices("u2").empty());
+    }
+
+    TEST_F(RedisIntegrationTest, AutoPipelineRepliesReachTheirCallers)
+    {
+        AutoPipelineOptions options;
+        options.enabled = true;
+        options.max_batch = 16;
+        options.flushers = 2;
+        client_->EnableAutoPipeline(options);
+        std::string prefix = TestPrefix("auto_pipeline");
+
+        // 多线程并发的命令被合并进同一批流水线, 每个调用方取回自己 key 的值
+        const int threads = 16, per_thread = 50;
+        std::atomic<int> mismatched{0};
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]()
+            {
+                for (int i = 0; i < per_thread; ++i)
+                {
+                    std::string key = prefix + std::to_string(t) + ":" + std::to_string(i);
+                    client_->Set(key, key, std::chrono::milliseconds(10000));
+                    auto value = client_->Get(key);
+                    if (!value || *value != key) ++mismatched;
+                    if (client_->Del(key) != 1) ++mismatched;
+                }
+            });
+        }
+        for (auto &w : workers) w.join();
+        EXPECT_EQ(mismatched.load(), 0);
+    }
+
+    TEST_F(RedisIntegrationTest, AutoPipelineServesOthersWhileAFlushIsInFlight)
+    {
+        AutoPipelineOptions options;
+        options.flushers = 2;
+        AutoPipeline pipeline(client_.get(), options);
+        std::string prefix = TestPrefix("auto_pipeline_busy");
+        client_->Set(prefix + "k", "v", std::chrono::milliseconds(10000));
+
+        // 一个刷新线程阻塞在 BLPOP 上, 之后的命令由另一个刷新线程发送, 不必等它返回
+        auto start = std::chrono::steady_clock::now();
+        auto blocked = pipeline.Submit<sw::redis::OptionalStringPair>(prefix + "empty", [prefix](sw::redis::Pipeline &pipe)
+        {
+            pipe.command("BLPOP", prefix + "empty", "1");
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::vector<std::future<sw::redis::OptionalString>> gets;
+        for (int i = 0; i < 8; ++i)
+        {
+            gets.push_back(pipeline.Submit<sw::redis::OptionalString>(prefix + "k", [prefix](sw::redis::Pipeline &pipe) { pipe.get(prefix + "k"); }));
+        }
+        for (auto &get : gets)
+        {
+            auto value = get.get();
+            ASSERT_TRUE(value);
+            EXPECT_EQ(*value, "v");
+        }
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(800));
+        EXPECT_EQ(blocked.wait_for(std::chrono::milliseconds(0)), std::future_status::timeout);
+
+        EXPECT_FALSE(blocked.get());
+        client_->Del(prefix + "k");
+    }
+
+    TEST_F(RedisIntegrationTest, AutoPipelineErrorOnlyFailsItsCaller)
+    {
+        AutoPipelineOptions options;
+        options.window = std::chrono::microseconds(50000);
+        options.flushers = 1;
+        AutoPipeline pipeline(client_.get(), options);
+        std::string prefix = TestPrefix("auto_pipeline_error");
+        client_->Set(prefix + "text", "not a number", std::chrono::milliseconds(10000));
+
+        // 攒批窗口内提交的三条命令在同一条流水线中, 只有 INCR 非数字的那条失败
+        auto before = pipeline.Submit<long long>(prefix + "n1", [prefix](sw::redis::Pipeline &pipe) { pipe.incr(prefix + "n1"); });
+        auto bad = pipeline.Submit<long long>(prefix + "text", [prefix](sw::redis::Pipeline &pipe) { pipe.incr(prefix + "text"); });
+        auto after = pipeline.Submit<long long>(prefix + "n2", [prefix](sw::redis::Pipeline &pipe) { pipe.incr(prefix + "n2"); });
+
+        EXPECT_EQ(before.get(), 1);
+        EXPECT_THROW(bad.get(), sw::redis::ReplyError);
+        EXPECT_EQ(after.get(), 1);
+        for (auto key : {"n1", "n2", "text"}) client_->Del(prefix + key);
+    }
+
+    TEST_F(RedisIntegrationTest, ScriptFallsBackToEvalOnNoScript)
+    {
+        std::string prefix = TestPrefix("script");
+        // 脚本内容带上唯一前缀, 服务器上必然还没有缓存
+        RedisScript script("return ARGV[1] .. '" + prefix + "'");
+        std::vector<std::string> keys = {prefix + "k"};
+        std::vector<std::string> args = {"v:"};
+
+        auto first = client_->Execute([&](auto &r) { return script.Eval<std::string>(r, keys, args); });
+        EXPECT_EQ(first, "v:" + prefix);
+
+        // 首次调用以 EVAL 载入后, 直接 EVALSHA 即可执行
+        auto second = client_->Execute([&](auto &r)
+        {
+            return r.template evalsha<std::string>(script.Sha(), keys.begin(), keys.end(), args.begin(), args.end());
+        });
+        EXPECT_EQ(second, "v:" + prefix);
+    }
+
+    TEST_F(RedisIntegrationTest, InvalidatorStopsWithoutSocketTimeout)
+    {
+        RedisOptions options;
+        options.host = "192.168.113.205";
+        options.port = 6379;
+        options.metrics_prefix = "";
+        options.socket_timeout = std::chrono::milliseconds(0);
+        auto client = RedisFactory::Create(options);
+        ASSERT_NE(client, nullptr);
+
+        std::string channel = TestPrefix("invalidator") + "channel";
+        std::promise<std::string> received;
+        std::atomic<bool> got{false};
+        auto invalidator = std::make_unique<CacheInvalidator>(client, channel,
+            [&](const std::string &key) { if (!got.exchange(true)) received.set_value(key); }, [] {});
+
+        // 订阅建立前发布的消息会丢失, 持续发布直到收到
+        auto fut = received.get_future();
+        for (int i = 0; i < 50 && fut.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready; ++i)
+        {
+            client_->Execute([&](auto &r) { r.publish(channel, "k"); });
+        }
+        ASSERT_EQ(fut.wait_for(std::chrono::milliseconds(0)), std::future_status::ready);
+        EXPECT_EQ(fut.get(), "k");
+
+        // consume 不会超时返回, 析构依靠唤醒频道退出
+        auto start = std::chrono::steady_clock::now();
+        invalidator.reset();
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(2000));
+    }
+}
@@ -0,0 +1,169 @@
+#include "user_cache.h"
+#include <gtest/gtest.h>
+#include <string>
+
+namespace InstantSocial
+{
+    namespace
+    {
+        UserCacheOptions TestOptions(size_t capacity_bytes = 1 << 20)
+        {
+            UserCacheOptions options;
+            options.shards = 4;
+            options.capacity_bytes = capacity_bytes;
+            options.metrics_prefix = "";
+            return options;
+        }
+
+        void Fill(UserCache &cache, const UserEntity &user)
+        {
+            cache.Fill(user, cache.Epoch(user.user_id()));
+        }
+
+        UserEntity MakeUser(const std::string &user_id, const std::string &phone, const std::string &email)
+        {
+            UserEntity user(user_id, "nick_" + user_id, std::string("password"));
+            user.phone(phone);
+            user.email(email);
+            return user;
+        }
+    }
+
+    TEST(UserCacheTest, LookupByIdPhoneAndEmail)
+    {
+        UserCache cache(TestOptions());
+        UserCache::User user;
+        std::string user_id;
+        EXPECT_FALSE(cache.GetById("u1", user));
+
+        Fill(cache, MakeUser("u1", "13800000001", "u1@example.com"));
+        ASSERT_TRUE(cache.GetById("u1", user));
+        EXPECT_EQ(user->nickname(), "nick_u1");
+        ASSERT_TRUE(cache.GetByPhone("13800000001", user, user_id));
+        EXPECT_EQ(user->user_id(), "u1");
+        ASSERT_TRUE(cache.GetByEmail("u1@example.com", user, user_id));
+        EXPECT_EQ(user->user_id(), "u1");
+        EXPECT_FALSE(cache.GetByPhone("13800000002", user, user_id));
+    }
+
+    TEST(UserCacheTest, InvalidateDropsAllKeysOfUser)
+    {
+        UserCache cache(TestOptions());
+        Fill(cache, MakeUser("u1", "13800000001", "u1@example.com"));
+        cache.Invalidate("u1");
+
+        UserCache::User user;
+        std::string user_id;
+        EXPECT_FALSE(cache.GetById("u1", user));
+        EXPECT_FALSE(cache.GetByPhone("13800000001", user, user_id));
+        EXPECT_FALSE(cache.GetByEmail("u1@example.com", user, user_id));
+    }
+
+    TEST(UserCacheTest, ClearDropsAllUsers)
+    {
+        UserCache cache(TestOptions());
+        Fill(cache, MakeUser("u1", "13800000001", ""));
+        Fill(cache, MakeUser("u2", "13800000002", ""));
+        cache.Clear();
+
+        UserCache::User user;
+        std::string user_id;
+        EXPECT_FALSE(cache.GetById("u1", user));
+        EXPECT_FALSE(cache.GetByPhone("13800000002", user, user_id));
+    }
+
+    TEST(UserCacheTest, ChangedPhoneDoesNotHitOldIndex)
+    {
+        UserCache cache(TestOptions());
+        Fill(cache, MakeUser("u1", "13800000001", "u1@example.com"));
+        cache.Invalidate("u1");
+        Fill(cache, MakeUser("u1", "13800000009", "u1@example.com"));
+
+        UserCache::User user;
+        std::string user_id;
+        EXPECT_FALSE(cache.GetByPhone("13800000001", user, user_id));
+        ASSERT_TRUE(cache.GetByPhone("13800000009", user, user_id));
+        EXPECT_EQ(user->user_id(), "u1");
+    }
+
+    TEST(UserCacheTest, FillAfterInvalidationIsDropped)
+    {
+        UserCache cache(TestOptions());
+        // 读库前取得的 epoch, 读库期间该用户被失效
+        uint64_t epoch = cache.Epoch("u1");
+        cache.Invalidate("u1");
+        cache.Fill(MakeUser("u1", "13800000001", ""), epoch);
+
+        UserCache::User user;
+        EXPECT_FALSE(cache.GetById("u1", user));
+        Fill(cache, MakeUser("u1", "13800000001", ""));
+        EXPECT_TRUE(cache.GetById("u1", user));
+    }
+
+    TEST(UserCacheTest, InvalidationInOtherShardKeepsFill)
+    {
+        UserCache cache(TestOptions());
+        // 找一个与 u1 不在同一分片的用户
+        std::string other;
+        for (int i = 0; i < 100 && other.empty(); ++i)
+        {
+            std::string id = "other_" + std::to_string(i);
+            uint64_t before = cache.Epoch(id);
+            cache.Invalidate("u1");
+            if (cache.Epoch(id) == before) other = id;
+        }
+        ASSERT_FALSE(other.empty());
+
+        uint64_t epoch = cache.Epoch(other);
+        cache.Invalidate("u1");
+        cache.Fill(MakeUser(other, "13800000002", ""), epoch);
+        UserCache::User user;
+        EXPECT_TRUE(cache.GetById(other, user));
+    }
+
+    TEST(UserCacheTest, IndexFillGivesUserIdForNextLookup)
+    {
+        UserCache cache(TestOptions());
+        cache.FillIndexes(MakeUser("u1", "13800000001", ""));
+
+        UserCache::User user;
+        std::string user_id;
+        EXPECT_FALSE(cache.GetByPhone("13800000001", user, user_id));
+        EXPECT_EQ(user_id, "u1");
+        cache.Fill(MakeUser("u1", "13800000001", ""), cache.Epoch(user_id));
+        ASSERT_TRUE(cache.GetByPhone("13800000001", user, user_id));
+        EXPECT_EQ(user->user_id(), "u1");
+    }
+
+    TEST(UserCacheTest, BoundedByBytesAndReportsShardStats)
+    {
+        const size_t capacity = 64 * 1024;
+        UserCache cache(TestOptions(capacity));
+        for (int i = 0; i < 2000; ++i)
+        {
+            std::string id = "user_" + std::to_string(i);
+            Fill(cache, MakeUser(id, "1390000" + std::to_string(i), id + "@example.com"));
+        }
+
+        int64_t bytes = 0;
+        for (size_t i = 0; i < cache.ShardCount(); ++i)
+        {
+            bytes += cache.ShardBytes(i);
+        }
+        EXPECT_GT(bytes, 0);
+        EXPECT_GT(cache.PhoneIndexBytes(), 0);
+        EXPECT_GT(cache.EmailIndexBytes(), 0);
+        EXPECT_LE(bytes + cache.PhoneIndexBytes() + cache.EmailIndexBytes(), static_cast<int64_t>(capacity));
+
+        UserCache::User user;
+        std::string user_id;
+        EXPECT_TRUE(cache.GetById("user_1999", user));
+        EXPECT_FALSE(cache.GetById("user_0", user));
+        double hit_rate = 0;
+        for (size_t i = 0; i < cache.ShardCount(); ++i)
+        {
+            hit_rate += cache.ShardHitRate(i);
+        }
+        EXPECT_GT(hit_rate, 0.0);
+    }
+}
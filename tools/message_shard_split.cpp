@@ -0,0 +1,386 @@
+// 消息分片在线拆分工具: 把源分片的一部分桶迁移到目标分片, 迁移期间服务不停写
+//
+// 分片表存放在 etcd 的 --map_key 下, 各服务监听该 key 并调用 MessageShardRouter::UpdateMap.
+// 阶段(--phase):
+//   init     分片表不存在时按 --init_shards 均匀分配并写入
+//   begin    把选中的桶标记为迁往 --target, 服务开始双写
+//   copy     按桶把源分片的历史消息补到目标分片, 重复直到一轮没有新补的数据, 再删除目标分片上源分片已没有的消息
+//   cutover  选中的桶归属切换到目标分片, 读写都转到目标分片
+//   cleanup  删除源分片上已迁走的桶的数据
+//   all      依次执行 begin、copy、cutover、cleanup, 每次改表后等待 --propagation_wait_s 秒
+#include "logger.h"
+#include "odb_client.h"
+#include "message_entity.h"
+#include "message_entity-odb.hxx"
+#include "message_shard_router.h"
+#include <etcd/Client.hpp>
+#include <gflags/gflags.h>
+#include <set>
+#include <sstream>
+#include <thread>
+
+DEFINE_string(etcd_host, "http://127.0.0.1:2379", "etcd 地址");
+DEFINE_string(map_key, "/config/message_shard_map", "分片表在 etcd 中的 key");
+DEFINE_string(shards, "", "分片 MySQL 地址列表 host:port, 逗号分隔, 顺序即分片编号");
+DEFINE_string(user, "root", "MySQL 用户");
+DEFINE_string(password, "", "MySQL 密码");
+DEFINE_string(db, "instant_social", "MySQL 库名");
+DEFINE_int32(source, -1, "源分片编号");
+DEFINE_int32(target, -1, "目标分片编号");
+DEFINE_string(buckets, "", "要迁移的桶范围 a-b, 默认取源分片所拥有桶的后一半");
+DEFINE_string(phase, "all", "init|begin|copy|cutover|cleanup|all");
+DEFINE_int32(init_shards, 1, "init 阶段的分片数");
+DEFINE_int32(init_buckets, 1024, "init 阶段的桶数");
+DEFINE_int32(propagation_wait_s, 10, "改表后等待各服务加载新表的时间");
+DEFINE_int32(batch, 500, "补数据与清理时每批的行数");
+
+namespace
+{
+    using namespace InstantSocial;
+    using Database = std::shared_ptr<odb::core::database>;
+
+    std::vector<std::string> Split(const std::string &text, char sep)
+    {
+        std::vector<std::string> items;
+        std::stringstream ss(text);
+        std::string item;
+        while (std::getline(ss, item, sep))
+        {
+            if (!item.empty()) items.push_back(item);
+        }
+        return items;
+    }
+
+    std::vector<Database> ConnectShards()
+    {
+        MySQLPoolOptions pool_options;
+        pool_options.min_connections = 1;
+        pool_options.max_connections = 2;
+        pool_options.metrics_prefix = "";
+        std::vector<Database> shards;
+        for (auto &endpoint : Split(FLAGS_shards, ','))
+        {
+            auto parts = Split(endpoint, ':');
+            unsigned int port = parts.size() > 1 ? std::stoul(parts[1]) : 3306;
+            auto db = ODBFactory::Create(DatabaseType::MySQL, parts[0], FLAGS_user, FLAGS_password, FLAGS_db, port, pool_options);
+            if (!db)
+            {
+                throw std::runtime_error("connect shard " + endpoint + " failed");
+            }
+            shards.push_back(db);
+        }
+        return shards;
+    }
+
+    // 读取分片表及其 modified_index, 写回时做比较交换, 避免覆盖其他人的修改
+    bool LoadMap(etcd::Client &etcd, ShardMap &map, int64_t &index)
+    {
+        auto resp = etcd.get(FLAGS_map_key).get();
+        if (!resp.is_ok())
+        {
+            LOG_ERROR("Read shard map {} failed: {}", FLAGS_map_key, resp.error_message());
+            return false;
+        }
+        index = resp.value().modified_index();
+        if (!ShardMap::Parse(resp.value().as_string(), map))
+        {
+            LOG_ERROR("Parse shard map {} failed", FLAGS_map_key);
+            return false;
+        }
+        return true;
+    }
+
+    bool StoreMap(etcd::Client &etcd, ShardMap map, int64_t index)
+    {
+        ++map.version;
+        auto resp = etcd.modify_if(FLAGS_map_key, map.Format(), index).get();
+        if (!resp.is_ok())
+        {
+            LOG_ERROR("Write shard map failed (modified concurrently?): {}", resp.error_message());
+            return false;
+        }
+        LOG_INFO("Shard map version {} published:\n{}", map.version, map.Format());
+        return true;
+    }
+
+    void WaitPropagation()
+    {
+        LOG_INFO("Waiting {}s for services to load the new shard map", FLAGS_propagation_wait_s);
+        std::this_thread::sleep_for(std::chrono::seconds(FLAGS_propagation_wait_s));
+    }
+
+    // 本次迁移的桶:
+    //   begin   --buckets 指定范围内源分片拥有的桶, 默认取其后一半
+    //   copy/cutover  正在从源分片迁往目标分片的桶(可用 --buckets 缩小范围)
+    //   cleanup 已切换到目标分片的桶, 必须用 --buckets 指定
+    std::vector<size_t> SelectBuckets(const ShardMap &map, const std::string &phase)
+    {
+        size_t begin = 0, end = map.Buckets() - 1;
+        if (!FLAGS_buckets.empty())
+        {
+            auto range = Split(FLAGS_buckets, '-');
+            begin = std::stoul(range[0]);
+            end = range.size() > 1 ? std::stoul(range[1]) : begin;
+        }
+        else if (phase == "cleanup")
+        {
+            LOG_ERROR("--buckets is required for the cleanup phase");
+            return {};
+        }
+
+        std::vector<size_t> selected;
+        for (size_t b = begin; b <= end && b < map.Buckets(); ++b)
+        {
+            bool match = false;
+            if (phase == "begin" || phase == "all") match = map.owner[b] == FLAGS_source && map.migrating_to[b] == ShardMap::kNone;
+            else if (phase == "cleanup") match = map.owner[b] == FLAGS_target && map.migrating_to[b] == ShardMap::kNone;
+            else match = map.owner[b] == FLAGS_source && map.migrating_to[b] == FLAGS_target;
+            if (match) selected.push_back(b);
+        }
+        if ((phase == "begin" || phase == "all") && FLAGS_buckets.empty())
+        {
+            selected.erase(selected.begin(), selected.begin() + selected.size() / 2);
+        }
+        return selected;
+    }
+
+    std::string BucketCondition(const ShardMap &map, const std::vector<size_t> &buckets)
+    {
+        std::ostringstream cond;
+        cond << "CRC32(session_id) % " << map.Buckets() << " IN (";
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            cond << (i ? "," : "") << buckets[i];
+        }
+        cond << ")";
+        return cond.str();
+    }
+
+    bool Begin(etcd::Client &etcd, const std::vector<size_t> &buckets)
+    {
+        ShardMap map;
+        int64_t index = 0;
+        if (!LoadMap(etcd, map, index)) return false;
+        for (size_t b : buckets)
+        {
+            map.migrating_to[b] = FLAGS_target;
+        }
+        return StoreMap(etcd, map, index);
+    }
+
+    // 按主键 id 顺序分页扫描源分片, 目标分片没有的消息补写过去, 返回补写条数. 双写时各分片上同一条消息的 id 相同
+    size_t CopyOnce(const Database &source, const Database &target, const std::string &bucket_cond)
+    {
+        typedef odb::query<MessageEntity> Query;
+        typedef odb::result<MessageEntity> Result;
+        size_t copied = 0;
+        uint64_t last_id = 0;
+        while (true)
+        {
+            std::vector<MessageEntity> page;
+            {
+                odb::transaction t(source->begin());
+                Query cond = Query(bucket_cond) && Query::id > last_id;
+                Result r(source->query<MessageEntity>(cond + ("ORDER BY id LIMIT " + std::to_string(FLAGS_batch))));
+                for (auto it = r.begin(); it != r.end(); ++it)
+                {
+                    page.push_back(*it);
+                }
+                t.commit();
+            }
+            if (page.empty()) break;
+            last_id = page.back().id();
+
+            std::vector<uint64_t> ids;
+            for (auto &message : page) ids.push_back(message.id());
+            odb::transaction t(target->begin());
+            std::set<uint64_t> existing;
+            Result r(target->query<MessageEntity>(Query::id.in_range(ids.begin(), ids.end())));
+            for (auto it = r.begin(); it != r.end(); ++it)
+            {
+                existing.insert(it->id());
+            }
+            for (auto &message : page)
+            {
+                if (existing.count(message.id())) continue;
+                target->persist(message);
+                ++copied;
+            }
+            t.commit();
+        }
+        return copied;
+    }
+
+    // 按主键 id 顺序分页扫描目标分片, 删除源分片上已不存在的消息, 返回删除条数.
+    // Remove 先删目标分片再删源分片, 若夹在 CopyOnce 读源分片与写目标分片之间, 被删的消息会被补回目标分片,
+    // 之后的补数据只增不删, 切换后这些消息会重新出现. 双写总是先写源分片, 因此只在目标分片上存在的消息都是这种残留
+    size_t ReconcileOnce(const Database &source, const Database &target, const std::string &bucket_cond)
+    {
+        typedef odb::query<MessageEntity> Query;
+        typedef odb::result<MessageEntity> Result;
+        size_t removed = 0;
+        uint64_t last_id = 0;
+        while (true)
+        {
+            std::vector<uint64_t> ids;
+            {
+                odb::transaction t(target->begin());
+                Query cond = Query(bucket_cond) && Query::id > last_id;
+                Result r(target->query<MessageEntity>(cond + ("ORDER BY id LIMIT " + std::to_string(FLAGS_batch))));
+                for (auto it = r.begin(); it != r.end(); ++it)
+                {
+                    ids.push_back(it->id());
+                }
+                t.commit();
+            }
+            if (ids.empty()) break;
+            last_id = ids.back();
+
+            std::set<uint64_t> present;
+            {
+                odb::transaction t(source->begin());
+                Result r(source->query<MessageEntity>(Query::id.in_range(ids.begin(), ids.end())));
+                for (auto it = r.begin(); it != r.end(); ++it)
+                {
+                    present.insert(it->id());
+                }
+                t.commit();
+            }
+            std::vector<uint64_t> stale;
+            for (auto &id : ids)
+            {
+                if (!present.count(id)) stale.push_back(id);
+            }
+            if (stale.empty()) continue;
+            odb::transaction t(target->begin());
+            removed += target->erase_query<MessageEntity>(Query::id.in_range(stale.begin(), stale.end()));
+            t.commit();
+        }
+        return removed;
+    }
+
+    bool Copy(const std::vector<Database> &shards, const ShardMap &map, const std::vector<size_t> &buckets)
+    {
+        std::string cond = BucketCondition(map, buckets);
+        // 双写生效前写入源分片的消息可能在第一轮扫描之后才落库, 重复扫描直到一轮没有新补的数据
+        for (int pass = 1; pass <= 5; ++pass)
+        {
+            size_t copied = CopyOnce(shards[FLAGS_source], shards[FLAGS_target], cond);
+            LOG_INFO("Copy pass {}: {} messages copied", pass, copied);
+            if (copied == 0)
+            {
+                // 最后一轮没有补写, 之后不会再有被删除的消息补回目标分片
+                size_t removed = ReconcileOnce(shards[FLAGS_source], shards[FLAGS_target], cond);
+                LOG_INFO("Reconcile: {} messages removed from source but copied to target deleted", removed);
+                return true;
+            }
+        }
+        LOG_ERROR("Copy did not converge, check that every service has loaded the migrating shard map");
+        return false;
+    }
+
+    bool Cutover(etcd::Client &etcd, const std::vector<size_t> &buckets)
+    {
+        ShardMap map;
+        int64_t index = 0;
+        if (!LoadMap(etcd, map, index)) return false;
+        for (size_t b : buckets)
+        {
+            if (map.migrating_to[b] != FLAGS_target)
+            {
+                LOG_ERROR("Bucket {} is not migrating to shard {}, run the begin phase first", b, FLAGS_target);
+                return false;
+            }
+            map.owner[b] = FLAGS_target;
+            map.migrating_to[b] = ShardMap::kNone;
+        }
+        return StoreMap(etcd, map, index);
+    }
+
+    bool Cleanup(const std::vector<Database> &shards, const ShardMap &map, const std::vector<size_t> &buckets)
+    {
+        std::string sql = "DELETE FROM message WHERE " + BucketCondition(map, buckets) + " LIMIT " + std::to_string(FLAGS_batch);
+        auto &source = shards[FLAGS_source];
+        unsigned long long total = 0;
+        while (true)
+        {
+            odb::transaction t(source->begin());
+            auto removed = source->execute(sql);
+            t.commit();
+            total += removed;
+            if (removed == 0) break;
+        }
+        LOG_INFO("Removed {} migrated messages from shard {}", total, FLAGS_source);
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    InstantSocial::init_logger(false, "message_shard_split.log", 0);
+
+    try
+    {
+        etcd::Client etcd(FLAGS_etcd_host);
+        if (FLAGS_phase == "init")
+        {
+            auto map = ShardMap::Uniform(FLAGS_init_shards, FLAGS_init_buckets);
+            auto resp = etcd.add(FLAGS_map_key, map.Format()).get();
+            if (!resp.is_ok())
+            {
+                LOG_ERROR("Init shard map failed (already exists?): {}", resp.error_message());
+                return 1;
+            }
+            LOG_INFO("Shard map initialized:\n{}", map.Format());
+            return 0;
+        }
+
+        auto shards = ConnectShards();
+        int shard_count = static_cast<int>(shards.size());
+        if (FLAGS_source < 0 || FLAGS_source >= shard_count || FLAGS_target < 0 || FLAGS_target >= shard_count ||
+            FLAGS_source == FLAGS_target)
+        {
+            LOG_ERROR("--source and --target must be different shards in [0, {})", shard_count);
+            return 1;
+        }
+
+        ShardMap map;
+        int64_t index = 0;
+        if (!LoadMap(etcd, map, index)) return 1;
+        auto buckets = SelectBuckets(map, FLAGS_phase);
+        if (buckets.empty())
+        {
+            LOG_ERROR("No bucket selected for phase {}", FLAGS_phase);
+            return 1;
+        }
+        LOG_INFO("Moving {} buckets ({} - {}) from shard {} to shard {}",
+                 buckets.size(), buckets.front(), buckets.back(), FLAGS_source, FLAGS_target);
+
+        bool all = FLAGS_phase == "all";
+        if (all || FLAGS_phase == "begin")
+        {
+            if (!Begin(etcd, buckets)) return 1;
+            if (all) WaitPropagation();
+        }
+        if (all || FLAGS_phase == "copy")
+        {
+            if (!Copy(shards, map, buckets)) return 1;
+        }
+        if (all || FLAGS_phase == "cutover")
+        {
+            if (!Cutover(etcd, buckets)) return 1;
+            if (all) WaitPropagation();
+        }
+        if (all || FLAGS_phase == "cleanup")
+        {
+            if (!Cleanup(shards, map, buckets)) return 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("Shard split failed: {}", e.what());
+        return 1;
+    }
+    return 0;
+}
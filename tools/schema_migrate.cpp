@@ -0,0 +1,86 @@
+// 表结构迁移工具: 查看当前版本与待执行的迁移, 或执行迁移
+//
+//   status   打印已执行的最大版本号与待执行的迁移
+//   migrate  按版本号依次执行待执行的迁移; 会阻塞写入的迁移需要 --allow_blocking, 应在维护窗口执行
+//   drop_auto_increment  去掉旧库 message.id 上的 AUTO_INCREMENT, 使其与新建的表一致. id 由 IdGenerator 分配,
+//            带着该属性也能正常写入, 因此不是必需的版本; 需要复制整表, 同样要求 --allow_blocking
+// 服务启动时也会执行在线迁移, 该工具用于提前执行、执行阻塞迁移或在多个分片上逐个执行.
+#include "logger.h"
+#include "odb_client.h"
+#include "schema_migrator.h"
+#include <gflags/gflags.h>
+#include <cstdio>
+
+DEFINE_string(host, "127.0.0.1", "MySQL 地址");
+DEFINE_int32(port, 3306, "MySQL 端口");
+DEFINE_string(user, "root", "MySQL 用户");
+DEFINE_string(password, "", "MySQL 密码");
+DEFINE_string(db, "instant_social", "MySQL 库名");
+DEFINE_string(action, "status", "status|migrate|drop_auto_increment");
+DEFINE_bool(allow_blocking, false, "执行会阻塞写入的迁移");
+DEFINE_int32(progress_interval_s, 5, "在线 DDL 的进度汇报周期(秒)");
+DEFINE_int32(lock_timeout_s, 60, "等待其他实例完成迁移的最长时间(秒)");
+
+int main(int argc, char *argv[])
+{
+    using namespace InstantSocial;
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    init_logger(false, "schema_migrate.log", 0);
+
+    MySQLPoolOptions pool_options;
+    pool_options.min_connections = 1;
+    pool_options.max_connections = 4;
+    pool_options.metrics_prefix = "";
+    auto db = ODBFactory::Create(DatabaseType::MySQL, FLAGS_host, FLAGS_user, FLAGS_password, FLAGS_db, FLAGS_port, pool_options);
+    if (!db)
+    {
+        LOG_ERROR("Connect {}:{} failed", FLAGS_host, FLAGS_port);
+        return 1;
+    }
+
+    SchemaMigratorOptions options;
+    options.allow_blocking = FLAGS_allow_blocking;
+    options.progress_interval = std::chrono::seconds(FLAGS_progress_interval_s);
+    options.lock_timeout = std::chrono::seconds(FLAGS_lock_timeout_s);
+    SchemaMigrator migrator(db, options);
+
+    try
+    {
+        if (FLAGS_action == "status")
+        {
+            printf("current version: %llu\n", static_cast<unsigned long long>(migrator.CurrentVersion()));
+            auto pending = migrator.Pending();
+            printf("pending: %zu\n", pending.size());
+            for (auto &migration : pending)
+            {
+                printf("  %llu %s%s\n", static_cast<unsigned long long>(migration.version), migration.description.c_str(),
+                       migration.online ? "" : " (blocks writes)");
+            }
+            return 0;
+        }
+        if (FLAGS_action == "migrate")
+        {
+            bool ok = migrator.Migrate();
+            printf("current version: %llu\n", static_cast<unsigned long long>(migrator.CurrentVersion()));
+            return ok ? 0 : 1;
+        }
+        if (FLAGS_action == "drop_auto_increment")
+        {
+            if (!FLAGS_allow_blocking)
+            {
+                LOG_ERROR("drop_auto_increment copies the whole message table, pass --allow_blocking to run it");
+                return 1;
+            }
+            migrator.DropAutoIncrement("message", "id", "BIGINT UNSIGNED NOT NULL");
+            printf("message.id extra: %s\n", migrator.ColumnExtra("message", "id").c_str());
+            return 0;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("Schema migration tool failed: {}", e.what());
+        return 1;
+    }
+    LOG_ERROR("Unknown action {}", FLAGS_action);
+    return 1;
+}